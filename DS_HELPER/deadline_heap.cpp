@@ -0,0 +1,138 @@
+#include "deadline_heap.hpp"
+
+/*!
+ *   @brief Sets up the heap
+ *   @param DeadlineHeapNode **storage array of at least capacity node pointers
+ *   @param int capacity
+ */
+void DeadlineHeap::init(DeadlineHeapNode **storage, int capacity)
+{
+    this->nodes = storage;
+    this->capacity = capacity;
+    this->count = 0;
+    this->next_sequence = 0;
+}
+
+/*!
+ *   @brief Moves the heap over to new storage, like a bigger array once there's more nodes that could go in it
+ *   @param DeadlineHeapNode **storage array of at least capacity node pointers
+ *   @param int capacity has to fit every node already in the heap
+ *   @returns The storage we were using before, so whoever handed it in can free it
+ */
+DeadlineHeapNode **DeadlineHeap::move_storage(DeadlineHeapNode **storage, int capacity)
+{
+    DeadlineHeapNode **old_storage = this->nodes;
+
+    // Nodes keep their index, so they only have to be copied over.
+    for (int n = 0; n < this->count; n++)
+        storage[n] = this->nodes[n];
+    this->nodes = storage;
+    this->capacity = capacity;
+    return old_storage;
+}
+
+/*!
+ *   @returns Whether or not node a comes out before node b
+ */
+bool DeadlineHeap::before(DeadlineHeapNode *a, DeadlineHeapNode *b)
+{
+    if (a->deadline != b->deadline)
+        return a->deadline < b->deadline;
+
+    // Same deadline, whoever got here first. Compared as a difference so it keeps working when the sequence wraps.
+    return (int32_t)(a->sequence - b->sequence) < 0;
+}
+
+/*!
+ *   @brief Puts a node at an index and lets it know where it is
+ */
+void DeadlineHeap::place(DeadlineHeapNode *node, int index)
+{
+    this->nodes[index] = node;
+    node->index = (int16_t)index;
+}
+
+/*!
+ *   @brief Moves the node at an index up until it's parent comes before it
+ */
+void DeadlineHeap::sift_up(int index)
+{
+    DeadlineHeapNode *node = this->nodes[index];
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if (!before(node, this->nodes[parent]))
+            break;
+        this->place(this->nodes[parent], index);
+        index = parent;
+    }
+    this->place(node, index);
+}
+
+/*!
+ *   @brief Moves the node at an index down until it comes before both it's children
+ */
+void DeadlineHeap::sift_down(int index)
+{
+    DeadlineHeapNode *node = this->nodes[index];
+    while (1)
+    {
+        int child = index * 2 + 1;
+        if (child >= this->count)
+            break;
+
+        // Whichever child comes first.
+        if (child + 1 < this->count && before(this->nodes[child + 1], this->nodes[child]))
+            child++;
+
+        if (!before(this->nodes[child], node))
+            break;
+        this->place(this->nodes[child], index);
+        index = child;
+    }
+    this->place(node, index);
+}
+
+/*!
+ *   @brief Puts a node in the heap
+ *   @param DeadlineHeapNode *node
+ *   @param uint64_t deadline
+ *   @returns false if the heap is full or the node is already in it
+ */
+bool DeadlineHeap::insert(DeadlineHeapNode *node, uint64_t deadline)
+{
+    if (node->index >= 0 || this->count == this->capacity)
+        return false;
+
+    node->deadline = deadline;
+    node->sequence = this->next_sequence++;
+    this->place(node, this->count);
+    this->count++;
+    this->sift_up(this->count - 1);
+    return true;
+}
+
+/*!
+ *   @brief Takes a node out of the heap, wherever it is.
+ *   @note Safe to call on a node that isn't in the heap.
+ */
+void DeadlineHeap::remove(DeadlineHeapNode *node)
+{
+    int index = node->index;
+    if (index < 0)
+        return;
+
+    node->index = -1;
+    this->count--;
+
+    // Was the last node, nothing has to move.
+    if (index == this->count)
+        return;
+
+    // Last node fills the hole, and goes whichever way it needs to.
+    this->place(this->nodes[this->count], index);
+    if (index > 0 && before(this->nodes[index], this->nodes[(index - 1) / 2]))
+        this->sift_up(index);
+    else
+        this->sift_down(index);
+}
@@ -0,0 +1,114 @@
+#ifndef _DEADLINE_HEAP_HPP
+#define _DEADLINE_HEAP_HPP
+
+// Deliberately only depends on stdint, so the heap can be built into host side simulations too.
+#include <stdint.h>
+#include <stddef.h>
+
+/*!
+ *   @brief Intrusive heap node, embedded in whatever we want ordered by deadline.
+ */
+struct DeadlineHeapNode
+{
+    /*!
+     *   @brief Absolute deadline, smallest one comes out on top
+     */
+    uint64_t deadline;
+
+    /*!
+     *   @brief General purpose pointer back to whatever owns the node
+     */
+    void *ptr;
+
+    /*!
+     *   @brief Where the node sits in the heap array, -1 if it isn't in the heap
+     */
+    int16_t index = -1;
+
+    /*!
+     *   @brief Order the node was inserted in, so nodes with the same deadline come out first in first out.
+     */
+    uint32_t sequence;
+};
+
+/*!
+ *   @brief Binary min heap of nodes ordered by earliest deadline
+ *   @note Capacity is fixed until new storage is handed in, storage is handed in so nothing is allocated.
+ *   @note Inserting and removing are O(log n), peeking the earliest deadline is O(1).
+ */
+class DeadlineHeap
+{
+public:
+    /*!
+     *   @brief Sets up the heap
+     *   @param DeadlineHeapNode **storage array of at least capacity node pointers
+     *   @param int capacity
+     */
+    void init(DeadlineHeapNode **storage, int capacity);
+
+    /*!
+     *   @brief Moves the heap over to new storage, like a bigger array once there's more nodes that could go in it
+     *   @param DeadlineHeapNode **storage array of at least capacity node pointers
+     *   @param int capacity has to fit every node already in the heap
+     *   @returns The storage we were using before, so whoever handed it in can free it
+     */
+    DeadlineHeapNode **move_storage(DeadlineHeapNode **storage, int capacity);
+
+    /*!
+     *   @brief Puts a node in the heap
+     *   @param DeadlineHeapNode *node
+     *   @param uint64_t deadline
+     *   @returns false if the heap is full or the node is already in it
+     */
+    bool insert(DeadlineHeapNode *node, uint64_t deadline);
+
+    /*!
+     *   @brief Takes a node out of the heap, wherever it is.
+     *   @note Safe to call on a node that isn't in the heap.
+     */
+    void remove(DeadlineHeapNode *node);
+
+    /*!
+     *   @returns The node with the earliest deadline, NULL if the heap is empty
+     */
+    DeadlineHeapNode *peek(void)
+    {
+        return this->count ? this->nodes[0] : NULL;
+    }
+
+    /*!
+     *   @returns How many nodes are in the heap
+     */
+    int size(void)
+    {
+        return this->count;
+    }
+
+private:
+    /*!
+     *   @returns Whether or not node a comes out before node b
+     */
+    static bool before(DeadlineHeapNode *a, DeadlineHeapNode *b);
+
+    /*!
+     *   @brief Moves the node at an index up until it's parent comes before it
+     */
+    void sift_up(int index);
+
+    /*!
+     *   @brief Moves the node at an index down until it comes before both it's children
+     */
+    void sift_down(int index);
+
+    /*!
+     *   @brief Puts a node at an index and lets it know where it is
+     */
+    void place(DeadlineHeapNode *node, int index);
+
+    DeadlineHeapNode **nodes = NULL;
+    int capacity = 0;
+    int count = 0;
+    uint32_t next_sequence = 0;
+};
+
+#endif
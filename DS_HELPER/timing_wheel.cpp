@@ -0,0 +1,213 @@
+#include "timing_wheel.hpp"
+
+/*!
+ *   @brief Sets up the wheel, everything before now is considered processed
+ *   @param uint64_t now current time
+ */
+void TimingWheel::init(uint64_t now)
+{
+    for (int level = 0; level < TIMING_WHEEL_LEVELS; level++)
+    {
+        for (int slot = 0; slot < TIMING_WHEEL_SLOTS; slot++)
+            this->slots[level][slot] = NULL;
+        this->occupied[level] = 0;
+    }
+    this->current = now;
+    this->count = 0;
+}
+
+/*!
+ *   @brief Places a node in the slot it belongs to, relative to where the wheel is right now
+ *   @param uint64_t expires when the node goes off, never earlier than the current time
+ */
+void TimingWheel::place(TimingWheelNode *node, uint64_t expires)
+{
+
+    // Anything further out than the wheel covers sits in the top level, and gets placed again once it cascades down.
+    uint64_t delta = expires - this->current;
+    if (delta >= (1ULL << (TIMING_WHEEL_LEVEL_BITS * TIMING_WHEEL_LEVELS)))
+    {
+        delta = (1ULL << (TIMING_WHEEL_LEVEL_BITS * TIMING_WHEEL_LEVELS)) - 1;
+        expires = this->current + delta;
+    }
+
+    // Lowest level whose range covers the node.
+    int level = 0;
+    while (level < TIMING_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMING_WHEEL_LEVEL_BITS * (level + 1))))
+        level++;
+
+    int slot = (int)((expires >> (TIMING_WHEEL_LEVEL_BITS * level)) & (TIMING_WHEEL_SLOTS - 1));
+
+    // Push onto the front of the slot list.
+    node->prev = NULL;
+    node->next = this->slots[level][slot];
+    if (node->next != NULL)
+        node->next->prev = node;
+    this->slots[level][slot] = node;
+    this->occupied[level] |= (1ULL << slot);
+    node->slot = (int16_t)(level * TIMING_WHEEL_SLOTS + slot);
+}
+
+/*!
+ *   @brief Puts a node in the wheel to expire at a certain time.
+ *   @note If the time already passed, the node expires on the next call to advance
+ *   @param TimingWheelNode *node
+ *   @param uint64_t expires absolute time
+ */
+void TimingWheel::insert(TimingWheelNode *node, uint64_t expires)
+{
+    // Re-arming a node that is already in the wheel.
+    if (node->slot >= 0)
+        this->cancel(node);
+
+    node->expires = expires;
+
+    // Anything that should have already expired goes off on the very next tick
+    if (expires <= this->current)
+        expires = this->current + 1;
+
+    this->place(node, expires);
+    this->count++;
+}
+
+/*!
+ *   @brief Takes a node out of the wheel before it expires
+ *   @note Safe to call on a node that isn't in the wheel.
+ *   @param TimingWheelNode *node
+ */
+void TimingWheel::cancel(TimingWheelNode *node)
+{
+    if (node->slot < 0)
+        return;
+
+    int level = node->slot / TIMING_WHEEL_SLOTS;
+    int slot = node->slot % TIMING_WHEEL_SLOTS;
+
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        this->slots[level][slot] = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+
+    if (this->slots[level][slot] == NULL)
+        this->occupied[level] &= ~(1ULL << slot);
+
+    node->next = NULL;
+    node->prev = NULL;
+    node->slot = -1;
+    this->count--;
+}
+
+/*!
+ *   @brief Takes every node out of a slot, and places them again relative to where the wheel is now.
+ */
+void TimingWheel::cascade(int level, int slot)
+{
+    TimingWheelNode *node = this->slots[level][slot];
+    this->slots[level][slot] = NULL;
+    this->occupied[level] &= ~(1ULL << slot);
+
+    while (node != NULL)
+    {
+        TimingWheelNode *next = node->next;
+        // Cascading happens before the bottom level expires, so anything due right now still goes off this tick.
+        this->place(node, node->expires);
+        node = next;
+    }
+}
+
+/*!
+ *   @returns The next time something in the wheel expires or cascades down, UINT64_MAX if the wheel is empty
+ */
+uint64_t TimingWheel::next_event(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    // Closest occupied slot in the bottom level, found by rotating the bitmap so the next tick is bit 0.
+    if (this->occupied[0] != 0)
+    {
+        int start = (int)((this->current + 1) & (TIMING_WHEEL_SLOTS - 1));
+        uint64_t rotated = (this->occupied[0] >> start) | (start ? (this->occupied[0] << (TIMING_WHEEL_SLOTS - start)) : 0);
+        next = this->current + 1 + __builtin_ctzll(rotated);
+    }
+
+    // Higher levels only do anything on their boundaries, and the closest boundary is from the lowest occupied level.
+    for (int level = 1; level < TIMING_WHEEL_LEVELS; level++)
+    {
+        if (this->occupied[level] == 0)
+            continue;
+
+        int shift = TIMING_WHEEL_LEVEL_BITS * level;
+        uint64_t boundary = ((this->current >> shift) + 1) << shift;
+        if (boundary < next)
+            next = boundary;
+        break;
+    }
+
+    return next;
+}
+
+/*!
+ *   @brief Moves the wheel forward to now
+ *   @param uint64_t now current time
+ *   @returns TimingWheelNode* list of every node that expired chained through next, or NULL
+ */
+TimingWheelNode *TimingWheel::advance(uint64_t now)
+{
+    TimingWheelNode *expired = NULL;
+
+    while (this->current < now)
+    {
+        // Skip straight to the next tick where something actually happens
+        uint64_t next = this->next_event();
+        if (next > now)
+        {
+            this->current = now;
+            break;
+        }
+        this->current = next;
+
+        // Cascade every level whose boundary we just hit, from the top down
+        for (int level = TIMING_WHEEL_LEVELS - 1; level > 0; level--)
+        {
+            int shift = TIMING_WHEEL_LEVEL_BITS * level;
+            if ((this->current & ((1ULL << shift) - 1)) == 0)
+                this->cascade(level, (int)((this->current >> shift) & (TIMING_WHEEL_SLOTS - 1)));
+        }
+
+        // Everything in this bottom level slot expires right now.
+        int slot = (int)(this->current & (TIMING_WHEEL_SLOTS - 1));
+        TimingWheelNode *node = this->slots[0][slot];
+        this->slots[0][slot] = NULL;
+        this->occupied[0] &= ~(1ULL << slot);
+
+        while (node != NULL)
+        {
+            TimingWheelNode *next_node = node->next;
+            node->slot = -1;
+            node->prev = NULL;
+            node->next = expired;
+            expired = node;
+            this->count--;
+            node = next_node;
+        }
+    }
+
+    return expired;
+}
+
+/*!
+ *   @brief Earliest time the wheel needs to be advanced for something to happen
+ *   @note Exact for nodes close by, for nodes further out it's when they cascade down, which is never later than they expire.
+ *   @param uint64_t *when filled in with the time
+ *   @returns Whether or not there is anything in the wheel
+ */
+bool TimingWheel::next_expiry(uint64_t *when)
+{
+    if (this->count == 0)
+        return false;
+
+    *when = this->next_event();
+    return true;
+}
@@ -0,0 +1,132 @@
+#ifndef _TIMING_WHEEL_HPP
+#define _TIMING_WHEEL_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*!
+ *   @brief Number of bits of time each level of the wheel covers
+ */
+static const int TIMING_WHEEL_LEVEL_BITS = 6;
+
+/*!
+ *   @brief Number of slots in each level of the wheel
+ */
+static const int TIMING_WHEEL_SLOTS = (1 << TIMING_WHEEL_LEVEL_BITS);
+
+/*!
+ *   @brief Number of levels in the wheel
+ *   @note 5 levels of 64 slots covers 2^30 ticks(~18 minutes in microseconds), anything further out gets re-cascaded
+ */
+static const int TIMING_WHEEL_LEVELS = 5;
+
+/*!
+ *   @brief Intrusive timer node, embedded in whatever we want to time out.
+ */
+struct TimingWheelNode
+{
+    /*!
+     *   @brief Absolute 64 bit time the node expires at
+     */
+    uint64_t expires;
+
+    /*!
+     *   @brief General purpose pointer back to whatever owns the node
+     */
+    void *ptr;
+
+    /*!
+     *   @brief Links in the slot list the node sits in, next is also used to chain expired nodes
+     */
+    struct TimingWheelNode *next;
+    struct TimingWheelNode *prev;
+
+    /*!
+     *   @brief Which slot(level * TIMING_WHEEL_SLOTS + slot) the node is in, -1 if it isn't in the wheel
+     */
+    int16_t slot = -1;
+};
+
+/*!
+ *   @brief Hierarchical timing wheel
+ *   @note Inserting and cancelling are O(1), expiring is O(1) amortized since each node is cascaded down at most once per level.
+ *   @note Time is 64 bit, so nothing breaks when a 32 bit counter wraps around.
+ */
+class TimingWheel
+{
+public:
+    /*!
+     *   @brief Sets up the wheel, everything before now is considered processed
+     *   @param uint64_t now current time
+     */
+    void init(uint64_t now);
+
+    /*!
+     *   @brief Puts a node in the wheel to expire at a certain time.
+     *   @note If the time already passed, the node expires on the next call to advance
+     *   @param TimingWheelNode *node
+     *   @param uint64_t expires absolute time
+     */
+    void insert(TimingWheelNode *node, uint64_t expires);
+
+    /*!
+     *   @brief Takes a node out of the wheel before it expires
+     *   @note Safe to call on a node that isn't in the wheel.
+     *   @param TimingWheelNode *node
+     */
+    void cancel(TimingWheelNode *node);
+
+    /*!
+     *   @brief Moves the wheel forward to now
+     *   @param uint64_t now current time
+     *   @returns TimingWheelNode* list of every node that expired chained through next, or NULL
+     */
+    TimingWheelNode *advance(uint64_t now);
+
+    /*!
+     *   @brief Earliest time the wheel needs to be advanced for something to happen
+     *   @note Exact for nodes close by, for nodes further out it's when they cascade down, which is never later than they expire.
+     *   @param uint64_t *when filled in with the time
+     *   @returns Whether or not there is anything in the wheel
+     */
+    bool next_expiry(uint64_t *when);
+
+private:
+    /*!
+     *   @brief Places a node in the slot it belongs to, relative to where the wheel is right now
+     *   @param uint64_t expires when the node goes off, never earlier than the current time
+     */
+    void place(TimingWheelNode *node, uint64_t expires);
+
+    /*!
+     *   @brief Takes every node out of a slot, and places them again relative to where the wheel is now.
+     */
+    void cascade(int level, int slot);
+
+    /*!
+     *   @returns The next time something in the wheel expires or cascades down, UINT64_MAX if the wheel is empty
+     */
+    uint64_t next_event(void);
+
+    /*!
+     *   @brief Heads of each slot list
+     */
+    TimingWheelNode *slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+
+    /*!
+     *   @brief Bitmap of which slots in each level have something in them
+     */
+    uint64_t occupied[TIMING_WHEEL_LEVELS];
+
+    /*!
+     *   @brief Everything up to and including this time has been processed
+     */
+    uint64_t current = 0;
+
+    /*!
+     *   @brief Number of nodes in the wheel
+     */
+    uint32_t count = 0;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "mpu6050_imu.h"
+#include "OS/OSTraceKernel.h"
 
 #ifdef MPU6050_MODULE
 
@@ -121,10 +122,28 @@ static mpu_accelerometer_range_t accelerometer_range;
 */
 static mpu_gyro_range_t gyroscope_range;
 
+#ifdef SIGNALING_MODULE
+/*!
+*   @brief Signaled from the data ready interrupt whenever new data comes in
+*   @note Only used after you call the attach_mpu6050_data_ready function
+*/
+static OSSignal data_ready_signal;
+
+/*!
+*   @brief Whether or not the data ready pin is hooked up to an interrupt
+*/
+static bool data_ready_attached = false;
+#endif
+
 /*              FUNCTION DECLARATIONS BEGIN                 */
 mpu_init_status_t init_mpu6050(uint8_t i2c_address, mpu_accelerometer_range_t a_range, mpu_gyro_range_t g_range);
 static inline void i2c_setup_gyroscope(mpu_gyro_range_t g_range);
 static inline void i2c_setup_accelerometer(mpu_accelerometer_range_t a_range);
+#ifdef SIGNALING_MODULE
+void attach_mpu6050_data_ready(uint8_t interrupt_pin);
+static void mpu6050_data_ready_isr(void);
+#endif
+static inline void wait_mpu6050_data_ready(void);
 imu_data_raw get_latest_mpu6050_data(bool blocking);
 imu_data_raw get_latest_mpu6050_data_sampled(uint16_t samples);
 static inline void get_mpu6050_gyro_data(imu_data_raw *dat);
@@ -210,6 +229,48 @@ static inline void i2c_setup_accelerometer(mpu_accelerometer_range_t a_range){
     i2c_write_byte(ACCEL_CONFIG, buffer | ((uint8_t)a_range << 3)); // Set full range for gyroscope
 }
 
+#ifdef SIGNALING_MODULE
+/*!
+*   @brief Hooks the MPU6050 INT pin up to an interrupt, so threads waiting on data sleep instead of polling the bus.
+*   @note Call after init_mpu6050, which sets the INT pin to pulse high whenever new data is ready.
+*   @param uint8_t interrupt_pin pin the INT line is wired to
+*/
+void attach_mpu6050_data_ready(uint8_t interrupt_pin){
+    pinMode(interrupt_pin, INPUT);
+    data_ready_signal.clear(THREAD_SIGNAL_0);
+    attachInterrupt(digitalPinToInterrupt(interrupt_pin), mpu6050_data_ready_isr, RISING);
+    data_ready_attached = true;
+}
+
+/*!
+*   @brief Data ready interrupt, wakes up whoever is waiting on data.
+*/
+static void mpu6050_data_ready_isr(void){
+    // Pin interrupts all come in through their port's interrupt, so that's what shows up in the trace. 
+    uint32_t ipsr; 
+    __asm volatile("mrs %0, ipsr" : "=r"(ipsr)); 
+    OS_TRACE_ISR_ENTER(ipsr - 16); 
+    data_ready_signal.signal_from_isr(THREAD_SIGNAL_0);
+    OS_TRACE_ISR_EXIT(ipsr - 16); 
+}
+#endif
+
+/*!
+*   @brief Sits and waits for new data to come in
+*   @note If the data ready interrupt is attached we sleep until it fires, otherwise we poll the interrupt status register.
+*/
+static inline void wait_mpu6050_data_ready(void){
+#ifdef SIGNALING_MODULE
+    if(data_ready_attached){
+        data_ready_signal.wait_notimeout(THREAD_SIGNAL_0);
+        data_ready_signal.clear(THREAD_SIGNAL_0);
+        return;
+    }
+#endif
+    while(!(i2c_read_byte(INT_STATUS) & 0x01))
+        _os_yield();    // Since this module is built into Will-OS, we call the os yield
+}
+
 /*!
 *   @brief Getting the latest data from the imu
 *   @param bool Whether or not we will wait for data to be available or not
@@ -228,8 +289,7 @@ imu_data_raw get_latest_mpu6050_data(bool blocking){
     }
     else{
         // Sit and wait for new data to come in
-        while(!(i2c_read_byte(INT_STATUS) & 0x01))
-            _os_yield();    // Since this module is built into Will-OS, we call the os yield
+        wait_mpu6050_data_ready();
 
         // We were able to get data successfully.
         dat.success = true;
@@ -251,8 +311,7 @@ imu_data_raw get_latest_mpu6050_data_sampled(uint16_t samples){
 
     for(int n = 0; n < samples; n++){
         // Sit and wait for new data to come in
-        while(!(i2c_read_byte(INT_STATUS) & 0x01))
-            _os_yield();    // Since this module is built into Will-OS, we call the os yield
+        wait_mpu6050_data_ready();
 
         // We were able to get data successfully.
         dat.success = true;
@@ -92,6 +92,9 @@ typedef struct{
 *   @brief Function declarations
 */
 mpu_init_status_t init_mpu6050(uint8_t i2c_address, mpu_accelerometer_range_t a_range, mpu_gyro_range_t g_range); 
+#ifdef SIGNALING_MODULE
+void attach_mpu6050_data_ready(uint8_t interrupt_pin); 
+#endif
 imu_data_raw get_latest_mpu6050_data(bool blocking); 
 imu_data_raw get_latest_mpu6050_data_sampled(uint16_t samples); 
 accel_data_g translate_accel_raw_g(imu_data_raw raw_dat); 
@@ -1,6 +1,150 @@
 #include "OSSerial.h"
+#include "OS/OSTraceKernel.h"
 
 #ifdef SERIAL_MODULE
 
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
 
-#endif
\ No newline at end of file
+/*!
+*   @brief Serial port whose interrupt we hooked, and the interrupt handler the port had before us
+*/
+typedef struct{
+    int irq; 
+    void (*chained_isr)(void); 
+    OSSerial *serial; 
+}os_serial_irq_hook_t; 
+
+/*!
+*   @brief Every port we hooked the receive interrupt of
+*/
+static os_serial_irq_hook_t serial_irq_hooks[OS_SERIAL_MAX_PORTS]; 
+static int serial_irq_hook_count = 0; 
+
+/*!
+*   @brief Sets up a serial port so threads can wait on received data
+*   @note On Teensy 4 we chain onto the port's receive interrupt, so waiting threads wake up as soon as data comes in.
+*   @note Otherwise, or if the interrupt isn't given, threads waiting on data poll.
+*   @note Has to be called after the port's begin(), since that's when the port attaches it's own interrupt.
+*   @param HardwareSerial *serial_ptr
+*   @param int irq the port's interrupt(ex IRQ_LPUART6 for Serial1), -1 to poll
+*   @returns whether or not we were able to hook the interrupt
+*/
+bool OSSerial::setup(HardwareSerial *serial_ptr, int irq){
+    this->serial_ptr = serial_ptr; 
+    this->rx_hooked = false; 
+
+#if defined(__IMXRT1062__)
+    if(irq < 0 || serial_irq_hook_count == OS_SERIAL_MAX_PORTS)
+        return false; 
+
+    // Swap the handler out with the port's own interrupt off, so it never sees half a hook. 
+    NVIC_DISABLE_IRQ(irq); 
+    os_serial_irq_hook_t *hook = &serial_irq_hooks[serial_irq_hook_count]; 
+    hook->irq = irq; 
+    hook->chained_isr = _VectorsRam[irq + 16]; 
+    hook->serial = this; 
+    serial_irq_hook_count++; 
+    attachInterruptVector((IRQ_NUMBER_t)irq, &OSSerial::rx_isr); 
+    NVIC_ENABLE_IRQ(irq); 
+
+    this->rx_hooked = true; 
+    return true; 
+#else
+    return false; 
+#endif
+}
+
+/*!
+*   @brief Receive interrupt shared by every hooked port, runs the port's own handler and then wakes up readers
+*/
+void OSSerial::rx_isr(void){
+    // Which interrupt are we in? Exception numbers start 16 past the interrupt numbers. 
+    uint32_t ipsr; 
+    __asm volatile("mrs %0, ipsr" : "=r"(ipsr)); 
+    int irq = (int)ipsr - 16; 
+    OS_TRACE_ISR_ENTER(irq); 
+
+    for(int n = 0; n < serial_irq_hook_count; n++){
+        os_serial_irq_hook_t *hook = &serial_irq_hooks[n]; 
+        if(hook->irq != irq)
+            continue; 
+
+        // Let the port move the data into it's buffer first. 
+        hook->chained_isr(); 
+        if(hook->serial->serial_ptr->available())
+            hook->serial->rx_signal.signal_from_isr(THREAD_SIGNAL_0); 
+        break; 
+    }
+    OS_TRACE_ISR_EXIT(irq); 
+}
+
+/*!
+*   @returns How many bytes are waiting to be read
+*/
+int OSSerial::available(void){
+    return this->serial_ptr->available(); 
+}
+
+/*!
+*   @brief Waits for data to come in
+*   @param uint64_t timeout_us, 0 to wait for as long as it takes
+*   @returns whether or not there's data
+*/
+bool OSSerial::wait_available(uint64_t timeout_us){
+    uint64_t start = os_micros64(); 
+
+    while(!this->serial_ptr->available()){
+        uint64_t waited = os_micros64() - start; 
+        if(timeout_us && waited >= timeout_us)
+            return false; 
+
+        if(this->rx_hooked){
+            // Clear first, so anything that comes in after we check is still going to wake us up. 
+            this->rx_signal.clear(THREAD_SIGNAL_0); 
+            if(this->serial_ptr->available())
+                break; 
+
+            if(timeout_us)
+                this->rx_signal.wait_us(THREAD_SIGNAL_0, timeout_us - waited); 
+            else
+                this->rx_signal.wait_notimeout(THREAD_SIGNAL_0); 
+        }
+        else
+            _os_yield(); // Nothing to wake us up, so we poll
+    }
+    return true; 
+}
+
+/*!
+*   @brief Reads a byte, waiting up to the timeout for one to come in
+*   @param uint32_t timeout_ms, 0 to wait for as long as it takes
+*   @returns the byte, or -1 if we timed out
+*/
+int OSSerial::read(uint32_t timeout_ms){
+    return this->read_us((uint64_t)timeout_ms * 1000); 
+}
+
+/*!
+*   @brief Reads a byte, waiting up to the timeout in microseconds for one to come in
+*   @param uint64_t timeout_us, 0 to wait for as long as it takes
+*   @returns the byte, or -1 if we timed out
+*/
+int OSSerial::read_us(uint64_t timeout_us){
+    if(!this->wait_available(timeout_us))
+        return -1; 
+    return this->serial_ptr->read(); 
+}
+
+/*!
+*   @brief Reads a byte, waiting for as long as it takes for one to come in
+*   @returns the byte
+*/
+int OSSerial::read_blocking(void){
+    this->wait_available(0); 
+    return this->serial_ptr->read(); 
+}
+
+#endif
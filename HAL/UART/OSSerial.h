@@ -9,13 +9,78 @@
 #include "OS/OSSignalKernel.h" 
 #include "OS/OSThreadKernel.h" 
 
+/*!
+*   @brief How many serial ports can have their receive interrupt hooked at once
+*/
+#ifndef EXTERN_OS_SERIAL_MAX_PORTS
+static const int OS_SERIAL_MAX_PORTS = 8; 
+#else
+static const int OS_SERIAL_MAX_PORTS = EXTERN_OS_SERIAL_MAX_PORTS; 
+#endif
+
 class OSSerial{
     public: 
-        void setup(HardwareSerial *serial_ptr); 
+        /*!
+        *   @brief Sets up a serial port so threads can wait on received data
+        *   @note On Teensy 4 we chain onto the port's receive interrupt, so waiting threads wake up as soon as data comes in.
+        *   @note Otherwise, or if the interrupt isn't given, threads waiting on data poll.
+        *   @note Has to be called after the port's begin(), since that's when the port attaches it's own interrupt.
+        *   @param HardwareSerial *serial_ptr
+        *   @param int irq the port's interrupt(ex IRQ_LPUART6 for Serial1), -1 to poll
+        *   @returns whether or not we were able to hook the interrupt
+        */
+        bool setup(HardwareSerial *serial_ptr, int irq = -1); 
+
+        /*!
+        *   @returns How many bytes are waiting to be read
+        */
+        int available(void); 
+
+        /*!
+        *   @brief Reads a byte, waiting up to the timeout for one to come in
+        *   @param uint32_t timeout_ms, 0 to wait for as long as it takes
+        *   @returns the byte, or -1 if we timed out
+        */
+        int read(uint32_t timeout_ms); 
+
+        /*!
+        *   @brief Reads a byte, waiting up to the timeout in microseconds for one to come in
+        *   @param uint64_t timeout_us, 0 to wait for as long as it takes
+        *   @returns the byte, or -1 if we timed out
+        */
+        int read_us(uint64_t timeout_us); 
+
+        /*!
+        *   @brief Reads a byte, waiting for as long as it takes for one to come in
+        *   @returns the byte
+        */
+        int read_blocking(void); 
 
     private: 
+        /*!
+        *   @brief Waits for data to come in
+        *   @param uint64_t timeout_us, 0 to wait for as long as it takes
+        *   @returns whether or not there's data
+        */
+        bool wait_available(uint64_t timeout_us); 
+
+        /*!
+        *   @brief Receive interrupt shared by every hooked port, runs the port's own handler and then wakes up readers
+        */
+        static void rx_isr(void); 
+
         HardwareSerial *serial_ptr; 
+
+        /*!
+        *   @brief Signaled from the receive interrupt whenever there's data
+        */
+        OSSignal rx_signal; 
+
+        /*!
+        *   @brief Whether or not we hooked the receive interrupt
+        */
+        bool rx_hooked = false; 
 }; 
 
 #endif
-#endif 
\ No newline at end of file
+#endif 
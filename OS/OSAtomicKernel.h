@@ -0,0 +1,72 @@
+#ifndef _OSATOMICKERNEL_H
+#define _OSATOMICKERNEL_H
+
+#include <stdint.h>
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Compare and swap, what the kernel objects build their fast paths on, so they only stop the kernel when they have to
+ * @note On the Cortex-M it's an LDREX/STREX loop. Every exception entry and return clears the exclusive monitor, so a thread that got
+ * @note interrupted or switched out between the two just goes around again. Anywhere else it's the compiler's atomics, what std::atomic is built on.
+ * @note Only single core parts run the kernel, so there's no barrier beyond keeping the compiler from moving memory accesses across it.
+ */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define OS_ATOMIC_EXCLUSIVE_MONITOR
+#endif
+
+/*!
+ * @brief Swaps in desired if addr still holds expected
+ * @param volatile uint32_t *addr
+ * @param uint32_t expected
+ * @param uint32_t desired
+ * @returns Whether or not we swapped
+ */
+static inline bool os_atomic_cas32(volatile uint32_t *addr, uint32_t expected, uint32_t desired)
+{
+#if defined(OS_ATOMIC_EXCLUSIVE_MONITOR)
+  uint32_t current;
+  uint32_t failed;
+  do
+  {
+    __asm volatile("ldrex %0, [%1]"
+                   : "=r"(current)
+                   : "r"(addr)
+                   : "memory");
+    if (current != expected)
+    {
+      __asm volatile("clrex" ::: "memory");
+      return false;
+    }
+    __asm volatile("strex %0, %2, [%1]"
+                   : "=&r"(failed)
+                   : "r"(addr), "r"(desired)
+                   : "memory");
+  } while (failed);
+  return true;
+#else
+  return __atomic_compare_exchange_n(addr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/*!
+ * @brief Pointer sized compare and swap, for words that hold a thread_t
+ * @param volatile uintptr_t *addr
+ * @param uintptr_t expected
+ * @param uintptr_t desired
+ * @returns Whether or not we swapped
+ */
+static inline bool os_atomic_cas_ptr(volatile uintptr_t *addr, uintptr_t expected, uintptr_t desired)
+{
+#if defined(OS_ATOMIC_EXCLUSIVE_MONITOR)
+  static_assert(sizeof(uintptr_t) == sizeof(uint32_t), "Exclusive monitor compare and swap is 32 bit");
+  return os_atomic_cas32((volatile uint32_t *)addr, (uint32_t)expected, (uint32_t)desired);
+#else
+  return __atomic_compare_exchange_n(addr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+#endif
@@ -0,0 +1,989 @@
+#include "OSBenchmarkKernel.h"
+
+#ifdef BENCHMARK_MODULE
+
+#include <stdlib.h>
+
+#ifdef OS_PORT_POSIX
+#include "DS_HELPER/priority_queue.hpp"
+#endif
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Stack size of the threads the benchmarks start
+ */
+static const int OS_BENCHMARK_STACK_SIZE = 1024;
+
+/*!
+ * @brief How many elements the queue throughput benchmark pushes before it lets the consumer drain them
+ */
+static const uint32_t OS_BENCHMARK_QUEUE_LEN = 16;
+
+/*!
+ * @brief Timeout the threads os_benchmark_yield_ready() puts to sleep wait with, long enough it never runs out during the benchmark
+ */
+static const uint64_t OS_BENCHMARK_FILLER_TIMEOUT_US = 60000000;
+
+/*!
+ * @brief What the results were run on, so results from different targets don't get compared against each other
+ */
+#if defined(__IMXRT1062__)
+static const char *OS_BENCHMARK_TARGET = "teensy4";
+#elif defined(OS_PORT_POSIX)
+static const char *OS_BENCHMARK_TARGET = "posix";
+#elif defined(OS_PORT_MPS2)
+static const char *OS_BENCHMARK_TARGET = "qemu_mps2";
+#else
+static const char *OS_BENCHMARK_TARGET = "unknown";
+#endif
+
+/*!
+ * @brief Collects the samples of one benchmark
+ */
+typedef struct
+{
+  os_benchmark_result_t result;
+  uint64_t total_cycles;
+
+  // Samples we kept for the percentiles, and the random number picking which ones
+  uint32_t kept;
+  uint32_t seed;
+  uint32_t reservoir[OS_BENCHMARK_RESERVOIR_LEN];
+} os_benchmark_sampler_t;
+
+/*!
+ * @brief Benchmarks run one at a time, and none of them measure more than two things at once
+ */
+static os_benchmark_sampler_t samplers[2];
+
+/*!
+ * @brief Queue the producer and consumer hand off through
+ */
+static VoidOSQueue handoff_queue;
+static bool handoff_queue_init = false;
+
+/*!
+ * @brief Queue that lets the thread a benchmark started know it's time for the next round
+ */
+static VoidOSQueue gate_queue;
+static bool gate_queue_init = false;
+
+/*!
+ * @brief Queue the throughput benchmark fills and drains
+ */
+static VoidOSQueue throughput_queue;
+static bool throughput_queue_init = false;
+
+/*!
+ * @brief Kernel objects the benchmarks go through
+ */
+static MutexLock benchmark_mutex;
+#ifdef SEMAPHORE_MODULE
+static SemaphoreLock benchmark_semaphore(1);
+#endif
+#ifdef SIGNALING_MODULE
+static OSSignal benchmark_signal;
+#endif
+
+/*!
+ * @brief Cycle count when the calling thread let go, and how many rounds the other thread got through
+ */
+static volatile uint32_t benchmark_start_cycles;
+static volatile uint32_t benchmark_count;
+
+/*!
+ * @brief State of the yield benchmark, both threads take turns stamping and sampling
+ */
+static volatile bool yield_done;
+static uint32_t yield_iterations;
+
+/*!
+ * @brief State of the inversion benchmark, when the round started and when high started waiting on the lock(0 until then)
+ */
+static volatile uint64_t inversion_start_us;
+static volatile uint64_t inversion_blocked_us;
+static bool inversion_inherit;
+
+/*!
+ * @brief Starts a sampler over
+ */
+static void os_benchmark_sampler_reset(os_benchmark_sampler_t *sampler)
+{
+  memset(&sampler->result, 0, sizeof(sampler->result));
+  sampler->total_cycles = 0;
+  sampler->kept = 0;
+  sampler->seed = 0x2545F491;
+}
+
+/*!
+ * @brief Adds a sample to a benchmark result
+ * @note Once the reservoir is full, each new sample replaces a random one with the odds that keep every sample equally likely to be in there.
+ */
+static inline void os_benchmark_add_sample(os_benchmark_sampler_t *sampler, uint32_t cycles)
+{
+  os_benchmark_result_t *result = &sampler->result;
+  if (result->samples == 0 || cycles < result->min_cycles)
+    result->min_cycles = cycles;
+  if (cycles > result->max_cycles)
+    result->max_cycles = cycles;
+  sampler->total_cycles += cycles;
+  result->samples++;
+
+  if (sampler->kept < OS_BENCHMARK_RESERVOIR_LEN)
+  {
+    sampler->reservoir[sampler->kept++] = cycles;
+    return;
+  }
+
+  sampler->seed = sampler->seed * 1664525 + 1013904223;
+  uint32_t slot = sampler->seed % result->samples;
+  if (slot < OS_BENCHMARK_RESERVOIR_LEN)
+    sampler->reservoir[slot] = cycles;
+}
+
+static int os_benchmark_compare_cycles(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*!
+ * @returns The sample at a percentile of a sorted reservoir, nearest rank
+ */
+static inline uint32_t os_benchmark_percentile(const uint32_t *sorted, uint32_t len, uint32_t percent)
+{
+  uint32_t rank = (len * percent + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*!
+ * @brief Works out the average and percentiles once we're done taking samples
+ */
+static os_benchmark_result_t os_benchmark_sampler_finish(os_benchmark_sampler_t *sampler)
+{
+  os_benchmark_result_t *result = &sampler->result;
+  if (result->samples == 0)
+    return *result;
+
+  result->avg_cycles = sampler->total_cycles / result->samples;
+  qsort(sampler->reservoir, sampler->kept, sizeof(uint32_t), os_benchmark_compare_cycles);
+  result->p50_cycles = os_benchmark_percentile(sampler->reservoir, sampler->kept, 50);
+  result->p90_cycles = os_benchmark_percentile(sampler->reservoir, sampler->kept, 90);
+  result->p99_cycles = os_benchmark_percentile(sampler->reservoir, sampler->kept, 99);
+  return *result;
+}
+
+/*!
+ * @brief Starts the thread a benchmark needs, with a stack out of the stack pool
+ * @returns The thread's id, -1 if we couldn't start it
+ */
+static os_thread_id_t os_benchmark_start_thread(thread_func_t func, uint32_t iterations, uint8_t priority)
+{
+  return os_add_thread(func, (void *)(uintptr_t)iterations, priority, OS_BENCHMARK_STACK_SIZE, NULL, -1, THREAD_INTEGER_ONLY);
+}
+
+/*!
+ * @brief Waits until a thread we started has ended, so the next benchmark doesn't have it in the way
+ */
+static void os_benchmark_wait_out(os_thread_id_t thread_id)
+{
+  while (os_get_indexed_thread(thread_id) != NULL)
+    _os_yield();
+}
+
+/*!
+ * @returns Whether a queue is set up, setting it up the first time through
+ */
+static bool os_benchmark_queue_ready(VoidOSQueue *queue, bool *init, uint32_t len)
+{
+  if (!*init)
+    *init = queue->init(len);
+  return *init;
+}
+
+/*!
+ * @returns Element we push into the queues, what's in it doesn't matter
+ */
+static inline QueueData os_benchmark_queue_data(void)
+{
+  QueueData data;
+  data.data = NULL;
+  data.type = LED_ON;
+  return data;
+}
+
+/*!
+ * @brief Consumer side of the handoff benchmark, timestamps as soon as it's back up and running.
+ * @param void *arg how many handoffs we wait for
+ */
+static void handoff_consumer_thread(void *arg)
+{
+  uint32_t iterations = (uint32_t)(uintptr_t)arg;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    handoff_queue.popBlocking();
+    uint32_t cycles = os_benchmark_cycles() - benchmark_start_cycles;
+    os_benchmark_add_sample(&samplers[0], cycles);
+    benchmark_count++;
+  }
+}
+
+/*!
+ * @brief Measures how long it takes from a producer pushing into a VoidOSQueue until the blocked consumer is running.
+ * @note Starts a consumer thread one priority above the calling thread, so it has to be called from a thread below 255.
+ * @param uint32_t iterations how many handoffs we measure
+ * @returns os_benchmark_result_t handoff latency, no samples if we couldn't start the consumer
+ */
+os_benchmark_result_t os_benchmark_queue_handoff(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+  benchmark_count = 0;
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+  if (!os_benchmark_queue_ready(&handoff_queue, &handoff_queue_init, 1) || priority == 255)
+    return samplers[0].result;
+
+  os_thread_id_t consumer_id = os_benchmark_start_thread(&handoff_consumer_thread, iterations, priority + 1);
+  if (consumer_id == -1)
+    return samplers[0].result;
+
+  QueueData data = os_benchmark_queue_data();
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    // Only start the clock once the consumer is asleep waiting on us.
+    while (handoff_queue.consumer_waiters.head == NULL)
+      _os_yield();
+
+    benchmark_start_cycles = os_benchmark_cycles();
+    handoff_queue.push(data);
+
+    // Consumer should have run already, but if it hasn't we give it the chance.
+    while (benchmark_count <= n)
+      _os_yield();
+  }
+
+  os_benchmark_wait_out(consumer_id);
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Stack every churn thread gets, one at a time, so the benchmark times the thread table and not the allocator
+ */
+static uint8_t churn_stack[OS_BENCHMARK_STACK_SIZE];
+
+/*!
+ * @brief Thread the churn benchmark keeps creating, it ends as soon as it starts
+ */
+static void churn_thread(void *arg)
+{
+  (void)arg;
+}
+
+/*!
+ * @brief Measures creating and destroying threads over and over
+ * @note Threads are added at the calling thread's priority, so they only run once we yield to them.
+ * @param uint32_t iterations how many threads we create and wait out
+ * @returns os_benchmark_churn_result_t, no samples if we couldn't add a thread
+ */
+os_benchmark_churn_result_t os_benchmark_thread_churn(uint32_t iterations)
+{
+  os_benchmark_churn_result_t result;
+  memset(&result, 0, sizeof(result));
+  os_benchmark_sampler_reset(&samplers[0]);
+  os_benchmark_sampler_reset(&samplers[1]);
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    os_thread_id_t thread_id = os_add_thread(&churn_thread, NULL, priority, sizeof(churn_stack), churn_stack, -1, THREAD_INTEGER_ONLY);
+    uint32_t created = os_benchmark_cycles();
+    if (thread_id == -1)
+      break;
+
+    // Once it's gone, it's id stops working, and it's done with the stack.
+    os_benchmark_wait_out(thread_id);
+    uint32_t ended = os_benchmark_cycles();
+
+    os_benchmark_add_sample(&samplers[0], created - start);
+    os_benchmark_add_sample(&samplers[1], ended - start);
+  }
+
+  result.create = os_benchmark_sampler_finish(&samplers[0]);
+  result.lifetime = os_benchmark_sampler_finish(&samplers[1]);
+  result.thread_slots = os_thread_slots();
+  return result;
+}
+
+/*!
+ * @brief One turn of the yield benchmark, samples the switch that got us here and yields to the other thread
+ */
+static inline void os_benchmark_yield_step(void)
+{
+  uint32_t now = os_benchmark_cycles();
+  if (benchmark_count < yield_iterations)
+  {
+    os_benchmark_add_sample(&samplers[0], now - benchmark_start_cycles);
+    benchmark_count++;
+  }
+  benchmark_start_cycles = os_benchmark_cycles();
+  _os_yield();
+}
+
+/*!
+ * @brief Other side of the yield benchmark, yields back until the calling thread has all it's samples
+ */
+static void yield_partner_thread(void *arg)
+{
+  (void)arg;
+  while (!yield_done)
+    os_benchmark_yield_step();
+}
+
+/*!
+ * @brief Measures _os_yield() from one thread to another, Rhealstone's task switch time
+ * @note Starts a thread at the calling thread's priority and the two yield back and forth,
+ * @note each sample is from one thread yielding until the other is running. Other threads at the same priority get in the way.
+ * @param uint32_t iterations how many switches we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the other thread
+ */
+os_benchmark_result_t os_benchmark_yield(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+  benchmark_count = 0;
+  yield_iterations = iterations;
+  yield_done = false;
+
+  os_thread_id_t partner_id = os_benchmark_start_thread(&yield_partner_thread, iterations, _os_current_thread()->thread_priority);
+  if (partner_id == -1)
+    return samplers[0].result;
+
+  // Partner samples this first switch over to it.
+  benchmark_start_cycles = os_benchmark_cycles();
+  _os_yield();
+  while (benchmark_count < iterations)
+    os_benchmark_yield_step();
+
+  yield_done = true;
+  os_benchmark_wait_out(partner_id);
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Waits above the two threads yielding until the benchmark signals it, then ends
+ * @note arg set means it waits with a timeout, so it's asleep in the wake timers rather than just blocked.
+ */
+static void ready_filler_thread(void *arg)
+{
+  os_thread_waitbits_us(THREAD_SIGNAL_0, arg != NULL ? OS_BENCHMARK_FILLER_TIMEOUT_US : 0);
+}
+
+#ifdef OS_PORT_POSIX
+/*!
+ * @brief Times walking a PriorityQueuePointerNaive of the benchmark's threads down to the first one that's ready
+ * @note Reference for os_benchmark_yield_ready(), it's how a scheduler keeping it's threads in one sorted list picks the next one.
+ * @returns os_benchmark_result_t, one sample a walk
+ */
+static os_benchmark_result_t os_benchmark_naive_walk(uint32_t iterations, const os_thread_id_t *filler_ids, int fillers)
+{
+  os_benchmark_sampler_reset(&samplers[1]);
+
+  PriorityQueuePointerNaive queue;
+  for (int n = 0; n < fillers; n++)
+  {
+    thread_t *filler = os_get_indexed_thread(filler_ids[n]);
+    if (filler != NULL)
+      queue.insert(filler, filler->thread_priority);
+  }
+  // Our partner is gone by now, so we stand in for it. The walk stops at whichever of the two comes first anyway.
+  thread_t *this_thread = _os_current_thread();
+  queue.insert(this_thread, this_thread->thread_priority);
+  queue.insert(this_thread, this_thread->thread_priority);
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    PriorityQueueNaiveNode *node = queue.peek_top_node();
+    while (node != NULL && ((thread_t *)node->ptr)->flags != THREAD_RUNNING)
+      node = node->next;
+    os_benchmark_add_sample(&samplers[1], os_benchmark_cycles() - start);
+
+    // So the compiler can't drop the walk.
+    __asm volatile("" ::"r"(node) : "memory");
+  }
+
+  while (queue.pop() != NULL)
+    ;
+  return os_benchmark_sampler_finish(&samplers[1]);
+}
+#endif
+
+/*!
+ * @brief Measures the same switch as os_benchmark_yield(), with more threads around that outrank the two yielding
+ * @note Starts threads - 2 threads one priority above the calling thread that stay blocked or asleep the whole time, half of them
+ * @note with a timeout. A list sorted by priority has to step over every one of them to find the next thread, ours shouldn't grow with threads.
+ * @note Has to be called from a thread below priority 255.
+ * @param uint32_t iterations how many switches we measure
+ * @param int threads how many threads there are, the two yielding back and forth included, at most OS_BENCHMARK_MAX_READY
+ * @returns os_benchmark_yield_ready_result_t, no samples if we couldn't start every thread
+ */
+os_benchmark_yield_ready_result_t os_benchmark_yield_ready(uint32_t iterations, int threads)
+{
+  os_benchmark_yield_ready_result_t result;
+  memset(&result, 0, sizeof(result));
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+  if (priority == 255 || threads < 2 || threads > OS_BENCHMARK_MAX_READY)
+    return result;
+
+  // Fillers are above us, so each one runs as soon as it's added and goes straight to waiting.
+  os_thread_id_t filler_ids[OS_BENCHMARK_MAX_READY];
+  int fillers = 0;
+  while (fillers < threads - 2)
+  {
+    os_thread_id_t filler_id = os_benchmark_start_thread(&ready_filler_thread, fillers & 1, priority + 1);
+    if (filler_id == -1)
+      break;
+    filler_ids[fillers++] = filler_id;
+  }
+
+  if (fillers == threads - 2)
+  {
+    result.yield = os_benchmark_yield(iterations);
+#ifdef OS_PORT_POSIX
+    result.naive_walk = os_benchmark_naive_walk(iterations, filler_ids, fillers);
+#endif
+  }
+
+  for (int n = 0; n < fillers; n++)
+  {
+    os_signal_thread(THREAD_SIGNAL_0, filler_ids[n]);
+    os_benchmark_wait_out(filler_ids[n]);
+  }
+  return result;
+}
+
+/*!
+ * @brief Measures how late os_thread_sleep_us() wakes the calling thread, sleeping a millisecond at a time
+ * @note Each sample is how long after the millisecond was up the thread was running again.
+ * @param uint32_t iterations how many sleeps we measure, each one takes a millisecond
+ * @returns os_benchmark_result_t wake latency
+ */
+os_benchmark_result_t os_benchmark_sleep_wake(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+  uint32_t sleep_cycles = 1000 * os_benchmark_cycles_per_us();
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    os_thread_sleep_us(1000);
+    uint32_t slept = os_benchmark_cycles() - start;
+    os_benchmark_add_sample(&samplers[0], slept > sleep_cycles ? slept - sleep_cycles : 0);
+  }
+
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Measures os_stop() and os_start() together, what every kernel call that can't take a fast path pays on top of it's own work
+ * @note Uncontended mutex and semaphore calls skip this, so they should come in under it.
+ * @param uint32_t iterations
+ * @returns os_benchmark_result_t
+ */
+os_benchmark_result_t os_benchmark_stop_start(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    int os_state = os_stop();
+    os_start(os_state);
+    os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - start);
+  }
+
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Measures MutexLock lockWaitIndefinite() and unlock() with nobody else wanting the mutex
+ * @note Each sample is one lock and unlock together.
+ * @param uint32_t iterations
+ * @returns os_benchmark_result_t
+ */
+os_benchmark_result_t os_benchmark_mutex_uncontended(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    benchmark_mutex.lockWaitIndefinite();
+    benchmark_mutex.unlock();
+    os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - start);
+  }
+
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Waiter side of the mutex handoff, blocks on the mutex every time the calling thread lets it through the gate
+ */
+static void mutex_waiter_thread(void *arg)
+{
+  uint32_t iterations = (uint32_t)(uintptr_t)arg;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    gate_queue.popBlocking();
+    benchmark_mutex.lockWaitIndefinite();
+    os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - benchmark_start_cycles);
+    benchmark_mutex.unlock();
+  }
+}
+
+/*!
+ * @brief Measures handing a MutexLock to a higher priority thread that's blocked on it, Rhealstone's deadlock break time
+ * @note Each sample is from unlock() until the waiter is running with the mutex. The waiter runs one priority above the calling thread,
+ * @note so it has to be called from a thread below 255. The time includes giving up the priority we inherited from the waiter.
+ * @param uint32_t iterations how many handoffs we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the waiter
+ */
+os_benchmark_result_t os_benchmark_mutex_handoff(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+  if (!os_benchmark_queue_ready(&gate_queue, &gate_queue_init, 1) || priority == 255)
+    return samplers[0].result;
+
+  os_thread_id_t waiter_id = os_benchmark_start_thread(&mutex_waiter_thread, iterations, priority + 1);
+  if (waiter_id == -1)
+    return samplers[0].result;
+
+  QueueData data = os_benchmark_queue_data();
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    // Waiter is higher priority, so by the time push() comes back it's blocked on the mutex.
+    benchmark_mutex.lockWaitIndefinite();
+    gate_queue.push(data);
+
+    benchmark_start_cycles = os_benchmark_cycles();
+    benchmark_mutex.unlock();
+  }
+
+  os_benchmark_wait_out(waiter_id);
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Takes the lock the inversion benchmark fights over
+ */
+static void os_benchmark_inversion_lock(void)
+{
+#ifdef SEMAPHORE_MODULE
+  if (!inversion_inherit)
+  {
+    benchmark_semaphore.entryWaitIndefinite();
+    return;
+  }
+#endif
+  benchmark_mutex.lockWaitIndefinite();
+}
+
+static void os_benchmark_inversion_unlock(void)
+{
+#ifdef SEMAPHORE_MODULE
+  if (!inversion_inherit)
+  {
+    benchmark_semaphore.exit();
+    return;
+  }
+#endif
+  benchmark_mutex.unlock();
+}
+
+/*!
+ * @brief Low priority side of the inversion, takes the lock and holds it until high has waited OS_BENCHMARK_INVERSION_HOLD_US for it
+ */
+static void inversion_low_thread(void *arg)
+{
+  (void)arg;
+  os_benchmark_inversion_lock();
+  while (inversion_blocked_us == 0 || os_micros64() < inversion_blocked_us + OS_BENCHMARK_INVERSION_HOLD_US)
+    ;
+  os_benchmark_inversion_unlock();
+}
+
+/*!
+ * @brief Medium priority side of the inversion, wakes up once high is waiting and wants the CPU for OS_BENCHMARK_INVERSION_MEDIUM_US
+ */
+static void inversion_medium_thread(void *arg)
+{
+  (void)arg;
+  os_thread_sleep_until_us(inversion_start_us + 1200);
+  uint64_t end = os_micros64() + OS_BENCHMARK_INVERSION_MEDIUM_US;
+  while (os_micros64() < end)
+    ;
+}
+
+/*!
+ * @brief High priority side of the inversion, wakes up with low holding the lock and samples how long it waits for it
+ */
+static void inversion_high_thread(void *arg)
+{
+  (void)arg;
+  os_thread_sleep_until_us(inversion_start_us + 1000);
+  uint32_t start = os_benchmark_cycles();
+  inversion_blocked_us = os_micros64();
+  os_benchmark_inversion_lock();
+  os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - start);
+  os_benchmark_inversion_unlock();
+}
+
+/*!
+ * @brief Measures how long a high priority thread is blocked on a lock held by a low priority thread, while a medium priority thread wants the CPU
+ * @note Classic priority inversion. Low takes the lock, high blocks on it, and then medium wakes up and runs for OS_BENCHMARK_INVERSION_MEDIUM_US.
+ * @note With inheritance low runs at high's priority until it lets go, so high is only held up for OS_BENCHMARK_INVERSION_HOLD_US.
+ * @note Without it medium runs first and high waits on medium too, for as long as medium wants. The mutex inherits, a binary SemaphoreLock doesn't.
+ * @note The three threads run one, two and three priorities above the calling thread, so it has to be called from a thread below 253.
+ * @note Each iteration takes a little over OS_BENCHMARK_INVERSION_MEDIUM_US.
+ * @param uint32_t iterations
+ * @param bool inherit true to go through a MutexLock, false for a binary SemaphoreLock
+ * @returns os_benchmark_result_t how long high was blocked, no samples without SEMAPHORE_MODULE when inherit is false
+ */
+os_benchmark_result_t os_benchmark_priority_inversion(uint32_t iterations, bool inherit)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+  inversion_inherit = inherit;
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+#ifndef SEMAPHORE_MODULE
+  if (!inherit)
+    return samplers[0].result;
+#endif
+  if (priority > 252)
+    return samplers[0].result;
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    inversion_blocked_us = 0;
+    inversion_start_us = os_micros64();
+
+    // High and medium go straight to sleep, low takes the lock as soon as it's added and keeps the CPU until it lets go.
+    os_thread_id_t high_id = os_benchmark_start_thread(&inversion_high_thread, 0, priority + 3);
+    os_thread_id_t medium_id = os_benchmark_start_thread(&inversion_medium_thread, 0, priority + 2);
+    os_thread_id_t low_id = -1;
+    if (high_id != -1 && medium_id != -1)
+      low_id = os_benchmark_start_thread(&inversion_low_thread, 0, priority + 1);
+
+    // Low never got the lock, so the other two are only sleeping and can go.
+    if (low_id == -1)
+    {
+      os_kill_thread(high_id);
+      os_kill_thread(medium_id);
+      return samplers[0].result;
+    }
+
+    os_benchmark_wait_out(high_id);
+    os_benchmark_wait_out(medium_id);
+    os_benchmark_wait_out(low_id);
+  }
+
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+#ifdef SEMAPHORE_MODULE
+/*!
+ * @brief Measures SemaphoreLock entryWaitIndefinite() and exit() with nobody else wanting an entry
+ * @note Each sample is one entry and exit together.
+ * @param uint32_t iterations
+ * @returns os_benchmark_result_t
+ */
+os_benchmark_result_t os_benchmark_semaphore_uncontended(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    benchmark_semaphore.entryWaitIndefinite();
+    benchmark_semaphore.exit();
+    os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - start);
+  }
+
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Other side of the semaphore shuffle, blocks on an entry every time the calling thread lets it through the gate
+ */
+static void semaphore_partner_thread(void *arg)
+{
+  uint32_t iterations = (uint32_t)(uintptr_t)arg;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    gate_queue.popBlocking();
+    benchmark_semaphore.entryWaitIndefinite();
+    os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - benchmark_start_cycles);
+    benchmark_semaphore.exit();
+  }
+}
+
+/*!
+ * @brief Measures the entry of a binary SemaphoreLock going back and forth between two threads, Rhealstone's semaphore shuffle
+ * @note Each sample is from exit() until the thread blocked in entry is running with it. The other thread runs one priority above
+ * @note the calling thread, so it has to be called from a thread below 255.
+ * @param uint32_t iterations how many handoffs we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the other thread
+ */
+os_benchmark_result_t os_benchmark_semaphore_pingpong(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+  if (!os_benchmark_queue_ready(&gate_queue, &gate_queue_init, 1) || priority == 255)
+    return samplers[0].result;
+
+  os_thread_id_t partner_id = os_benchmark_start_thread(&semaphore_partner_thread, iterations, priority + 1);
+  if (partner_id == -1)
+    return samplers[0].result;
+
+  QueueData data = os_benchmark_queue_data();
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    // Partner is higher priority, so by the time push() comes back it's blocked waiting for the entry.
+    benchmark_semaphore.entryWaitIndefinite();
+    gate_queue.push(data);
+
+    benchmark_start_cycles = os_benchmark_cycles();
+    benchmark_semaphore.exit();
+  }
+
+  os_benchmark_wait_out(partner_id);
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+#endif
+
+#ifdef SIGNALING_MODULE
+/*!
+ * @brief Waiter side of the signal benchmark, timestamps as soon as the signal wakes it up
+ */
+static void signal_waiter_thread(void *arg)
+{
+  uint32_t iterations = (uint32_t)(uintptr_t)arg;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    benchmark_signal.wait_notimeout(THREAD_SIGNAL_0);
+    os_benchmark_add_sample(&samplers[0], os_benchmark_cycles() - benchmark_start_cycles);
+    benchmark_signal.clear(THREAD_SIGNAL_0);
+  }
+}
+
+/*!
+ * @brief Measures from OSSignal::signal() until a higher priority thread waiting on the bit is running
+ * @note The waiter runs one priority above the calling thread, so it has to be called from a thread below 255.
+ * @param uint32_t iterations how many wakeups we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the waiter
+ */
+os_benchmark_result_t os_benchmark_signal_wake(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+  benchmark_signal.clear(THREAD_SIGNAL_0);
+
+  uint8_t priority = _os_current_thread()->thread_priority;
+  if (priority == 255)
+    return samplers[0].result;
+
+  // Waiter is higher priority, so it's already waiting on the bit once we're back.
+  os_thread_id_t waiter_id = os_benchmark_start_thread(&signal_waiter_thread, iterations, priority + 1);
+  if (waiter_id == -1)
+    return samplers[0].result;
+
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    benchmark_start_cycles = os_benchmark_cycles();
+    benchmark_signal.signal(THREAD_SIGNAL_0);
+  }
+
+  os_benchmark_wait_out(waiter_id);
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+#endif
+
+/*!
+ * @brief Consumer side of the throughput benchmark, takes elements until it's had every one
+ */
+static void throughput_consumer_thread(void *arg)
+{
+  uint32_t elements = (uint32_t)(uintptr_t)arg * OS_BENCHMARK_QUEUE_LEN;
+  for (uint32_t n = 0; n < elements; n++)
+  {
+    throughput_queue.popBlocking();
+    benchmark_count++;
+  }
+}
+
+/*!
+ * @brief Measures how fast elements go through a VoidOSQueue, pushed by the calling thread and taken by popBlocking() on another
+ * @note Both run at the calling thread's priority. The queue gets filled and then drained, each sample is the cycles per element over one fill and drain.
+ * @param uint32_t iterations how many times we fill and drain the queue
+ * @returns os_benchmark_result_t cycles per element, no samples if we couldn't start the consumer
+ */
+os_benchmark_result_t os_benchmark_queue_throughput(uint32_t iterations)
+{
+  os_benchmark_sampler_reset(&samplers[0]);
+  benchmark_count = 0;
+
+  if (!os_benchmark_queue_ready(&throughput_queue, &throughput_queue_init, OS_BENCHMARK_QUEUE_LEN))
+    return samplers[0].result;
+
+  os_thread_id_t consumer_id = os_benchmark_start_thread(&throughput_consumer_thread, iterations, _os_current_thread()->thread_priority);
+  if (consumer_id == -1)
+    return samplers[0].result;
+
+  QueueData data = os_benchmark_queue_data();
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint32_t start = os_benchmark_cycles();
+    for (uint32_t i = 0; i < OS_BENCHMARK_QUEUE_LEN; i++)
+      throughput_queue.push(data);
+
+    // Consumer is at our priority, so it only drains the queue once we yield to it.
+    while (benchmark_count < (n + 1) * OS_BENCHMARK_QUEUE_LEN)
+      _os_yield();
+    os_benchmark_add_sample(&samplers[0], (os_benchmark_cycles() - start) / OS_BENCHMARK_QUEUE_LEN);
+  }
+
+  os_benchmark_wait_out(consumer_id);
+  return os_benchmark_sampler_finish(&samplers[0]);
+}
+
+/*!
+ * @brief Adds a result to the suite's results, if there's room
+ */
+static void os_benchmark_suite_add(os_benchmark_entry_t *entries, int max_entries, int *count, const char *name, os_benchmark_result_t result)
+{
+  if (*count >= max_entries)
+    return;
+  entries[*count].name = name;
+  entries[*count].result = result;
+  (*count)++;
+}
+
+/*!
+ * @brief Adds both results of os_benchmark_yield_ready() to the suite's results, the naive walk right after the switch it's compared with
+ */
+static void os_benchmark_suite_add_ready(os_benchmark_entry_t *entries, int max_entries, int *count, const char *yield_name, const char *walk_name, os_benchmark_yield_ready_result_t result)
+{
+  os_benchmark_suite_add(entries, max_entries, count, yield_name, result.yield);
+#ifdef OS_PORT_POSIX
+  os_benchmark_suite_add(entries, max_entries, count, walk_name, result.naive_walk);
+#else
+  (void)walk_name;
+#endif
+}
+
+/*!
+ * @brief Runs every benchmark, one after another
+ * @note Has to be called from a thread below priority 255, same as the benchmarks that start a higher priority thread.
+ * @note The sleep benchmark takes a millisecond an iteration, so the suite takes at least iterations milliseconds.
+ * @param os_benchmark_entry_t *entries where the results go, OS_BENCHMARK_SUITE_LEN is always enough
+ * @param int max_entries
+ * @param uint32_t iterations of each benchmark
+ * @returns How many results we filled in
+ */
+int os_benchmark_run_suite(os_benchmark_entry_t *entries, int max_entries, uint32_t iterations)
+{
+  int count = 0;
+  os_benchmark_suite_add(entries, max_entries, &count, "yield", os_benchmark_yield(iterations));
+  os_benchmark_suite_add_ready(entries, max_entries, &count, "yield_ready_4", "naive_walk_4", os_benchmark_yield_ready(iterations, 4));
+  os_benchmark_suite_add_ready(entries, max_entries, &count, "yield_ready_12", "naive_walk_12", os_benchmark_yield_ready(iterations, 12));
+  os_benchmark_suite_add_ready(entries, max_entries, &count, "yield_ready_24", "naive_walk_24", os_benchmark_yield_ready(iterations, 24));
+  os_benchmark_suite_add(entries, max_entries, &count, "sleep_wake", os_benchmark_sleep_wake(iterations));
+  os_benchmark_suite_add(entries, max_entries, &count, "stop_start", os_benchmark_stop_start(iterations));
+  os_benchmark_suite_add(entries, max_entries, &count, "mutex_uncontended", os_benchmark_mutex_uncontended(iterations));
+  os_benchmark_suite_add(entries, max_entries, &count, "mutex_handoff", os_benchmark_mutex_handoff(iterations));
+#ifdef SEMAPHORE_MODULE
+  os_benchmark_suite_add(entries, max_entries, &count, "semaphore_uncontended", os_benchmark_semaphore_uncontended(iterations));
+  os_benchmark_suite_add(entries, max_entries, &count, "semaphore_pingpong", os_benchmark_semaphore_pingpong(iterations));
+#endif
+#ifdef SIGNALING_MODULE
+  os_benchmark_suite_add(entries, max_entries, &count, "signal_wake", os_benchmark_signal_wake(iterations));
+#endif
+  os_benchmark_suite_add(entries, max_entries, &count, "queue_handoff", os_benchmark_queue_handoff(iterations));
+  os_benchmark_suite_add(entries, max_entries, &count, "queue_throughput", os_benchmark_queue_throughput(iterations));
+
+  uint32_t inversion_iterations = iterations >= 10 ? iterations / 10 : 1;
+  os_benchmark_suite_add(entries, max_entries, &count, "inversion_inherit", os_benchmark_priority_inversion(inversion_iterations, true));
+#ifdef SEMAPHORE_MODULE
+  os_benchmark_suite_add(entries, max_entries, &count, "inversion_no_inherit", os_benchmark_priority_inversion(inversion_iterations, false));
+#endif
+
+  os_benchmark_churn_result_t churn = os_benchmark_thread_churn(iterations);
+  os_benchmark_suite_add(entries, max_entries, &count, "thread_create", churn.create);
+  os_benchmark_suite_add(entries, max_entries, &count, "thread_lifetime", churn.lifetime);
+  return count;
+}
+
+/*!
+ * @brief Prints benchmark results as a table, in cycles and nanoseconds
+ * @param Print *out(ex &Serial)
+ * @param const os_benchmark_entry_t *entries
+ * @param int count
+ */
+void os_print_benchmark_results(Print *out, const os_benchmark_entry_t *entries, int count)
+{
+  uint32_t cycles_per_us = os_benchmark_cycles_per_us();
+  out->printf("Benchmarks on %s, %lu cycles per us\n", OS_BENCHMARK_TARGET, (unsigned long)cycles_per_us);
+  out->printf("%-22s %7s %9s %9s %9s %9s %9s %9s %9s\n", "benchmark", "samples", "min", "avg", "p50", "p90", "p99", "max", "avg ns");
+  for (int n = 0; n < count; n++)
+  {
+    const os_benchmark_result_t *result = &entries[n].result;
+    out->printf("%-22s %7lu %9lu %9lu %9lu %9lu %9lu %9lu %9lu\n",
+                entries[n].name,
+                (unsigned long)result->samples,
+                (unsigned long)result->min_cycles,
+                (unsigned long)result->avg_cycles,
+                (unsigned long)result->p50_cycles,
+                (unsigned long)result->p90_cycles,
+                (unsigned long)result->p99_cycles,
+                (unsigned long)result->max_cycles,
+                (unsigned long)((uint64_t)result->avg_cycles * 1000 / cycles_per_us));
+  }
+}
+
+/*!
+ * @brief Prints benchmark results as JSON, one object a line, so runs can be saved and compared
+ * @note Lines that don't start with '{' can be mixed in, tools/benchmark_compare.py skips them.
+ * @param Print *out(ex &Serial)
+ * @param const os_benchmark_entry_t *entries
+ * @param int count
+ */
+void os_print_benchmark_json(Print *out, const os_benchmark_entry_t *entries, int count)
+{
+  uint32_t cycles_per_us = os_benchmark_cycles_per_us();
+  for (int n = 0; n < count; n++)
+  {
+    const os_benchmark_result_t *result = &entries[n].result;
+    out->printf("{\"benchmark\":\"%s\",\"target\":\"%s\",\"unit\":\"cycles\",\"cycles_per_us\":%lu,"
+                "\"samples\":%lu,\"min\":%lu,\"avg\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}\n",
+                entries[n].name,
+                OS_BENCHMARK_TARGET,
+                (unsigned long)cycles_per_us,
+                (unsigned long)result->samples,
+                (unsigned long)result->min_cycles,
+                (unsigned long)result->avg_cycles,
+                (unsigned long)result->p50_cycles,
+                (unsigned long)result->p90_cycles,
+                (unsigned long)result->p99_cycles,
+                (unsigned long)result->max_cycles);
+  }
+}
+
+#endif
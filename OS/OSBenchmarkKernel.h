@@ -0,0 +1,278 @@
+#ifndef _OSBENCHMARKKERNEL_H
+#define _OSBENCHMARKKERNEL_H
+
+// So we can configure modules
+#include "enabled_modules.h"
+
+#ifdef BENCHMARK_MODULE
+
+#include <Arduino.h>
+#include "OSThreadKernel.h"
+#include "OSQueueKernel.hpp"
+#include "OSSemaphoreKernel.h"
+#include "OSSignalKernel.h"
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief How many samples of each benchmark are kept for the percentiles
+ * @note Past that, samples are picked at random(with a fixed seed, so runs stay repeatable) to stand in for the rest.
+ * @note Min, average and max always cover every sample.
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_BENCHMARK_RESERVOIR_LEN
+static const uint32_t OS_BENCHMARK_RESERVOIR_LEN = 512;
+#else
+static const uint32_t OS_BENCHMARK_RESERVOIR_LEN = EXTERN_OS_BENCHMARK_RESERVOIR_LEN;
+#endif
+
+/*!
+ * @brief Timing results of a benchmark, in CPU cycles
+ */
+typedef struct
+{
+  // How many samples we took
+  uint32_t samples;
+
+  uint32_t min_cycles;
+  uint32_t avg_cycles;
+  uint32_t max_cycles;
+
+  // Median, and the tail
+  uint32_t p50_cycles;
+  uint32_t p90_cycles;
+  uint32_t p99_cycles;
+} os_benchmark_result_t;
+
+/*!
+ * @returns The current CPU cycle count
+ * @note Uses the DWT cycle counter when there is one, otherwise micros() scaled up to cycles.
+ */
+static inline uint32_t os_benchmark_cycles(void)
+{
+  return os_cpu_cycles();
+}
+
+/*!
+ * @returns How many CPU cycles there are in a microsecond, to turn results into time
+ */
+static inline uint32_t os_benchmark_cycles_per_us(void)
+{
+#if defined(__IMXRT1062__)
+  return F_CPU_ACTUAL / 1000000;
+#else
+  return F_CPU / 1000000;
+#endif
+}
+
+/*!
+ * @brief Measures how long it takes from a producer pushing into a VoidOSQueue until the blocked consumer is running.
+ * @note Starts a consumer thread one priority above the calling thread, so it has to be called from a thread below 255.
+ * @param uint32_t iterations how many handoffs we measure
+ * @returns os_benchmark_result_t handoff latency, no samples if we couldn't start the consumer
+ */
+os_benchmark_result_t os_benchmark_queue_handoff(uint32_t iterations);
+
+/*!
+ * @brief Timing results of the thread churn benchmark, in CPU cycles
+ */
+typedef struct
+{
+  // os_add_thread() on it's own, which takes a slot off the free list and sets the thread up
+  os_benchmark_result_t create;
+
+  // Whole life of a thread that does nothing: added, switched to, ends, switched out and it's slot given back
+  os_benchmark_result_t lifetime;
+
+  // How big the thread table was once we were done, it shouldn't grow when the same slots keep getting reused
+  int thread_slots;
+} os_benchmark_churn_result_t;
+
+/*!
+ * @brief Measures creating and destroying threads over and over
+ * @note Threads are added at the calling thread's priority, so they only run once we yield to them.
+ * @param uint32_t iterations how many threads we create and wait out
+ * @returns os_benchmark_churn_result_t, no samples if we couldn't add a thread
+ */
+os_benchmark_churn_result_t os_benchmark_thread_churn(uint32_t iterations);
+
+/*!
+ * @brief Measures _os_yield() from one thread to another, Rhealstone's task switch time
+ * @note Starts a thread at the calling thread's priority and the two yield back and forth,
+ * @note each sample is from one thread yielding until the other is running. Other threads at the same priority get in the way.
+ * @param uint32_t iterations how many switches we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the other thread
+ */
+os_benchmark_result_t os_benchmark_yield(uint32_t iterations);
+
+/*!
+ * @brief Most threads os_benchmark_yield_ready() can have at once
+ */
+static const int OS_BENCHMARK_MAX_READY = 32;
+
+/*!
+ * @brief Timing results of the yield benchmark with more threads around, in CPU cycles
+ */
+typedef struct
+{
+  // _os_yield() from one thread to the other, same as os_benchmark_yield()
+  os_benchmark_result_t yield;
+
+  // Walking a PriorityQueuePointerNaive of the same threads down to the first one that's ready, what a sorted list scheduler does on every switch.
+  // Only taken on the host port, no samples anywhere else.
+  os_benchmark_result_t naive_walk;
+} os_benchmark_yield_ready_result_t;
+
+/*!
+ * @brief Measures the same switch as os_benchmark_yield(), with more threads around that outrank the two yielding
+ * @note Starts threads - 2 threads one priority above the calling thread that stay blocked or asleep the whole time, half of them
+ * @note with a timeout. A list sorted by priority has to step over every one of them to find the next thread, ours shouldn't grow with threads.
+ * @note Has to be called from a thread below priority 255.
+ * @param uint32_t iterations how many switches we measure
+ * @param int threads how many threads there are, the two yielding back and forth included, at most OS_BENCHMARK_MAX_READY
+ * @returns os_benchmark_yield_ready_result_t, no samples if we couldn't start every thread
+ */
+os_benchmark_yield_ready_result_t os_benchmark_yield_ready(uint32_t iterations, int threads);
+
+/*!
+ * @brief Measures how late os_thread_sleep_us() wakes the calling thread, sleeping a millisecond at a time
+ * @note Each sample is how long after the millisecond was up the thread was running again.
+ * @param uint32_t iterations how many sleeps we measure, each one takes a millisecond
+ * @returns os_benchmark_result_t wake latency
+ */
+os_benchmark_result_t os_benchmark_sleep_wake(uint32_t iterations);
+
+/*!
+ * @brief Measures os_stop() and os_start() together, what every kernel call that can't take a fast path pays on top of it's own work
+ * @note Uncontended mutex and semaphore calls skip this, so they should come in under it.
+ * @param uint32_t iterations
+ * @returns os_benchmark_result_t
+ */
+os_benchmark_result_t os_benchmark_stop_start(uint32_t iterations);
+
+/*!
+ * @brief Measures MutexLock lockWaitIndefinite() and unlock() with nobody else wanting the mutex
+ * @note Each sample is one lock and unlock together.
+ * @param uint32_t iterations
+ * @returns os_benchmark_result_t
+ */
+os_benchmark_result_t os_benchmark_mutex_uncontended(uint32_t iterations);
+
+/*!
+ * @brief Measures handing a MutexLock to a higher priority thread that's blocked on it, Rhealstone's deadlock break time
+ * @note Each sample is from unlock() until the waiter is running with the mutex. The waiter runs one priority above the calling thread,
+ * @note so it has to be called from a thread below 255. The time includes giving up the priority we inherited from the waiter.
+ * @param uint32_t iterations how many handoffs we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the waiter
+ */
+os_benchmark_result_t os_benchmark_mutex_handoff(uint32_t iterations);
+
+/*!
+ * @brief How long the low priority thread of the inversion benchmark keeps the lock once the high priority thread is waiting on it
+ */
+static const uint32_t OS_BENCHMARK_INVERSION_HOLD_US = 1000;
+
+/*!
+ * @brief How long the medium priority thread of the inversion benchmark runs for, it never touches the lock
+ */
+static const uint32_t OS_BENCHMARK_INVERSION_MEDIUM_US = 3000;
+
+/*!
+ * @brief Measures how long a high priority thread is blocked on a lock held by a low priority thread, while a medium priority thread wants the CPU
+ * @note Classic priority inversion. Low takes the lock, high blocks on it, and then medium wakes up and runs for OS_BENCHMARK_INVERSION_MEDIUM_US.
+ * @note With inheritance low runs at high's priority until it lets go, so high is only held up for OS_BENCHMARK_INVERSION_HOLD_US.
+ * @note Without it medium runs first and high waits on medium too, for as long as medium wants. The mutex inherits, a binary SemaphoreLock doesn't.
+ * @note The three threads run one, two and three priorities above the calling thread, so it has to be called from a thread below 253.
+ * @note Each iteration takes a little over OS_BENCHMARK_INVERSION_MEDIUM_US.
+ * @param uint32_t iterations
+ * @param bool inherit true to go through a MutexLock, false for a binary SemaphoreLock
+ * @returns os_benchmark_result_t how long high was blocked, no samples without SEMAPHORE_MODULE when inherit is false
+ */
+os_benchmark_result_t os_benchmark_priority_inversion(uint32_t iterations, bool inherit);
+
+#ifdef SEMAPHORE_MODULE
+/*!
+ * @brief Measures SemaphoreLock entryWaitIndefinite() and exit() with nobody else wanting an entry
+ * @note Each sample is one entry and exit together.
+ * @param uint32_t iterations
+ * @returns os_benchmark_result_t
+ */
+os_benchmark_result_t os_benchmark_semaphore_uncontended(uint32_t iterations);
+
+/*!
+ * @brief Measures the entry of a binary SemaphoreLock going back and forth between two threads, Rhealstone's semaphore shuffle
+ * @note Each sample is from exit() until the thread blocked in entry is running with it. The other thread runs one priority above
+ * @note the calling thread, so it has to be called from a thread below 255.
+ * @param uint32_t iterations how many handoffs we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the other thread
+ */
+os_benchmark_result_t os_benchmark_semaphore_pingpong(uint32_t iterations);
+#endif
+
+#ifdef SIGNALING_MODULE
+/*!
+ * @brief Measures from OSSignal::signal() until a higher priority thread waiting on the bit is running
+ * @note The waiter runs one priority above the calling thread, so it has to be called from a thread below 255.
+ * @param uint32_t iterations how many wakeups we measure
+ * @returns os_benchmark_result_t, no samples if we couldn't start the waiter
+ */
+os_benchmark_result_t os_benchmark_signal_wake(uint32_t iterations);
+#endif
+
+/*!
+ * @brief Measures how fast elements go through a VoidOSQueue, pushed by the calling thread and taken by popBlocking() on another
+ * @note Both run at the calling thread's priority. The queue gets filled and then drained, each sample is the cycles per element over one fill and drain.
+ * @param uint32_t iterations how many times we fill and drain the queue
+ * @returns os_benchmark_result_t cycles per element, no samples if we couldn't start the consumer
+ */
+os_benchmark_result_t os_benchmark_queue_throughput(uint32_t iterations);
+
+/*!
+ * @brief One result of the benchmark suite
+ */
+typedef struct
+{
+  // Short name, the same from release to release so results can be compared
+  const char *name;
+  os_benchmark_result_t result;
+} os_benchmark_entry_t;
+
+/*!
+ * @brief Most results os_benchmark_run_suite() gives back
+ */
+static const int OS_BENCHMARK_SUITE_LEN = 20;
+
+/*!
+ * @brief Runs every benchmark, one after another
+ * @note Has to be called from a thread below priority 255, same as the benchmarks that start a higher priority thread.
+ * @note The sleep benchmark takes a millisecond an iteration, so the suite takes at least iterations milliseconds.
+ * @note The inversion benchmarks run a tenth of the iterations, since each one takes milliseconds.
+ * @param os_benchmark_entry_t *entries where the results go, OS_BENCHMARK_SUITE_LEN is always enough
+ * @param int max_entries
+ * @param uint32_t iterations of each benchmark
+ * @returns How many results we filled in
+ */
+int os_benchmark_run_suite(os_benchmark_entry_t *entries, int max_entries, uint32_t iterations);
+
+/*!
+ * @brief Prints benchmark results as a table, in cycles and nanoseconds
+ * @param Print *out(ex &Serial)
+ * @param const os_benchmark_entry_t *entries
+ * @param int count
+ */
+void os_print_benchmark_results(Print *out, const os_benchmark_entry_t *entries, int count);
+
+/*!
+ * @brief Prints benchmark results as JSON, one object a line, so runs can be saved and compared
+ * @note Lines that don't start with '{' can be mixed in, tools/benchmark_compare.py skips them.
+ * @param Print *out(ex &Serial)
+ * @param const os_benchmark_entry_t *entries
+ * @param int count
+ */
+void os_print_benchmark_json(Print *out, const os_benchmark_entry_t *entries, int count);
+
+#endif
+#endif
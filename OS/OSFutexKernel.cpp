@@ -0,0 +1,128 @@
+#include "OSFutexKernel.h"
+
+#ifdef FUTEX_MODULE
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+// Buckets are picked with a shift, so there has to be a power of 2 of them.
+static_assert((OS_FUTEX_BUCKETS & (OS_FUTEX_BUCKETS - 1)) == 0, "OS_FUTEX_BUCKETS has to be a power of 2");
+
+/*!
+ * @brief Wait queues every thread in os_wait_on() sleeps on, hashed by the address of it's word
+ * @note Only ever touched with the scheduler locked.
+ */
+static os_wait_queue_t futex_buckets[OS_FUTEX_BUCKETS];
+
+/*!
+ * @returns The wait queue threads waiting on a word sleep on
+ * @note Words are 4 byte aligned, so the bottom bits are dropped, and then it's multiplied by 2^32 over the golden ratio
+ * @note and we take the middle bits, so words next to each other land in buckets far apart.
+ */
+static inline os_wait_queue_t *os_futex_bucket(volatile uint32_t *addr)
+{
+  uint32_t hash = (uint32_t)((uintptr_t)addr >> 2) * 2654435761UL;
+  return &futex_buckets[(hash >> 16) & (OS_FUTEX_BUCKETS - 1)];
+}
+
+/*!
+ * @brief Wakes up threads waiting on a word, highest priority first
+ * @note Scheduler has to be locked.
+ * @returns How many threads we woke up
+ */
+static uint32_t os_futex_wake(volatile uint32_t *addr, uint32_t count)
+{
+  uint32_t woken = 0;
+
+  // Threads waiting on other words can share the bucket, so we only wake the ones on ours.
+  thread_t *waiter = os_futex_bucket(addr)->head;
+  while (waiter != NULL && woken < count)
+  {
+    thread_t *next = waiter->wait_next;
+    if (waiter->futex_addr == addr)
+    {
+      os_wait_queue_wake(waiter);
+      woken++;
+    }
+    waiter = next;
+  }
+
+  return woken;
+}
+
+/*!
+ * @brief Sleeps the calling thread on a word, as long as the word still holds what we expect
+ * @param volatile uint32_t *addr word we are waiting on, anywhere in memory
+ * @param uint32_t expected what the word holds while we should keep sleeping
+ * @param uint64_t timeout_us how long we sleep at most, OS_WAIT_FOREVER to never time out
+ * @returns os_wait_on_status_t
+ */
+os_wait_on_status_t os_wait_on(volatile uint32_t *addr, uint32_t expected, uint64_t timeout_us)
+{
+  os_sched_lock();
+
+  // Whoever changes the word wakes us after they change it, so if it already changed there's no wake coming.
+  if (*addr != expected)
+  {
+    os_sched_unlock();
+    return OS_WAIT_ON_CHANGED;
+  }
+
+  thread_t *this_thread = _os_current_thread();
+  this_thread->futex_addr = addr;
+  thread_state_t block_state = (timeout_us == OS_WAIT_FOREVER) ? THREAD_BLOCKED_FUTEX : THREAD_BLOCKED_FUTEX_TIMEOUT;
+  thread_wake_status_t wake_status = os_wait_queue_block(os_futex_bucket(addr), block_state, timeout_us);
+
+  // We're off the bucket by now, so nothing looks at it anymore, but a stale word shouldn't outlive the wait.
+  this_thread->futex_addr = NULL;
+
+  switch (wake_status)
+  {
+  case THREAD_WAKE_SIGNALED:
+    return OS_WAIT_ON_WOKEN;
+  case THREAD_WAKE_TIMEOUT:
+    return OS_WAIT_ON_TIMEOUT;
+  default:
+    // Nobody woke us, we either never switched out or got suspended off the bucket.
+    return OS_WAIT_ON_NOT_SLEPT;
+  }
+}
+
+/*!
+ * @brief Wakes up threads sleeping on a word in os_wait_on()
+ * @param volatile uint32_t *addr
+ * @param uint32_t count most threads we wake up, highest priority first, OS_WAKE_ALL for all of them
+ * @returns How many threads we woke up
+ */
+uint32_t os_wake(volatile uint32_t *addr, uint32_t count)
+{
+  os_sched_lock();
+  uint32_t woken = os_futex_wake(addr, count);
+  os_sched_unlock();
+  return woken;
+}
+
+/*!
+ * @brief os_wake_from_isr() operation that the kernel runs for us
+ */
+static bool os_futex_wake_isr_request(void *object, void *data, uint32_t arg)
+{
+  (void)data;
+  os_futex_wake((volatile uint32_t *)object, arg);
+  return true;
+}
+
+/*!
+ * @brief Interrupt safe version of os_wake()
+ * @param volatile uint32_t *addr
+ * @param uint32_t count most threads we wake up, OS_WAKE_ALL for all of them
+ * @returns false if the kernel was busy and the wake had to be dropped
+ */
+bool os_wake_from_isr(volatile uint32_t *addr, uint32_t count)
+{
+  return os_isr_request(&os_futex_wake_isr_request, (void *)addr, NULL, count);
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _OSFUTEXKERNEL_H
+#define _OSFUTEXKERNEL_H
+
+// So we can configure modules
+#include "enabled_modules.h"
+
+#ifdef FUTEX_MODULE
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "OSThreadKernel.h"
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief How many wait queues the waiting threads are hashed into by address, has to be a power of 2
+ * @note Threads waiting on different words can share a queue, os_wake() only wakes the ones on the word it was given.
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_FUTEX_BUCKETS
+static const uint32_t OS_FUTEX_BUCKETS = 32;
+#else
+static const uint32_t OS_FUTEX_BUCKETS = EXTERN_OS_FUTEX_BUCKETS;
+#endif
+
+/*!
+ * @brief Timeout for os_wait_on() that never runs out
+ */
+static const uint64_t OS_WAIT_FOREVER = UINT64_MAX;
+
+/*!
+ * @brief Count for os_wake() that wakes everyone waiting on the word
+ */
+static const uint32_t OS_WAKE_ALL = UINT32_MAX;
+
+/*!
+ * @brief Why os_wait_on() came back
+ */
+enum os_wait_on_status_t
+{
+  // os_wake() woke us up, or we came back early. Either way check the word again.
+  OS_WAIT_ON_WOKEN = 0,
+  // Word didn't hold what we expected, so we never went to sleep.
+  OS_WAIT_ON_CHANGED = 1,
+  OS_WAIT_ON_TIMEOUT = 2,
+  // We never slept, since the caller had the scheduler locked so there was no switching out,
+  // or os_suspend_thread() took us off the word. Nobody woke us, so check the word again.
+  OS_WAIT_ON_NOT_SLEPT = 3
+};
+
+/*!
+ * @brief Sleeps the calling thread on a word, as long as the word still holds what we expect
+ * @note Checking the word and going to sleep happen with the scheduler locked, so an os_wake() from another thread or an interrupt
+ * @note that comes after the word changed can't get lost in between. Build on it like a futex, change the word and then os_wake():
+ * @note   while (latch != 0) os_wait_on(&latch, latch);
+ * @note Waiters are woken highest priority first. There's no priority inheritance, MutexLock has that.
+ * @param volatile uint32_t *addr word we are waiting on, anywhere in memory
+ * @param uint32_t expected what the word holds while we should keep sleeping
+ * @param uint64_t timeout_us how long we sleep at most, OS_WAIT_FOREVER to never time out
+ * @returns os_wait_on_status_t
+ */
+os_wait_on_status_t os_wait_on(volatile uint32_t *addr, uint32_t expected, uint64_t timeout_us = OS_WAIT_FOREVER);
+
+/*!
+ * @brief Wakes up threads sleeping on a word in os_wait_on()
+ * @param volatile uint32_t *addr
+ * @param uint32_t count most threads we wake up, highest priority first, OS_WAKE_ALL for all of them
+ * @returns How many threads we woke up
+ */
+uint32_t os_wake(volatile uint32_t *addr, uint32_t count = OS_WAKE_ALL);
+
+/*!
+ * @brief Interrupt safe version of os_wake()
+ * @note Never blocks, see os_isr_request() for how it gets to the kernel.
+ * @param volatile uint32_t *addr
+ * @param uint32_t count most threads we wake up, OS_WAKE_ALL for all of them
+ * @returns false if the kernel was busy and the wake had to be dropped
+ */
+bool os_wake_from_isr(volatile uint32_t *addr, uint32_t count = OS_WAKE_ALL);
+
+#endif
+#endif
@@ -6,16 +6,37 @@ Author: William Redenbaugh, Fernando Trias
 Last Edit Date: 10/24/2020
 */
 
+/*!
+ * @brief Bits of the mutex word, thread_t is always at least 4 byte aligned so the bottom two are free
+ */
+static const uintptr_t MUTEX_WORD_HELD = 1;
+static const uintptr_t MUTEX_WORD_KERNEL = 2;
+static const uintptr_t MUTEX_WORD_FLAGS = MUTEX_WORD_HELD | MUTEX_WORD_KERNEL;
+
+/*!
+ * @returns What the mutex word holds while a thread owns the mutex
+ * @note Held is set on it's own so a mutex locked before threads_init(), with no thread_t yet, still isn't 0.
+ */
+static inline uintptr_t mutex_word(thread_t *owner)
+{
+  return (uintptr_t)owner | MUTEX_WORD_HELD;
+}
+
+/*!
+ * @returns The owner of a held mutex
+ */
+static inline thread_t *mutex_word_owner(uintptr_t word)
+{
+  return (thread_t *)(word & ~MUTEX_WORD_FLAGS);
+}
+
 /*!
  * @brief Allows us to check the current state of our mutex
  * @returns MutexLockState_t state of the mutex
  */
 MutexLockState_t MutexLock::getState(void)
 {
-  int os_state = os_stop();
-  MutexLockState_t state = (MutexLockState_t)this->state;
-  os_start(os_state);
-  return state;
+  return this->state == 0 ? MUTEX_UNLOCKED : MUTEX_LOCKED;
 }
 
 /*!
@@ -23,39 +44,22 @@ MutexLockState_t MutexLock::getState(void)
  * @param timeout_ms
  * @returns MutexLockReturnStatus or whether or not we were able to get the mutex
  */
-MutexLockReturnStatus __attribute__((noinline)) MutexLock::lock(uint32_t timeout_ms)
+MutexLockReturnStatus MutexLock::lock(uint32_t timeout_ms)
 {
-  // Stop the kernel for mission critical stuff.
-  int os_state = os_stop();
-
-  thread_t *this_thread = _os_current_thread();
-  this_thread->mutex_semaphore = &this->state;
-  this_thread->flags = THREAD_BLOCKED_MUTEX_TIMEOUT;
-  this_thread->interval = timeout_ms;
-  this_thread->previous_millis = millis();
-
-  // reboot the OS kernel.
-  os_start(os_state);
-  // Context switch out of the thread.
-  _os_yield();
-
-  // Stop the OS again when checking mutex stuff
-  os_state = os_stop();
-  // If the lock in unlocked, then we acquire it.
-  if (this->state == MUTEX_UNLOCKED)
-  {
-    // Let's acquire it!
-    this->state = MUTEX_LOCKED;
-    // We are done dealing with OS specific commands
-    os_start(os_state);
-    // We gottem
+  return this->lock_us((uint64_t)timeout_ms * 1000);
+}
+
+/*!
+ * @brief Allows us to lock our mutex, with a timeout in microseconds
+ * @param timeout_us
+ * @returns MutexLockReturnStatus or whether or not we were able to get the mutex
+ */
+MutexLockReturnStatus __attribute__((noinline)) MutexLock::lock_us(uint64_t timeout_us)
+{
+  if (os_atomic_cas_ptr(&this->state, 0, mutex_word(_os_current_thread())))
     return MUTEX_ACQUIRE_SUCESS;
-  }
-  else
-  {
-    os_start(os_state);
-    return MUTEX_ACQUIRE_FAIL;
-  }
+
+  return this->lock_slow(THREAD_BLOCKED_MUTEX_TIMEOUT, timeout_us);
 }
 
 /*!
@@ -64,23 +68,10 @@ MutexLockReturnStatus __attribute__((noinline)) MutexLock::lock(uint32_t timeout
  */
 MutexLockReturnStatus MutexLock::tryLock(void)
 {
-  // Current state of the operating system.
-  int os_state = os_stop();
-
-  // If the lock in unlocked, then we acquire it.
-  if (this->state == MUTEX_UNLOCKED)
-  {
-    // Let's acquire it!
-    this->state = MUTEX_LOCKED;
-    // We are done dealing with OS specific commands
-    os_start(os_state);
-    // We gottem
+  // Never waits, so it never needs the kernel.
+  if (os_atomic_cas_ptr(&this->state, 0, mutex_word(_os_current_thread())))
     return MUTEX_ACQUIRE_SUCESS;
-  }
 
-  // Otherwise we lose it,
-  os_start(os_state);
-  // And we fail it.
   return MUTEX_ACQUIRE_FAIL;
 }
 
@@ -89,55 +80,91 @@ MutexLockReturnStatus MutexLock::tryLock(void)
  */
 void __attribute__((noinline)) MutexLock::lockWaitIndefinite(void)
 {
-  // Stop the kernel for mission critical stuff.
-  int os_state = os_stop();
-
-  // If the lock in unlocked, then we acquire it before we context switch just in case, to prevent any delays
-  if (this->state == MUTEX_UNLOCKED)
-  {
-    // Let's acquire it!
-    this->state = MUTEX_LOCKED;
-    // We are done dealing with OS specific commands
-    os_start(os_state);
-    // We gottem
+  if (os_atomic_cas_ptr(&this->state, 0, mutex_word(_os_current_thread())))
     return;
-  }
 
-  thread_t *this_thread = _os_current_thread();
-  this_thread->mutex_semaphore = &this->state;
-  // this_thread->thread_set_flags
-  this_thread->flags = THREAD_BLOCKED_MUTEX;
-  // reboot the OS kernel.
-  os_start(os_state);
+  while (this->lock_slow(THREAD_BLOCKED_MUTEX, 0) != MUTEX_ACQUIRE_SUCESS)
+    ;
+}
 
-  // Context switch out of the thread.
-  _os_yield();
+/*!
+ * @brief Gets the mutex through the kernel, blocking until we get it or time out
+ * @param thread_state_t block_state what we show up as while we wait
+ * @param uint64_t timeout_us 0 to wait for as long as it takes
+ * @returns MutexLockReturnStatus
+ */
+MutexLockReturnStatus MutexLock::lock_slow(thread_state_t block_state, uint64_t timeout_us)
+{
+  // Lock the scheduler for mission critical stuff.
+  os_sched_lock();
+  thread_t *self = _os_current_thread();
 
-  // Stop the OS again when checking mutex stuff
-  os_state = os_stop();
-  // If the lock in unlocked, then we acquire it.
-  if (this->state == MUTEX_UNLOCKED)
+  while (1)
   {
-    // Let's acquire it!
-    this->state = MUTEX_LOCKED;
-    // We are done dealing with OS specific commands
-    os_start(os_state);
-    // We gottem
-    return;
+    uintptr_t word = this->state;
+
+    // Owner let go before we stopped the kernel.
+    if (word == 0)
+    {
+      if (!os_atomic_cas_ptr(&this->state, 0, mutex_word(self)))
+        continue;
+      os_sched_unlock();
+      return MUTEX_ACQUIRE_SUCESS;
+    }
+
+    // From here on the owner has to unlock through the kernel, and it inherits our priority while we wait.
+    if (!(word & MUTEX_WORD_KERNEL))
+    {
+      if (!os_atomic_cas_ptr(&this->state, word, word | MUTEX_WORD_KERNEL))
+        continue;
+      os_wait_queue_set_owner(&this->waiters, mutex_word_owner(word));
+    }
+    break;
   }
+
+  // Sleep on the mutex wait queue, if we were woken up by unlock() the mutex was handed to us.
+  if (os_wait_queue_block(&this->waiters, block_state, timeout_us) == THREAD_WAKE_SIGNALED)
+    return MUTEX_ACQUIRE_SUCESS;
+
+  return MUTEX_ACQUIRE_FAIL;
 }
 
 /*!
  * @brief Unlocks a mutex if it hasn't been otherwise locked.
+ * @note If there are threads waiting, the mutex is handed straight to the highest priority one.
+ * @note Any priority we inherited from threads waiting on the mutex is given up.
  */
 void __attribute__((noinline)) MutexLock::unlock(void)
 {
-  int os_state = os_stop();
-  // Mutex is set to unlocked flag.
-  this->state = MUTEX_UNLOCKED;
+  // Nobody ever had to wait, so there's nobody to hand it to.
+  if (os_atomic_cas_ptr(&this->state, mutex_word(_os_current_thread()), 0))
+    return;
+
+  this->unlock_slow();
+}
+
+/*!
+ * @brief Unlocks through the kernel, handing the mutex to the highest priority waiter
+ */
+void MutexLock::unlock_slow(void)
+{
+  os_sched_lock();
+
+  // Nobody waiting, so the mutex is set to unlocked. Otherwise it stays locked for the thread we woke,
+  // which only has to go through the kernel to unlock if there's still someone waiting after it.
+  thread_t *next_owner = os_wait_queue_wake_one(&this->waiters);
+  bool still_waiting = this->waiters.head != NULL;
+  if (next_owner == NULL)
+    this->state = 0;
+  else
+    this->state = mutex_word(next_owner) | (still_waiting ? MUTEX_WORD_KERNEL : 0);
+
+  // We drop back down to whatever priority we had before we took the mutex, and the new owner inherits
+  // the priority of anyone still waiting.
+  os_wait_queue_set_owner(&this->waiters, still_waiting ? next_owner : NULL);
 
   __flush_cpu_pipeline();
-  os_start(os_state);
+  os_sched_unlock();
 }
 
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #ifdef MUTEX_MODULE
 
 #include "OSThreadKernel.h"
+#include "OSAtomicKernel.h"
 #include "DS_HELPER/priority_queue.hpp"
 
 /*!
@@ -30,6 +31,9 @@ enum MutexLockReturnStatus
 
 /*!
  * @brief Object descriptor to control a semaphore
+ * @note Uses priority inheritance: while a higher priority thread waits on the mutex, the owner runs at that priority,
+ * @note so a medium priority thread can't keep the owner(and the waiter) off the CPU.
+ * @note Locking a free mutex and unlocking one nobody is waiting on is a single compare and swap, the kernel only gets stopped once there's contention.
  */
 class MutexLock
 {
@@ -47,6 +51,13 @@ public:
    */
   MutexLockReturnStatus lock(uint32_t timeout_ms);
 
+  /*!
+   * @brief Allows us to lock our mutex, with a timeout in microseconds
+   * @param timeout_us
+   * @returns MutexLockReturnStatus or whether or not we were able to get the mutex
+   */
+  MutexLockReturnStatus lock_us(uint64_t timeout_us);
+
   /*!
    * @brief Attempt to lock the mutex without timeout.
    * @returns MutexLockReturnState state of whether or not we locked the mutex or not
@@ -60,11 +71,32 @@ public:
 
   /*!
    * @brief Unlocks a mutex if it hasn't been otherwise locked.
+   * @note If there are threads waiting, the mutex is handed straight to the highest priority one.
+   * @note Any priority we inherited from threads waiting on the mutex is given up.
    */
   void unlock(void);
 
 private:
-  volatile uint32_t state = MUTEX_UNLOCKED;
+  /*!
+   * @brief 0 while unlocked, otherwise the owner's thread_t with MUTEX_WORD_HELD set
+   * @note MUTEX_WORD_KERNEL gets set once someone has to wait, so the owner's unlock() goes through the kernel and hands the mutex over.
+   */
+  volatile uintptr_t state = 0;
+
+  /*!
+   * @brief Gets the mutex through the kernel, blocking until we get it or time out
+   */
+  MutexLockReturnStatus lock_slow(thread_state_t block_state, uint64_t timeout_us);
+
+  /*!
+   * @brief Unlocks through the kernel, handing the mutex to whoever has been waiting the longest at the highest priority
+   */
+  void unlock_slow(void);
+
+  /*!
+   * @brief Threads blocked waiting for the mutex, highest priority first.
+   */
+  os_wait_queue_t waiters;
 };
 
 #endif
@@ -1,13 +1,16 @@
 #include "OSQueueKernel.hpp"
 
+// The queue is only ever changed with the scheduler locked, rather than under a mutex,
+// so interrupts can push into it and nobody ever has to block just to touch it.
+
 bool VoidOSQueue::init(uint32_t queue_len)
 {
-    queue_lock.lockWaitIndefinite();
+    os_sched_lock();
 
     this->queue_len = queue_len;
     this->data_buffer = (QueueData *)malloc(sizeof(QueueData) * queue_len);
 
-    queue_lock.unlock();
+    os_sched_unlock();
 
     if (this->data_buffer == NULL)
     {
@@ -19,49 +22,68 @@ bool VoidOSQueue::init(uint32_t queue_len)
 
 bool VoidOSQueue::push(QueueData data)
 {
-    this->queue_lock.lockWaitIndefinite();
+    os_sched_lock();
+    bool ret = this->insert(data);
+    os_sched_unlock();
+    return ret;
+}
+
+bool VoidOSQueue::push_from_isr(QueueData data)
+{
+    return os_isr_request(&VoidOSQueue::push_isr_request, this, data.data, (uint32_t)data.type);
+}
+
+bool VoidOSQueue::push_isr_request(void *object, void *data, uint32_t arg)
+{
+    QueueData element;
+    element.data = data;
+    element.type = (QueueDataType)arg;
+    return ((VoidOSQueue *)object)->insert(element);
+}
+
+bool VoidOSQueue::insert(QueueData data)
+{
     // No more space for any more elements in the queue.
     if (this->queue_len == this->current_elements)
-    {
-        this->queue_lock.unlock();
         return false;
-    }
+
     this->current_elements++;
     this->data_buffer[tail] = data;
     this->tail++;
     if (this->tail == this->queue_len)
         this->tail = 0;
 
-    // If a thread is not in queue
-    // Also an atomic operation so stop preemptive switching
-    int os_state = os_stop();
-    if (this->consumer_thread_ptr != NULL)
-        this->consumer_thread_ptr->flags = THREAD_RUNNING;
-    os_start(os_state);
-
-    this->queue_lock.unlock();
+    // If a consumer is blocked waiting on data, we wake it up
+    os_wait_queue_wake_one(&this->consumer_waiters);
     return true;
 }
 
-QueueData VoidOSQueue::pop(void)
+QueueData VoidOSQueue::take(void)
 {
     QueueData new_data;
-    memset((void *)&new_data, 0, sizeof(new_data));
-    this->queue_lock.lockWaitIndefinite();
-    if (this->current_elements == 0)
-    {
-        this->queue_lock.unlock();
-        new_data.data = NULL;
-        return new_data;
-    }
     new_data.data = this->data_buffer[this->head].data;
     new_data.type = this->data_buffer[this->head].type;
     this->current_elements--;
     this->head++;
     if (this->head == this->queue_len)
         this->head = 0;
+    return new_data;
+}
+
+QueueData VoidOSQueue::pop(void)
+{
+    QueueData new_data;
+    memset((void *)&new_data, 0, sizeof(new_data));
 
-    this->queue_lock.unlock();
+    os_sched_lock();
+    if (this->current_elements == 0)
+    {
+        os_sched_unlock();
+        new_data.data = NULL;
+        return new_data;
+    }
+    new_data = this->take();
+    os_sched_unlock();
     return new_data;
 }
 
@@ -70,27 +92,16 @@ QueueData VoidOSQueue::popBlocking(void)
     QueueData new_data;
 
     consumer_lock.lockWaitIndefinite();
-    if (this->current_elements == 0)
+    os_sched_lock();
+    while (this->current_elements == 0)
     {
-        thread_t *self_thread = _os_current_thread();
-        this->consumer_thread_ptr = self_thread;
-        int os_state = os_stop();
-        self_thread->flags = THREAD_BLOCKED_QUEUE;
-        os_start(os_state);
-        // System blocking so yield
-        _os_yield();
+        // System blocking so sleep on the consumer wait queue until push() wakes us
+        os_wait_queue_block(&this->consumer_waiters, THREAD_BLOCKED_QUEUE, 0);
+        os_sched_lock();
     }
-    this->consumer_thread_ptr = NULL;
+    new_data = this->take();
+    os_sched_unlock();
     consumer_lock.unlock();
-    this->queue_lock.lockWaitIndefinite();
-
-    new_data.data = this->data_buffer[this->head].data;
-    new_data.type = this->data_buffer[this->head].type;
-    this->current_elements--;
-    this->head++;
-    if (this->head == this->queue_len)
-        this->head = 0;
 
-    this->queue_lock.unlock();
     return new_data;
 }
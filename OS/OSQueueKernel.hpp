@@ -19,9 +19,8 @@ struct QueueData
 class VoidOSQueue
 {
 public:
-    MutexLock queue_lock;
     MutexLock consumer_lock;
-    thread_t *consumer_thread_ptr = NULL;
+    os_wait_queue_t consumer_waiters;
     volatile uint32_t queue_len = 0;
     uint32_t current_elements = 0;
     QueueData *data_buffer;
@@ -43,6 +42,14 @@ public:
      */
     bool push(QueueData data);
 
+    /**
+     * @brief Interrupt safe version of push()
+     * @note Never blocks, if a higher priority consumer was waiting we switch to it once the interrupt returns.
+     * @param void* data pointer to whatever data you want to add to the queue
+     * @return false if the queue was full, or the kernel was busy and the element had to be dropped
+     */
+    bool push_from_isr(QueueData data);
+
     /**
      * @brief Removes off topmost element from queue.
      * @return void* pointer to topmost data
@@ -56,6 +63,22 @@ public:
      * @note Returns null if there is no available element
      */
     QueueData popBlocking(void);
+
+private:
+    /**
+     * @brief Adds an element and wakes up a consumer, kernel has to be stopped
+     */
+    bool insert(QueueData data);
+
+    /**
+     * @brief Takes off the topmost element, kernel has to be stopped and there has to be an element
+     */
+    QueueData take(void);
+
+    /**
+     * @brief push_from_isr() operation that the kernel runs for us
+     */
+    static bool push_isr_request(void *object, void *data, uint32_t arg);
 };
 
 #endif
\ No newline at end of file
@@ -7,16 +7,34 @@
  *   Last Edite Date: 3/27/2023
  */
 
+/*!
+ *   @brief Top bit of the state says threads are waiting on the semaphore, the rest is how many entries are taken
+ */
+static const uint32_t SEMAPHORE_WORD_WAITERS = 0x80000000;
+
 /*!
  *   @brief Get's the current entrants / states of the semaphore
  *   @return SemaphoreLockState_t state of the semaphore
  */
 uint32_t SemaphoreLock::getState(void)
 {
-    int os_state = os_stop();
-    uint32_t state = this->state;
-    os_start(os_state);
-    return state;
+    return this->state & ~SEMAPHORE_WORD_WAITERS;
+}
+
+/*!
+ * @brief Takes an entry if there's one free, without going near the kernel
+ * @returns How many entries are taken with ours, 0 if there wasn't one free
+ */
+static inline uint32_t semaphore_fast_entry(volatile uint32_t *state, uint32_t max_entry)
+{
+    uint32_t word = *state;
+    while ((word & ~SEMAPHORE_WORD_WAITERS) < max_entry)
+    {
+        if (os_atomic_cas32(state, word, word + 1))
+            return (word & ~SEMAPHORE_WORD_WAITERS) + 1;
+        word = *state;
+    }
+    return 0;
 }
 
 /*!
@@ -24,30 +42,27 @@ uint32_t SemaphoreLock::getState(void)
  * @param timeout_ms
  * @returns SemaphoreLockReturnStatus or whether or not we were able to get the mutex
  */
-SemaphoreRet __attribute__((noinline)) SemaphoreLock::entry(uint32_t timeout_ms)
+SemaphoreRet SemaphoreLock::entry(uint32_t timeout_ms)
 {
-    SemaphoreRet ret = this->tryEntry();
+    return this->entry_us((uint64_t)timeout_ms * 1000);
+}
 
-    if (ret.ret_status == SEMAPHORE_ACQUIRE_SUCCESS)
+/*!
+ * @brief Allows us to acquire our semaphore, with a timeout in microseconds
+ * @param timeout_us
+ * @returns SemaphoreLockReturnStatus or whether or not we were able to get the mutex
+ */
+SemaphoreRet __attribute__((noinline)) SemaphoreLock::entry_us(uint64_t timeout_us)
+{
+    SemaphoreRet ret;
+    ret.count = semaphore_fast_entry(&this->state, this->max_entry);
+    if (ret.count)
+    {
+        ret.ret_status = SEMAPHORE_ACQUIRE_SUCCESS;
         return ret;
+    }
 
-    int state = os_stop();
-
-    thread_t *this_thread = _os_current_thread();
-    this_thread->flags = THREAD_BLOCKED_SEMAPHORE_TIMEOUT;
-    this_thread->interval = timeout_ms;
-    this_thread->previous_millis = millis();
-
-    // Setting up the semaphore current and future counts here
-    this_thread->mutex_semaphore = &this->state;
-    this_thread->semaphore_max_count = this->max_entry;
-
-    os_start(state);
-    _os_yield();
-
-    __flush_cpu_pipeline();
-
-    return this->tryEntry();
+    return this->entry_slow(THREAD_BLOCKED_SEMAPHORE_TIMEOUT, timeout_us);
 }
 
 /*!
@@ -56,20 +71,16 @@ SemaphoreRet __attribute__((noinline)) SemaphoreLock::entry(uint32_t timeout_ms)
  */
 SemaphoreRet SemaphoreLock::tryEntry(void)
 {
-    int os_state = os_stop();
+    // Never waits, so it never needs the kernel.
     SemaphoreRet ret;
-
-    if (this->state < this->max_entry)
+    ret.count = semaphore_fast_entry(&this->state, this->max_entry);
+    if (ret.count)
     {
-        this->state++;
-        os_start(os_state);
-        ret.count = this->state;
         ret.ret_status = SEMAPHORE_ACQUIRE_SUCCESS;
         return ret;
     }
 
-    os_start(os_state);
-    ret.count = this->state;
+    ret.count = this->getState();
     ret.ret_status = SEMAPHORE_ACQUIRE_FAIL;
     return ret;
 }
@@ -79,48 +90,121 @@ SemaphoreRet SemaphoreLock::tryEntry(void)
  */
 int __attribute__((noinline)) SemaphoreLock::entryWaitIndefinite(void)
 {
-    SemaphoreRet sem_ret = this->tryEntry();
-    if (sem_ret.ret_status == SEMAPHORE_ACQUIRE_SUCCESS)
-        return sem_ret.count;
+    int count = semaphore_fast_entry(&this->state, this->max_entry);
+    if (count)
+        return count;
 
-    int state = os_stop();
-
-    // Pointer to the current thread.
-    thread_t *this_thread = _os_current_thread();
+    SemaphoreRet ret;
+    do
+    {
+        ret = this->entry_slow(THREAD_BLOCKED_SEMAPHORE, 0);
+    } while (ret.ret_status != SEMAPHORE_ACQUIRE_SUCCESS);
+    return ret.count;
+}
 
-    // Setting up the semaphore current and future counts here
-    this_thread->flags = THREAD_BLOCKED_SEMAPHORE;
-    this_thread->mutex_semaphore = &this->state;
-    this_thread->semaphore_max_count = this->max_entry;
+/*!
+ *   @brief Gets an entry through the kernel, blocking until we get one or time out
+ *   @param thread_state_t block_state what we show up as while we wait
+ *   @param uint64_t timeout_us 0 to wait for as long as it takes
+ */
+SemaphoreRet SemaphoreLock::entry_slow(thread_state_t block_state, uint64_t timeout_us)
+{
+    SemaphoreRet ret;
+    os_sched_lock();
 
-    os_start(state);
-    _os_yield();
-    __flush_cpu_pipeline();
+    while (1)
+    {
+        uint32_t word = this->state;
+
+        // Someone exited before we stopped the kernel.
+        if ((word & ~SEMAPHORE_WORD_WAITERS) < this->max_entry)
+        {
+            if (!os_atomic_cas32(&this->state, word, word + 1))
+                continue;
+            os_sched_unlock();
+            ret.count = (word & ~SEMAPHORE_WORD_WAITERS) + 1;
+            ret.ret_status = SEMAPHORE_ACQUIRE_SUCCESS;
+            return ret;
+        }
+
+        // From here on exit() has to go through the kernel, so it hands us the entry.
+        if (word & SEMAPHORE_WORD_WAITERS || os_atomic_cas32(&this->state, word, word | SEMAPHORE_WORD_WAITERS))
+            break;
+    }
 
-    // Increment the semaphore so it's valid.
-    sem_ret = this->tryEntry();
+    // If we were woken up by exit(), that thread's entry was handed to us.
+    thread_wake_status_t wake_status = os_wait_queue_block(&this->waiters, block_state, timeout_us);
 
-    // So the compiler stops giving me errors.
-    return sem_ret.count;
+    ret.count = this->getState();
+    ret.ret_status = (wake_status == THREAD_WAKE_SIGNALED) ? SEMAPHORE_ACQUIRE_SUCCESS : SEMAPHORE_ACQUIRE_FAIL;
+    return ret;
 }
 
 /*!
  *   @brief Decrements the semaphore counter.
+ *   @note If there are threads waiting, the entry is handed straight to the highest priority one.
  */
 SemaphoreExitReturnStatus __attribute__((noinline)) SemaphoreLock::exit(void)
 {
-    SemaphoreExitReturnStatus ret = SEMAPHORE_EXIT_SUCCCESS;
-
-    int os_state = os_stop();
-
-    if (this->state == 0)
-        ret = SEMAPHORE_EXIT_FAIL;
+    // Nobody waiting, so we just give the entry back.
+    uint32_t word = this->state;
+    while (!(word & SEMAPHORE_WORD_WAITERS))
+    {
+        if (word == 0)
+            return SEMAPHORE_EXIT_FAIL;
+        if (os_atomic_cas32(&this->state, word, word - 1))
+            return SEMAPHORE_EXIT_SUCCCESS;
+        word = this->state;
+    }
 
-    this->state--;
+    os_sched_lock();
+    SemaphoreExitReturnStatus ret = this->release();
     __flush_cpu_pipeline();
-    os_start(os_state);
+    os_sched_unlock();
 
     return ret;
 }
 
+/*!
+ *   @brief Interrupt safe version of exit()
+ *   @note Never blocks, if a higher priority thread was waiting for an entry we switch to it once the interrupt returns.
+ *   @returns SEMAPHORE_EXIT_FAIL if there was nothing to exit, or the kernel was busy and the exit had to be dropped
+ */
+SemaphoreExitReturnStatus SemaphoreLock::exit_from_isr(void)
+{
+    if (os_isr_request(&SemaphoreLock::exit_isr_request, this, NULL, 0))
+        return SEMAPHORE_EXIT_SUCCCESS;
+    return SEMAPHORE_EXIT_FAIL;
+}
+
+/*!
+ *   @brief exit_from_isr() operation that the kernel runs for us
+ */
+bool SemaphoreLock::exit_isr_request(void *object, void *data, uint32_t arg)
+{
+    (void)data;
+    (void)arg;
+    return ((SemaphoreLock *)object)->release() == SEMAPHORE_EXIT_SUCCCESS;
+}
+
+/*!
+ *   @brief Gives up an entry, kernel has to be stopped
+ */
+SemaphoreExitReturnStatus SemaphoreLock::release(void)
+{
+    // Threads can't get in while the kernel is stopped, and interrupts never take the fast path,
+    // so nothing changes the state under us. A thread halfway through a compare and swap just fails it.
+    uint32_t count = this->state & ~SEMAPHORE_WORD_WAITERS;
+    if (count == 0)
+        return SEMAPHORE_EXIT_FAIL;
+
+    // Nobody waiting, so we give up our entry. Otherwise the count stays the same for the thread we woke.
+    if (os_wait_queue_wake_one(&this->waiters) == NULL)
+        count--;
+
+    // Once the last waiter is gone, entries go back to the fast path.
+    this->state = count | (this->waiters.head != NULL ? SEMAPHORE_WORD_WAITERS : 0);
+    return SEMAPHORE_EXIT_SUCCCESS;
+}
+
 #endif
\ No newline at end of file
@@ -8,6 +8,7 @@
 
 #include <Arduino.h>
 #include "OSThreadKernel.h"
+#include "OSAtomicKernel.h"
 
 /*!
  * @brief Enumerated success or failiure of acquiring the semaphore
@@ -39,6 +40,7 @@ typedef struct SemaphoreRet
 /*!
  *   @brief Object descriptor to control a semaphore
  *   @brief By default a binary semaphore()
+ *   @note Taking a free entry and giving one back with nobody waiting is a single compare and swap, the kernel only gets stopped once someone has to wait.
  */
 class SemaphoreLock
 {
@@ -61,6 +63,13 @@ public:
      */
     SemaphoreRet entry(uint32_t timeout_ms);
 
+    /*!
+     * @brief Allows us to acquire our semaphore, with a timeout in microseconds
+     * @param timeout_us
+     * @returns SemaphoreLockReturnStatus or whether or not we were able to get the mutex
+     */
+    SemaphoreRet entry_us(uint64_t timeout_us);
+
     /*!
      * @brief Allows us to acquire our semaphore
      * @param timeout_ms
@@ -75,15 +84,43 @@ public:
 
     /*!
      *   @brief Decrements the current semaphore counter
+     *   @note If there are threads waiting, the entry is handed straight to the highest priority one.
      */
     SemaphoreExitReturnStatus exit(void);
 
+    /*!
+     *   @brief Interrupt safe version of exit()
+     *   @note Never blocks, if a higher priority thread was waiting for an entry we switch to it once the interrupt returns.
+     *   @returns SEMAPHORE_EXIT_FAIL if there was nothing to exit, or the kernel was busy and the exit had to be dropped
+     */
+    SemaphoreExitReturnStatus exit_from_isr(void);
+
 private:
     /*!
-     *   @brief
+     *   @brief Gives up an entry, kernel has to be stopped
+     */
+    SemaphoreExitReturnStatus release(void);
+
+    /*!
+     *   @brief exit_from_isr() operation that the kernel runs for us
+     */
+    static bool exit_isr_request(void *object, void *data, uint32_t arg);
+
+    /*!
+     *   @brief Gets an entry through the kernel, blocking until we get one or time out
+     */
+    SemaphoreRet entry_slow(thread_state_t block_state, uint64_t timeout_us);
+
+    /*!
+     *   @brief Entries taken, with SEMAPHORE_WORD_WAITERS set once someone has to wait so exit() goes through the kernel
      */
     volatile uint32_t state = 0;
     uint32_t max_entry = 1;
+
+    /*!
+     *   @brief Threads blocked waiting for an entry, highest priority first.
+     */
+    os_wait_queue_t waiters;
 };
 
 #endif
@@ -4,13 +4,53 @@
 
 /*!
  *   @brief Signals a bit
+ *   @note Wakes up every thread waiting on that bit.
  *   @param thread_signal_t which signal we are setting
  */
 void OSSignal::signal(thread_signal_t thread_signal)
 {
-    int state = os_stop();
-    this->bits |= (1 << (uint32_t)thread_signal);
-    os_start(state);
+    os_sched_lock();
+    this->set_bits(1 << (uint32_t)thread_signal);
+    os_sched_unlock();
+}
+
+/*!
+ *   @brief Interrupt safe version of signal()
+ *   @note Never blocks, if a higher priority thread was waiting on the bit we switch to it once the interrupt returns.
+ *   @param thread_signal_t which signal we are setting
+ *   @returns false if the kernel was busy and the signal had to be dropped
+ */
+bool OSSignal::signal_from_isr(thread_signal_t thread_signal)
+{
+    return os_isr_request(&OSSignal::signal_isr_request, this, NULL, (1 << (uint32_t)thread_signal));
+}
+
+/*!
+ *   @brief signal_from_isr() operation that the kernel runs for us
+ */
+bool OSSignal::signal_isr_request(void *object, void *data, uint32_t arg)
+{
+    (void)data;
+    ((OSSignal *)object)->set_bits(arg);
+    return true;
+}
+
+/*!
+ *   @brief Sets bits and wakes up whoever was waiting on them, kernel has to be stopped
+ */
+void OSSignal::set_bits(uint32_t bits)
+{
+    this->bits |= bits;
+
+    // Only the threads waiting on bits that are now set get woken up.
+    thread_t *waiter = this->waiters.head;
+    while (waiter != NULL)
+    {
+        thread_t *next = waiter->wait_next;
+        if (waiter->signal_bits_compare & this->bits)
+            os_wait_queue_wake(waiter);
+        waiter = next;
+    }
 }
 
 /*!
@@ -19,9 +59,9 @@ void OSSignal::signal(thread_signal_t thread_signal)
  */
 void OSSignal::clear(thread_signal_t thread_signal)
 {
-    int state = os_stop();
+    os_sched_lock();
     this->bits &= ~(1 << (uint32_t)thread_signal);
-    os_start(state);
+    os_sched_unlock();
 }
 
 /*!
@@ -44,35 +84,32 @@ bool OSSignal::check(thread_signal_t thread_signal)
  */
 bool OSSignal::wait(thread_signal_t thread_signal, uint32_t timeout_ms)
 {
+    return this->wait_us(thread_signal, (uint64_t)timeout_ms * 1000);
+}
+
+/*!
+ *   @brief Checks to see if a bit is cleared or set
+ *   @param thread_signal_t which bit we want to check
+ *   @param uint64_t timeout_us timeout or max time in microseconds we are willing to wait for bits to clear
+ *   @returns whether or or not we we able to get set bits or not
+ */
+bool OSSignal::wait_us(thread_signal_t thread_signal, uint64_t timeout_us)
+{
+    // Lock the scheduler so we can make changes to the thread.
+    os_sched_lock();
+
     // Checking case immediatly.
     if (OS_CHECK_BIT(this->bits, (uint32_t)thread_signal))
+    {
+        os_sched_unlock();
         return true;
+    }
 
-    // Stop the operating system so we can make changes to the thread.
-    int os_state = os_stop();
-
-    thread_t *this_thread = _os_current_thread();
-
-    // Set the bit that the thread is waiting on
-    this_thread->signal_bit = &this->bits;
     // Which bits are we comparing to
-    this_thread->signal_bits_compare = (1 << (uint32_t)thread_signal);
-    this_thread->previous_millis = millis();
-    this_thread->interval = timeout_ms;
-    this_thread->flags = THREAD_BLOCKED_SIGNAL_TIMEOUT;
-
-    // Restart the OS after we have completed touching the thread.
-    os_start(os_state);
+    _os_current_thread()->signal_bits_compare = (1 << (uint32_t)thread_signal);
 
-    // Context switch out of the thread.
-    _os_yield();
-
-    // If were able to get access to the signal
-    if (OS_CHECK_BIT(this->bits, (uint32_t)thread_signal))
-        return true;
-
-    // Otherwise we weren't able to
-    return false;
+    // Sleep on our wait queue until signal() wakes us up or we time out.
+    return os_wait_queue_block(&this->waiters, THREAD_BLOCKED_SIGNAL_TIMEOUT, timeout_us) == THREAD_WAKE_SIGNALED;
 }
 
 /*!
@@ -82,9 +119,20 @@ bool OSSignal::wait(thread_signal_t thread_signal, uint32_t timeout_ms)
  *   @returns whether or or not we we able to get set bits or not
  */
 bool OSSignal::wait_n_clear(thread_signal_t thread_signal, uint32_t timeout_ms)
+{
+    return this->wait_n_clear_us(thread_signal, (uint64_t)timeout_ms * 1000);
+}
+
+/*!
+ *   @brief Checks to see if a bit is cleared or set. If bit was set, then we cleared it.
+ *   @param thread_signal_t which bit we want to check
+ *   @param uint64_t timeout_us timeout or max time in microseconds we are willing to wait for bits to clear
+ *   @returns whether or or not we we able to get set bits or not
+ */
+bool OSSignal::wait_n_clear_us(thread_signal_t thread_signal, uint64_t timeout_us)
 {
     // We waited, and eventually the signal worked out for us
-    if (this->wait(thread_signal, timeout_ms))
+    if (this->wait_us(thread_signal, timeout_us))
     {
         this->clear(thread_signal);
         return true;
@@ -100,26 +148,22 @@ bool OSSignal::wait_n_clear(thread_signal_t thread_signal, uint32_t timeout_ms)
  */
 void OSSignal::wait_notimeout(thread_signal_t thread_signal)
 {
-    // Checking case immediatly.
-    if (OS_CHECK_BIT(this->bits, (uint32_t)thread_signal))
-        return;
-
-    // Stop the operating system so we can make changes to the thread.
-    int os_state = os_stop();
+    // Lock the scheduler so we can make changes to the thread.
+    os_sched_lock();
 
-    thread_t *this_thread = _os_current_thread();
+    while (!OS_CHECK_BIT(this->bits, (uint32_t)thread_signal))
+    {
+        // Which bits are we comparing to
+        _os_current_thread()->signal_bits_compare = (1 << (uint32_t)thread_signal);
 
-    // Set the bit that the thread is waiting on
-    this_thread->signal_bit = &this->bits;
-    // Which bits are we comparing to
-    this_thread->signal_bits_compare = (1 << (uint32_t)thread_signal);
-    this_thread->flags = THREAD_BLOCKED_SIGNAL;
+        // Sleep on our wait queue until signal() wakes us up.
+        if (os_wait_queue_block(&this->waiters, THREAD_BLOCKED_SIGNAL, 0) == THREAD_WAKE_SIGNALED)
+            return;
 
-    // Restart the OS after we have completed touching the thread.
-    os_start(os_state);
+        os_sched_lock();
+    }
 
-    // Context switch out of the thread. Whatever happens happens.
-    _os_yield();
+    os_sched_unlock();
 }
 
 /*!
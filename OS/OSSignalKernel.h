@@ -13,10 +13,19 @@ class OSSignal
 public:
     /*!
      *   @brief Signals a bit
+     *   @note Wakes up every thread waiting on that bit.
      *   @param thread_signal_t which signal we are setting
      */
     void signal(thread_signal_t thread_signal);
 
+    /*!
+     *   @brief Interrupt safe version of signal()
+     *   @note Never blocks, if a higher priority thread was waiting on the bit we switch to it once the interrupt returns.
+     *   @param thread_signal_t which signal we are setting
+     *   @returns false if the kernel was busy and the signal had to be dropped
+     */
+    bool signal_from_isr(thread_signal_t thread_signal);
+
     /*!
      *   @brief clears a bit
      *   @param thread_signal_t which signal we are clearing
@@ -38,6 +47,14 @@ public:
      */
     bool wait(thread_signal_t thread_signal, uint32_t timeout_ms);
 
+    /*!
+     *   @brief Checks to see if a bit is cleared or set
+     *   @param thread_signal_t which bit we want to check
+     *   @param uint64_t timeout_us timeout or max time in microseconds we are willing to wait for bits to clear
+     *   @returns whether or or not we we able to get set bits or not
+     */
+    bool wait_us(thread_signal_t thread_signal, uint64_t timeout_us);
+
     /*!
      *   @brief Checks to see if a bit is cleared or set. If bit was set, then we cleared it.
      *   @param thread_signal_t which bit we want to check
@@ -46,6 +63,14 @@ public:
      */
     bool wait_n_clear(thread_signal_t thread_signal, uint32_t timeout_ms);
 
+    /*!
+     *   @brief Checks to see if a bit is cleared or set. If bit was set, then we cleared it.
+     *   @param thread_signal_t which bit we want to check
+     *   @param uint64_t timeout_us timeout or max time in microseconds we are willing to wait for bits to clear
+     *   @returns whether or or not we we able to get set bits or not
+     */
+    bool wait_n_clear_us(thread_signal_t thread_signal, uint64_t timeout_us);
+
     /*!
      *   @brief Waits for bits to be set indefinitly
      *   @param thread_signal_t thread_signal to be sete
@@ -58,8 +83,21 @@ public:
     uint32_t bits_return(void);
 
 private:
+    /*!
+     *   @brief Sets bits and wakes up whoever was waiting on them, kernel has to be stopped
+     */
+    void set_bits(uint32_t bits);
+
+    /*!
+     *   @brief signal_from_isr() operation that the kernel runs for us
+     */
+    static bool signal_isr_request(void *object, void *data, uint32_t arg);
+
     // Bits data that we are using to wait with
     volatile uint32_t bits = 0;
+
+    // Threads waiting on any of our bits, highest priority first.
+    os_wait_queue_t waiters;
 };
 
 #endif
@@ -0,0 +1,256 @@
+#include "OSStackPoolKernel.h"
+#include "OSThreadKernel.h"
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Free stacks are linked through a node at the top of the stack
+ * @note At the top rather than the bottom, since the bottom of a stack that was just switched out can still be under it's MPU guard.
+ */
+typedef struct os_stack_pool_node_t
+{
+  struct os_stack_pool_node_t *next;
+  uint8_t *stack;
+} os_stack_pool_node_t;
+
+/*!
+ * @brief Free stacks of each size class
+ */
+static os_stack_pool_node_t *pool_free[OS_STACK_POOL_CLASS_COUNT];
+
+/*!
+ * @brief Statistics of each size class, with stacks too big for the pool in the last entry
+ */
+static os_stack_pool_stats_t pool_stats[OS_STACK_POOL_CLASS_COUNT + 1];
+
+/*!
+ * @brief Stacks too big for the pool whose threads are gone, waiting on the idle thread to free them
+ */
+static os_stack_pool_node_t *pool_reap_list = NULL;
+static uint32_t pool_reap_count = 0;
+
+/*!
+ * @returns Which size class a stack of this size goes in, OS_STACK_POOL_CLASS_COUNT if it's too big for the pool
+ */
+static inline int os_stack_pool_class(int stack_size)
+{
+  int n = 0;
+  while (n < OS_STACK_POOL_CLASS_COUNT && OS_STACK_POOL_CLASSES[n] < stack_size)
+    n++;
+  return n;
+}
+
+/*!
+ * @returns Where the free list node of a stack goes, 8 byte aligned at the top of it
+ */
+static inline os_stack_pool_node_t *os_stack_pool_node(uint8_t *stack, int stack_size)
+{
+  uintptr_t node = ((uintptr_t)stack + stack_size - sizeof(os_stack_pool_node_t)) & ~(uintptr_t)7;
+  return (os_stack_pool_node_t *)node;
+}
+
+/*!
+ * @brief Puts a stack on a free list
+ */
+static inline void os_stack_pool_push(os_stack_pool_node_t **list, uint8_t *stack, int stack_size)
+{
+  os_stack_pool_node_t *node = os_stack_pool_node(stack, stack_size);
+  node->stack = stack;
+  node->next = *list;
+  *list = node;
+}
+
+/*!
+ * @brief Takes a stack off a free list
+ * @returns The stack, or NULL if the list is empty
+ */
+static inline uint8_t *os_stack_pool_pop(os_stack_pool_node_t **list)
+{
+  os_stack_pool_node_t *node = *list;
+  if (node == NULL)
+    return NULL;
+  *list = node->next;
+  return node->stack;
+}
+
+/*!
+ * @brief Sets up the size of each class for the statistics
+ */
+static inline void os_stack_pool_init_stats(void)
+{
+  if (pool_stats[0].stack_size != 0)
+    return;
+  for (int n = 0; n < OS_STACK_POOL_CLASS_COUNT; n++)
+    pool_stats[n].stack_size = OS_STACK_POOL_CLASSES[n];
+}
+
+/*!
+ * @brief Gets a stack for a new thread, out of the pool if there's one free
+ * @note Kernel has to be stopped.
+ * @param int *stack_size size we want, rounded up to the size of the stack we hand out
+ * @returns The stack, or NULL if we are out of memory
+ */
+uint8_t *os_stack_pool_alloc(int *stack_size)
+{
+  os_stack_pool_init_stats();
+  int size_class = os_stack_pool_class(*stack_size);
+  os_stack_pool_stats_t *stats = &pool_stats[size_class];
+
+  uint8_t *stack = NULL;
+  if (size_class < OS_STACK_POOL_CLASS_COUNT)
+  {
+    *stack_size = OS_STACK_POOL_CLASSES[size_class];
+    stack = os_stack_pool_pop(&pool_free[size_class]);
+    if (stack != NULL)
+      stats->free--;
+  }
+
+  if (stack == NULL)
+  {
+    stack = new uint8_t[*stack_size];
+    if (stack == NULL)
+      return NULL;
+    stats->heap_allocs++;
+  }
+
+  stats->allocs++;
+  stats->in_use++;
+  if (stats->in_use > stats->peak_in_use)
+    stats->peak_in_use = stats->in_use;
+  return stack;
+}
+
+/*!
+ * @brief Gives the stack of a thread that's gone back
+ * @note Kernel has to be stopped, or we have to be in the scheduler. Never touches the heap, so it's fine to call while switching threads.
+ * @note Pool stacks go straight back in the pool, stacks from the heap wait for os_stack_pool_reap().
+ * @param uint8_t *stack
+ * @param int stack_size size os_stack_pool_alloc() handed it out with
+ */
+void os_stack_pool_release(uint8_t *stack, int stack_size)
+{
+  int size_class = os_stack_pool_class(stack_size);
+  pool_stats[size_class].in_use--;
+
+  if (size_class < OS_STACK_POOL_CLASS_COUNT && OS_STACK_POOL_CLASSES[size_class] == stack_size)
+  {
+    os_stack_pool_push(&pool_free[size_class], stack, stack_size);
+    pool_stats[size_class].free++;
+  }
+  else
+  {
+    os_stack_pool_push(&pool_reap_list, stack, stack_size);
+    pool_reap_count++;
+  }
+}
+
+/*!
+ * @brief Frees stacks that were too big for the pool back to the heap, once their threads are gone
+ * @note Run from the idle thread, so nobody has to wait on the heap for it.
+ */
+void os_stack_pool_reap(void)
+{
+  // Checked without stopping the kernel, since there's usually nothing to do.
+  if (pool_reap_list == NULL)
+    return;
+
+  os_sched_lock();
+  while (pool_reap_list != NULL)
+  {
+    delete[] os_stack_pool_pop(&pool_reap_list);
+    pool_reap_count--;
+  }
+  os_sched_unlock();
+}
+
+/*!
+ * @brief Fills the pool up ahead of time, so threads started later don't have to go to the heap, and the heap doesn't get fragmented.
+ * @param int stack_size which size class we fill
+ * @param int count how many stacks we add to that class
+ * @returns false if the size is too big for the pool or we ran out of memory
+ */
+bool os_stack_pool_reserve(int stack_size, int count)
+{
+  int size_class = os_stack_pool_class(stack_size);
+  if (size_class == OS_STACK_POOL_CLASS_COUNT)
+    return false;
+  stack_size = OS_STACK_POOL_CLASSES[size_class];
+
+  os_sched_lock();
+  os_stack_pool_init_stats();
+  bool ok = true;
+  for (int n = 0; n < count; n++)
+  {
+    uint8_t *stack = new uint8_t[stack_size];
+    if (stack == NULL)
+    {
+      ok = false;
+      break;
+    }
+    os_stack_pool_push(&pool_free[size_class], stack, stack_size);
+    pool_stats[size_class].free++;
+    pool_stats[size_class].heap_allocs++;
+  }
+  os_sched_unlock();
+  return ok;
+}
+
+/*!
+ * @brief Frees every stack sitting unused in the pool back to the heap
+ */
+void os_stack_pool_trim(void)
+{
+  os_sched_lock();
+  for (int n = 0; n < OS_STACK_POOL_CLASS_COUNT; n++)
+  {
+    while (pool_free[n] != NULL)
+      delete[] os_stack_pool_pop(&pool_free[n]);
+    pool_stats[n].free = 0;
+  }
+  os_sched_unlock();
+}
+
+/*!
+ * @brief Takes a snapshot of the stack pool's statistics
+ * @param os_stack_pool_stats_t *stats filled in with one entry per size class, followed by one for stacks too big for the pool
+ * @param int max_classes how many entries fit in stats
+ * @returns How many entries we filled in
+ */
+int os_get_stack_pool_stats(os_stack_pool_stats_t *stats, int max_classes)
+{
+  int count = OS_STACK_POOL_CLASS_COUNT + 1;
+  if (count > max_classes)
+    count = max_classes;
+
+  os_sched_lock();
+  os_stack_pool_init_stats();
+  for (int n = 0; n < count; n++)
+    stats[n] = pool_stats[n];
+  os_sched_unlock();
+  return count;
+}
+
+/*!
+ * @brief Prints the stack pool's statistics, one size class per line
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_stack_pool_stats(Print *out)
+{
+  os_stack_pool_stats_t stats[OS_STACK_POOL_CLASS_COUNT + 1];
+  int count = os_get_stack_pool_stats(stats, OS_STACK_POOL_CLASS_COUNT + 1);
+
+  out->printf("%8s %8s %8s %8s %10s %10s\n", "size", "in_use", "peak", "free", "allocs", "heap");
+  for (int n = 0; n < count; n++)
+  {
+    if (stats[n].stack_size)
+      out->printf("%8d", stats[n].stack_size);
+    else
+      out->printf("%8s", "bigger");
+    out->printf(" %8lu %8lu %8lu %10lu %10lu\n", (unsigned long)stats[n].in_use, (unsigned long)stats[n].peak_in_use,
+                (unsigned long)stats[n].free, (unsigned long)stats[n].allocs, (unsigned long)stats[n].heap_allocs);
+  }
+  out->printf("%lu stacks waiting to be freed\n", (unsigned long)pool_reap_count);
+}
@@ -0,0 +1,97 @@
+#ifndef _OSSTACKPOOLKERNEL_H
+#define _OSSTACKPOOLKERNEL_H
+
+// So we can configure modules
+#include "enabled_modules.h"
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Stack sizes the pool hands out, smallest first. Stacks are rounded up to the next size, anything bigger comes straight off the heap.
+ * @note Can be defined as a preprocessor command, as a comma separated list(ex -DEXTERN_OS_STACK_POOL_CLASSES=256,1024,8192)
+ */
+#ifndef EXTERN_OS_STACK_POOL_CLASSES
+static const int OS_STACK_POOL_CLASSES[] = {512, 1024, 2048, 4096};
+#else
+static const int OS_STACK_POOL_CLASSES[] = {EXTERN_OS_STACK_POOL_CLASSES};
+#endif
+
+static const int OS_STACK_POOL_CLASS_COUNT = sizeof(OS_STACK_POOL_CLASSES) / sizeof(OS_STACK_POOL_CLASSES[0]);
+
+/*!
+ * @brief Statistics of one size class of the stack pool
+ */
+typedef struct
+{
+  // Size of the stacks in this class, 0 for stacks too big for any class, which come straight off the heap and go back to it.
+  int stack_size;
+
+  // Stacks threads are using right now, and the most that ever were at once.
+  uint32_t in_use;
+  uint32_t peak_in_use;
+
+  // Stacks sitting in the pool ready to hand out.
+  uint32_t free;
+
+  // Stacks handed out since startup, and how many of those we had to go to the heap for.
+  uint32_t allocs;
+  uint32_t heap_allocs;
+} os_stack_pool_stats_t;
+
+/*!
+ * @brief Gets a stack for a new thread, out of the pool if there's one free
+ * @note Kernel has to be stopped.
+ * @param int *stack_size size we want, rounded up to the size of the stack we hand out
+ * @returns The stack, or NULL if we are out of memory
+ */
+uint8_t *os_stack_pool_alloc(int *stack_size);
+
+/*!
+ * @brief Gives the stack of a thread that's gone back
+ * @note Kernel has to be stopped, or we have to be in the scheduler. Never touches the heap, so it's fine to call while switching threads.
+ * @note Pool stacks go straight back in the pool, stacks from the heap wait for os_stack_pool_reap().
+ * @param uint8_t *stack
+ * @param int stack_size size os_stack_pool_alloc() handed it out with
+ */
+void os_stack_pool_release(uint8_t *stack, int stack_size);
+
+/*!
+ * @brief Frees stacks that were too big for the pool back to the heap, once their threads are gone
+ * @note Run from the idle thread, so nobody has to wait on the heap for it.
+ */
+void os_stack_pool_reap(void);
+
+/*!
+ * @brief Fills the pool up ahead of time, so threads started later don't have to go to the heap, and the heap doesn't get fragmented.
+ * @param int stack_size which size class we fill
+ * @param int count how many stacks we add to that class
+ * @returns false if the size is too big for the pool or we ran out of memory
+ */
+bool os_stack_pool_reserve(int stack_size, int count);
+
+/*!
+ * @brief Frees every stack sitting unused in the pool back to the heap
+ */
+void os_stack_pool_trim(void);
+
+/*!
+ * @brief Takes a snapshot of the stack pool's statistics
+ * @param os_stack_pool_stats_t *stats filled in with one entry per size class, followed by one for stacks too big for the pool
+ * @param int max_classes how many entries fit in stats
+ * @returns How many entries we filled in
+ */
+int os_get_stack_pool_stats(os_stack_pool_stats_t *stats, int max_classes);
+
+/*!
+ * @brief Prints the stack pool's statistics, one size class per line
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_stack_pool_stats(Print *out);
+
+#endif
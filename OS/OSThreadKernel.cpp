@@ -6,6 +6,8 @@
  */
 
 #include "OSThreadKernel.h"
+#include "OSTraceKernel.h"
+#include "OSStackPoolKernel.h"
 
 /*!
  * @brief Thread that calculates remainder stuff.
@@ -13,12 +15,34 @@
  */
 void idle_thread_handler(void *params);
 
+/*!
+ * @brief Checks the next few words of the thread stack we are scanning for it's high water mark
+ */
+static void os_stack_scan_step(void);
+
 /*!
  * @brief Remaind thread stack space and statically allocated array
  */
 static const int idle_thread_handler_stack_space = 256;
 uint8_t idle_thread_handler_stack[idle_thread_handler_stack_space];
 
+/*!
+ * @brief Floating point save area of the main thread, since it doesn't have a thread stack we can put it in.
+ */
+static software_fpu_stack_t thread_zero_fpu_save;
+
+/*!
+ * @brief Ready EDF threads, earliest deadline on top
+ */
+static DeadlineHeap edf_ready;
+static DeadlineHeapNode *edf_ready_storage_zero[OS_THREAD_SLAB_LEN];
+
+/*!
+ * @brief Pointer to the idle thread, so the scheduler knows when there's nothing else to do.
+ */
+static thread_t *idle_thread = NULL;
+
+
 /*!
  *   @brief Current thread that we have context of.
  *   @note This was contained in TeensyThreads' Thread class as current_thread
@@ -47,23 +71,309 @@ int OS_DEFAULT_TICKS = 10;
 int OS_DEFAULT_TICKS = EXTERN_OS_DEFAULT_TICKS;
 #endif
 
+/*!
+ * @brief How many kernel operations interrupts can queue up while a thread has the kernel stopped
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_ISR_REQUEST_QUEUE_LEN
+static const uint32_t OS_ISR_REQUEST_QUEUE_LEN = 32;
+#else
+static const uint32_t OS_ISR_REQUEST_QUEUE_LEN = EXTERN_OS_ISR_REQUEST_QUEUE_LEN;
+#endif
+
+/*!
+ * @brief Kernel operation an interrupt queued up because a thread had the kernel stopped
+ */
+typedef struct
+{
+  os_isr_request_func_t func;
+  void *object;
+  void *data;
+  uint32_t arg;
+} os_isr_request_t;
+
+/*!
+ * @brief Ring buffer of queued interrupt requests, only ever touched inside os_irq_lock()
+ */
+static os_isr_request_t isr_requests[OS_ISR_REQUEST_QUEUE_LEN];
+static uint32_t isr_request_head = 0;
+static uint32_t isr_request_tail = 0;
+
+/*!
+ * @brief Runs every interrupt request that was queued while the kernel was stopped
+ * @note Called with kernel interrupts masked and the kernel stopped.
+ */
+static void os_isr_requests_run(void);
+
+/*!
+ * @returns Whether or not a ready thread has another thread at it's priority to take turns with
+ */
+static inline bool os_thread_has_peer(thread_t *thread);
+
+/*!
+ * @brief Forgets every os_sched_lock() the running thread still holds, for when it's killed and can never unlock them
+ */
+static inline void os_sched_lock_drop(void);
+
+#if defined(__IMXRT1062__)
+/*!
+ * @brief Starts the general purpose timer as the kernel clock
+ */
+static void os_clock_start(void);
+#endif
+
+/*!
+ * @brief Set when a thread with a higher priority than the running one became ready, until we switch to it.
+ * @note The switch can't happen while the kernel is stopped, so os_start() pends it again.
+ */
+static volatile bool preempt_pending = false;
+
+/*!
+ * @brief Set when the running thread yields, so it goes behind the other threads at it's priority.
+ */
+static volatile bool yield_pending = false;
+
 extern volatile uint32_t systick_millis_count;
 
+// Slots are found with a shift and a mask.
+static_assert((OS_THREAD_SLAB_LEN & (OS_THREAD_SLAB_LEN - 1)) == 0, "OS_THREAD_SLAB_LEN has to be a power of 2");
+
+/*!
+ * @brief Thread table, a directory of slabs of OS_THREAD_SLAB_LEN thread control blocks each
+ * @note Thread control blocks never move once they are allocated, only the directory does when it grows.
+ * @note The first slab is static, so thread 0 and the idle thread are there before we can allocate anything.
+ */
+static thread_t thread_slab_zero[OS_THREAD_SLAB_LEN];
+static thread_t *thread_slab_directory_zero[1] = {thread_slab_zero};
+static thread_t **thread_slabs = thread_slab_directory_zero;
+static int thread_slab_count = 1;
+static int thread_slot_count = OS_THREAD_SLAB_LEN;
+
+/*!
+ * @brief Free slots, so creating a thread doesn't have to go looking for one
+ */
+static thread_t *thread_free_list = NULL;
+
+/*!
+ * @returns The thread in a slot of the thread table
+ */
+static inline thread_t *os_thread_slot(int index)
+{
+  return &thread_slabs[(unsigned)index / OS_THREAD_SLAB_LEN][(unsigned)index & (OS_THREAD_SLAB_LEN - 1)];
+}
+
+/*!
+ * @returns A thread's id, made up of it's slot and the slot's generation
+ */
+static inline os_thread_id_t os_thread_handle(thread_t *thread)
+{
+  return ((os_thread_id_t)thread->generation << OS_THREAD_INDEX_BITS) | thread->slot_index;
+}
+
+/*!
+ * @brief Finds the thread an id belongs to
+ * @returns The thread, or NULL if it's gone or the id was never handed out
+ */
+static inline thread_t *os_thread_lookup(os_thread_id_t thread_id)
+{
+  if (thread_id < 0)
+    return NULL;
+
+  int index = thread_id & (OS_THREAD_MAX_SLOTS - 1);
+  if (index >= thread_slot_count)
+    return NULL;
+
+  // Thread 0 is the main thread, which is always left marked empty.
+  thread_t *thread = os_thread_slot(index);
+  if (thread->generation != (uint16_t)(thread_id >> OS_THREAD_INDEX_BITS) || (thread->flags == THREAD_EMPTY && index != 0))
+    return NULL;
+  return thread;
+}
+
+/*!
+ * @brief Puts a slot on the free list
+ */
+static inline void os_thread_free_push(thread_t *thread)
+{
+  thread->free_listed = true;
+  thread->free_next = thread_free_list;
+  thread_free_list = thread;
+}
+
+/*!
+ * @brief Gives a thread's slot back once it's ended and switched out for good
+ * @note Periodic schedule is freed when the slot gets reused, since this can run in the scheduler and that needs the heap.
+ * @note Safe to call more than once, a thread that was killed might still get parked by the scheduler later.
+ */
+static inline void os_thread_free(thread_t *thread)
+{
+  if (thread->free_listed || thread->slot_index == 0)
+    return;
+
+  // Nobody is left to unlock the mutexes it held while others waited, so they stop lending it their priority,
+  // and whichever thread gets the slot next doesn't inherit it.
+  while (thread->owned_queues != NULL)
+    os_wait_queue_set_owner(thread->owned_queues, NULL);
+
+  // Any id handed out for this thread stops working.
+  thread->generation++;
+  os_thread_free_push(thread);
+  thread_count--;
+
+  // Stack goes back right away, rather than once someone reuses the slot.
+  if (thread->my_stack && thread->stack != NULL)
+    os_stack_pool_release(thread->stack, thread->stack_alloc_size);
+  thread->stack = NULL;
+  thread->my_stack = 0;
+}
+
+/*!
+ * @brief Adds another slab of thread control blocks onto the thread table
+ * @note Kernel has to be stopped.
+ * @returns false if we are out of memory, or at OS_THREAD_MAX_SLOTS
+ */
+static bool os_thread_table_grow(void)
+{
+  int slab_count = thread_slab_count + 1;
+  int slot_count = slab_count * OS_THREAD_SLAB_LEN;
+  if (slot_count > OS_THREAD_MAX_SLOTS)
+    return false;
+
+  thread_t *slab = new thread_t[OS_THREAD_SLAB_LEN];
+  thread_t **directory = new thread_t *[slab_count];
+  DeadlineHeapNode **edf_storage = new DeadlineHeapNode *[slot_count];
+  if (slab == NULL || directory == NULL || edf_storage == NULL)
+  {
+    delete[] slab;
+    delete[] directory;
+    delete[] edf_storage;
+    return false;
+  }
+
+  for (int n = 0; n < thread_slab_count; n++)
+    directory[n] = thread_slabs[n];
+  directory[thread_slab_count] = slab;
+
+  // Every EDF thread could be ready at once, so the EDF ready heap grows with the table.
+  // Interrupts can look threads up, so the directory has to be swapped in one go.
+  uint32_t irq_state = os_irq_lock();
+  thread_t **old_directory = thread_slabs;
+  DeadlineHeapNode **old_edf_storage = edf_ready.move_storage(edf_storage, slot_count);
+  thread_slabs = directory;
+  thread_slab_count = slab_count;
+  thread_slot_count = slot_count;
+  os_irq_unlock(irq_state);
+
+  if (old_directory != thread_slab_directory_zero)
+    delete[] old_directory;
+  if (old_edf_storage != edf_ready_storage_zero)
+    delete[] old_edf_storage;
+
+  // Pushed last slot first, so lower slots get handed out first.
+  for (int n = OS_THREAD_SLAB_LEN - 1; n >= 0; n--)
+  {
+    slab[n].slot_index = slot_count - OS_THREAD_SLAB_LEN + n;
+    os_thread_free_push(&slab[n]);
+  }
+  return true;
+}
+
+/*!
+ * @brief Sets up the static first slab of the thread table, slot 0 goes to thread 0 and the rest are free
+ */
+static void os_thread_table_init(void)
+{
+  thread_free_list = NULL;
+  for (int n = OS_THREAD_SLAB_LEN - 1; n >= 0; n--)
+  {
+    thread_slab_zero[n].flags = THREAD_EMPTY;
+    thread_slab_zero[n].slot_index = n;
+    if (n != 0)
+      os_thread_free_push(&thread_slab_zero[n]);
+  }
+}
+
+/*!
+ * @brief Takes a slot off the free list, growing the thread table if there aren't any
+ * @note Kernel has to be stopped.
+ * @returns The slot, or NULL if we are out of memory
+ */
+static inline thread_t *os_thread_alloc(void)
+{
+  if (thread_free_list == NULL && !os_thread_table_grow())
+    return NULL;
+
+  thread_t *thread = thread_free_list;
+  thread_free_list = thread->free_next;
+  thread->free_next = NULL;
+  thread->free_listed = false;
+  return thread;
+}
+
+/*!
+ * @returns How many thread control blocks the thread table has allocated, used or not
+ */
+int os_thread_slots(void)
+{
+  return thread_slot_count;
+}
+
+/*!
+ * @brief Per priority ready lists, each one a circular list of threads ready to run at that priority
+ * @note Head of each list is the next thread to run at that priority.
+ */
+static thread_t *ready_list[OS_NUM_PRIORITIES];
+
+/*!
+ * @brief Bitmap of which priorities have a ready thread, one bit per priority.
+ * @note Bit (n % 32) of ready_bitmap[n / 32] is set when ready_list[n] isn't empty
+ */
+static uint32_t ready_bitmap[OS_NUM_PRIORITIES / 32];
+
+/*!
+ * @brief Summary bitmap, bit n is set when ready_bitmap[n] has any bits set.
+ * @note Lets us find the highest ready priority with two count leading zero instructions.
+ */
+static uint32_t ready_group_bitmap;
+
+/*!
+ * @brief CPU cycle count when the running thread was switched in
+ */
+static uint32_t switched_in_cycles = 0;
+
+/*!
+ * @brief CPU cycles every thread except the idle thread has run for
+ */
+static uint64_t busy_cycles = 0;
+
 /*!
- * @brief Pointer array to all the available system threads
- * The maximum number of threads is hard-coded. Alternatively, we could implement
- * a linked list which would mean using up less memory for a small number of
- * threads while allowing an unlimited number of possible threads. This would
- * probably not slow down thread switching too much, but it would introduce
- * complexity and possibly bugs. So to simplifiy for now, we use an array.
- * But in the future, a linked list might be more appropriate.
+ * @brief One bucket of the CPU load window
  */
-static thread_t system_threads[MAX_THREADS];
+typedef struct
+{
+  // Cycles we were busy for during the bucket
+  uint64_t busy_cycles;
+  // How long the bucket actually was
+  uint64_t elapsed_us;
+} os_cpu_load_bucket_t;
+
+/*!
+ * @brief Sliding window of CPU load, the oldest bucket gets overwritten whenever one fills up.
+ */
+static os_cpu_load_bucket_t cpu_load_buckets[OS_CPU_LOAD_BUCKETS];
+static int cpu_load_bucket_index = 0;
 
 /*!
- * @brief Thread priority object that allows us to have an organized thread priority
+ * @brief When the bucket we are filling started, and what busy_cycles was then.
  */
-static PriorityQueuePointerNaive thread_priorities;
+static uint64_t cpu_load_bucket_start_us = 0;
+static uint64_t cpu_load_bucket_start_busy = 0;
+
+/*!
+ * @brief Wake timers of every thread that is sleeping or blocked with a timeout
+ * @note Time is kept in microseconds from os_micros64()
+ */
+static TimingWheel wake_timers;
 
 // These variables are used by the assembly context_switch() function.
 // They are copies or pointers to data in Threads and thread_t
@@ -72,10 +382,11 @@ extern "C"
 {
 
   /*!
-   *   @brief Current count of system tick
-   *   @note in TeensyThreads this was currentCount
+   *   @brief Whether systick counts down the running thread's time slice
+   *   @note With tickless mode it's only set while the running thread has another thread at it's priority to take turns with.
+   *   @note in TeensyThreads this was currentUseSystick
    */
-  static int current_use_systick;
+  int current_use_systick;
 
   /*!
    *   @brief The current thread in the program.
@@ -112,6 +423,11 @@ extern "C"
    *   @note in TeensyThreads this was currentSP
    */
   void *current_sp;
+
+  /*!
+   * @brief OS_KERNEL_IRQ_PRIORITY, where the assembly can get at it
+   */
+  uint32_t os_kernel_irq_basepri = OS_KERNEL_IRQ_PRIORITY;
 }
 
 /*!
@@ -144,7 +460,9 @@ static void __attribute((naked, noinline)) gpt1_isr()
 {
   GPT1_SR |= GPT_SR_OF1; // clear set bit
   __asm volatile("dsb"); // see github bug #20 by manitou48
-  __asm volatile("b context_switch");
+  preempt_pending = true; // Held until os_start() if the kernel is stopped right now
+  // Timer only fires on a wake deadline, the running thread keeps the rest of it's slice if it's still the most important.
+  __asm volatile("b context_switch_direct");
 }
 
 /*!
@@ -155,13 +473,20 @@ static void __attribute((naked, noinline)) gpt2_isr()
 {
   GPT2_SR |= GPT_SR_OF1; // clear set bit
   __asm volatile("dsb"); // see github bug #20 by manitou48
-  __asm volatile("b context_switch");
+  preempt_pending = true; // Held until os_start() if the kernel is stopped right now
+  // Timer only fires on a wake deadline, the running thread keeps the rest of it's slice if it's still the most important.
+  __asm volatile("b context_switch_direct");
 }
 
+/*!
+ * @brief Which of the general purpose timers we ended up using, 0 if none.
+ */
+static int gpt_number = 0;
+
 /*!
  *   @brief Intializes the unused General Purpose Timers in the Teensy 4.
- *   @note if we can't set this up, then currently Teensy 4 will not initialize Will-OS
- *   @param microseconds between each context switch
+ *   @note The timer free runs at 1MHz as the kernel clock, and the compare fires whenever a thread needs to wake up.
+ *   @param microseconds until the timer fires the first time
  */
 bool t4_gpt_init(unsigned int microseconds)
 {
@@ -169,7 +494,6 @@ bool t4_gpt_init(unsigned int microseconds)
   // See https://github.com/manitou48/teensy4/blob/master/gpt_isr.ino
   // See https://forum.pjrc.com/threads/54265-Teensy-4-testing-mbed-NXP-MXRT1050-EVKB-(600-Mhz-M7)?p=193217&viewfull=1#post193217
   // keep track of which GPT timer we are using
-  static int gpt_number = 0;
   // not configured yet, so find an inactive GPT timer
   if (gpt_number == 0)
   {
@@ -196,22 +520,22 @@ bool t4_gpt_init(unsigned int microseconds)
   switch (gpt_number)
   {
   case 1:
-    CCM_CCGR1 |= CCM_CCGR1_GPT1_BUS(CCM_CCGR_ON); // enable GPT1 module
-    GPT1_CR = 0;                                  // disable timer
-    GPT1_PR = 23;                                 // prescale: divide by 24 so 1 tick = 1 microsecond at 24MHz
-    GPT1_OCR1 = microseconds - 1;                 // compare value
-    GPT1_SR = 0x3F;                               // clear all prior status
-    GPT1_IR = GPT_IR_OF1IE;                       // use first timer
-    GPT1_CR = GPT_CR_EN | GPT_CR_CLKSRC(1);       // set to peripheral clock (24MHz)
+    CCM_CCGR1 |= CCM_CCGR1_GPT1_BUS(CCM_CCGR_ON);                    // enable GPT1 module
+    GPT1_CR = 0;                                                     // disable timer
+    GPT1_PR = 23;                                                    // prescale: divide by 24 so 1 tick = 1 microsecond at 24MHz
+    GPT1_OCR1 = microseconds;                                        // compare value, counting up from zero
+    GPT1_SR = 0x3F;                                                  // clear all prior status
+    GPT1_IR = GPT_IR_OF1IE;                                          // use first timer
+    GPT1_CR = GPT_CR_EN | GPT_CR_ENMOD | GPT_CR_FRR | GPT_CR_CLKSRC(1); // free run from zero off the peripheral clock (24MHz)
     break;
   case 2:
-    CCM_CCGR1 |= CCM_CCGR1_GPT1_BUS(CCM_CCGR_ON); // enable GPT1 module
-    GPT2_CR = 0;                                  // disable timer
-    GPT2_PR = 23;                                 // prescale: divide by 24 so 1 tick = 1 microsecond at 24MHz
-    GPT2_OCR1 = microseconds - 1;                 // compare value
-    GPT2_SR = 0x3F;                               // clear all prior status
-    GPT2_IR = GPT_IR_OF1IE;                       // use first timer
-    GPT2_CR = GPT_CR_EN | GPT_CR_CLKSRC(1);       // set to peripheral clock (24MHz)
+    CCM_CCGR0 |= CCM_CCGR0_GPT2_BUS(CCM_CCGR_ON);                    // enable GPT2 module
+    GPT2_CR = 0;                                                     // disable timer
+    GPT2_PR = 23;                                                    // prescale: divide by 24 so 1 tick = 1 microsecond at 24MHz
+    GPT2_OCR1 = microseconds;                                        // compare value, counting up from zero
+    GPT2_SR = 0x3F;                                                  // clear all prior status
+    GPT2_IR = GPT_IR_OF1IE;                                          // use first timer
+    GPT2_CR = GPT_CR_EN | GPT_CR_ENMOD | GPT_CR_FRR | GPT_CR_CLKSRC(1); // free run from zero off the peripheral clock (24MHz)
     break;
 
   // We weren't able to setup the GP1 module properly :(
@@ -221,6 +545,42 @@ bool t4_gpt_init(unsigned int microseconds)
   return true;
 }
 
+/*!
+ *   @returns Current count of the general purpose timer, in microseconds
+ */
+static inline uint32_t t4_gpt_count(void)
+{
+  switch (gpt_number)
+  {
+  case 1:
+    return GPT1_CNT;
+  case 2:
+    return GPT2_CNT;
+  default:
+    return 0;
+  }
+}
+
+/*!
+ *   @brief Reprograms when the general purpose timer fires next
+ *   @note Timer free runs, so the compare is set relative to the count and the clock never gets restarted.
+ *   @param microseconds from now until the timer fires
+ */
+static inline void t4_gpt_reprogram(uint32_t microseconds)
+{
+  switch (gpt_number)
+  {
+  case 1:
+    GPT1_OCR1 = GPT1_CNT + microseconds;
+    break;
+  case 2:
+    GPT2_OCR1 = GPT2_CNT + microseconds;
+    break;
+  default:
+    break;
+  }
+}
+
 #endif
 
 /*!
@@ -252,6 +612,163 @@ extern "C" void stack_overflow_default_isr()
  */
 extern "C" void stack_overflow_isr(void) __attribute__((weak, alias("stack_overflow_default_isr")));
 
+/*!
+ * @brief Last thread that overflowed it's stack, and how many have since startup
+ */
+static os_stack_fault_t stack_fault;
+static volatile uint32_t stack_fault_count = 0;
+
+/*!
+ * @brief Writes down which thread overflowed it's stack and where, so it can be looked at after the thread is gone
+ */
+static inline void os_stack_fault_record(thread_t *thread, bool guard, uint32_t fault_address, uint32_t pc, uint32_t sp)
+{
+  stack_fault.thread_id = os_thread_handle(thread);
+  stack_fault.guard = guard;
+  stack_fault.fault_address = fault_address;
+  stack_fault.pc = pc;
+  stack_fault.sp = sp;
+  stack_fault.stack = thread->stack;
+  stack_fault.stack_size = thread->stack_size;
+  stack_fault_count = stack_fault_count + 1;
+}
+
+#ifdef OS_STACK_GUARD
+static_assert((OS_STACK_GUARD_SIZE & (OS_STACK_GUARD_SIZE - 1)) == 0 && OS_STACK_GUARD_SIZE >= 32, "OS_STACK_GUARD_SIZE has to be a power of 2, and at least 32");
+
+/*!
+ * @brief Guard region attributes: no access at all, never executable
+ */
+static const uint32_t OS_STACK_GUARD_RASR = SCB_MPU_RASR_TEX(0) | SCB_MPU_RASR_AP(0) | SCB_MPU_RASR_XN | SCB_MPU_RASR_SIZE(__builtin_ctz(OS_STACK_GUARD_SIZE) - 1) | SCB_MPU_RASR_ENABLE;
+
+/*!
+ * @brief MemManage fault handler that was there before us, we pass on every fault that isn't a thread hitting it's guard
+ */
+os_isr_function_t save_memmanage_isr;
+
+/*!
+ * @brief Works out where a stack's guard goes, the first guard sized block of the stack
+ * @returns MPU region base register of the guard, 0 if the stack is too small to give up a guard
+ */
+static inline uint32_t os_stack_guard_rbar(uint8_t *stack, int stack_size)
+{
+  uintptr_t guard = ((uintptr_t)stack + OS_STACK_GUARD_SIZE - 1) & ~(uintptr_t)(OS_STACK_GUARD_SIZE - 1);
+  if (guard + 4 * OS_STACK_GUARD_SIZE > (uintptr_t)stack + stack_size)
+    return 0;
+  return guard | SCB_MPU_RBAR_VALID | SCB_MPU_RBAR_REGION(OS_STACK_GUARD_REGION);
+}
+
+/*!
+ * @returns First byte above a thread's stack guard
+ */
+static inline uint8_t *os_stack_guard_end(thread_t *thread)
+{
+  return (uint8_t *)(uintptr_t)(thread->guard_rbar & ~(OS_STACK_GUARD_SIZE - 1)) + OS_STACK_GUARD_SIZE;
+}
+
+/*!
+ * @brief Moves the guard region to the bottom of the stack of the thread we are switching to
+ */
+static inline void os_stack_guard_load(thread_t *thread)
+{
+  if (thread->guard_rbar)
+  {
+    SCB_MPU_RBAR = thread->guard_rbar;
+    SCB_MPU_RASR = OS_STACK_GUARD_RASR;
+  }
+  else
+  {
+    SCB_MPU_RBAR = SCB_MPU_RBAR_VALID | SCB_MPU_RBAR_REGION(OS_STACK_GUARD_REGION);
+    SCB_MPU_RASR = 0;
+  }
+  __asm volatile("dsb\n isb" ::: "memory");
+}
+
+/*!
+ * @brief MemManage fault handler, ends the thread if it ran into it's stack guard
+ * @note The thread never gets to run again, since going back to it would just fault on the same instruction.
+ */
+extern "C" void os_stack_guard_fault_isr(void)
+{
+  // Fault status bits: data access violation, stacking error and whether the fault address is valid.
+  const uint32_t MMFSR_DACCVIOL = 1 << 1;
+  const uint32_t MMFSR_MSTKERR = 1 << 4;
+  const uint32_t MMFSR_MMARVALID = 1 << 7;
+
+  uint32_t mmfsr = SCB_CFSR & 0xFF;
+  uint32_t fault_address = (mmfsr & MMFSR_MMARVALID) ? SCB_MMFAR : 0;
+
+  // Bit 2 of the exception return says we came from a thread on it's process stack, rather than thread 0 or an interrupt.
+  uint32_t exc_return = (uint32_t)__builtin_return_address(0);
+  thread_t *thread = current_thread;
+
+  uintptr_t guard = thread->guard_rbar & ~(OS_STACK_GUARD_SIZE - 1);
+  bool hit_guard = (exc_return & 4) && thread->guard_rbar &&
+                   ((mmfsr & MMFSR_MSTKERR) || ((mmfsr & MMFSR_DACCVIOL) && fault_address - guard < OS_STACK_GUARD_SIZE));
+  if (!hit_guard)
+  {
+    save_memmanage_isr();
+    return;
+  }
+
+  uint32_t psp;
+  __asm volatile("mrs %0, psp" : "=r"(psp));
+  // If the interrupt frame made it onto the stack, it has the instruction that overflowed.
+  uint32_t pc = (mmfsr & MMFSR_MSTKERR) ? 0 : ((uint32_t *)(uintptr_t)psp)[6];
+  os_stack_fault_record(thread, true, fault_address, pc, psp);
+  SCB_CFSR = mmfsr;
+
+#ifdef __ARM_PCS_VFP
+  // Drop any floating point registers the hardware still meant to stack into the guard, the thread is gone anyway.
+  (*(volatile uint32_t *)0xE000EF34) &= ~(uint32_t)1;
+#endif
+
+  stack_overflow_isr();
+  thread->flags = THREAD_ENDED;
+
+  // Switch away as soon as we return, even if the thread had the kernel stopped or the scheduler locked.
+  os_sched_lock_drop();
+  current_active_state = OS_STARTED;
+  os_pend_context_switch();
+}
+#endif
+
+/*!
+ * @brief Gets what we know about the last stack overflow
+ * @param os_stack_fault_t *fault filled in with the last overflow
+ * @returns How many threads have overflowed their stack since startup, 0 means fault wasn't filled in
+ */
+uint32_t os_get_stack_fault(os_stack_fault_t *fault)
+{
+  uint32_t irq_state = os_irq_lock();
+  uint32_t count = stack_fault_count;
+  if (count)
+    *fault = stack_fault;
+  os_irq_unlock(irq_state);
+  return count;
+}
+
+/*!
+ * @brief Prints which thread last overflowed it's stack and where
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_stack_fault(Print *out)
+{
+  os_stack_fault_t fault;
+  uint32_t count = os_get_stack_fault(&fault);
+  if (count == 0)
+  {
+    out->printf("no stack overflows\n");
+    return;
+  }
+
+  out->printf("thread %d overflowed it's %d byte stack at 0x%08lx-0x%08lx, caught by the %s\n", (int)fault.thread_id, fault.stack_size,
+              (unsigned long)(uintptr_t)fault.stack, (unsigned long)((uintptr_t)fault.stack + fault.stack_size),
+              fault.guard ? "MPU guard" : "switch time check");
+  out->printf("sp 0x%08lx, address 0x%08lx, pc 0x%08lx, %lu overflows since startup\n", (unsigned long)fault.sp,
+              (unsigned long)fault.fault_address, (unsigned long)fault.pc, (unsigned long)count);
+}
+
 /*!
  * @brief Declaration of system
  */
@@ -262,9 +779,11 @@ extern "C" void systick_isr();
  */
 extern "C" void context_switch_pit_isr();
 
+#if !defined(OS_PORT_POSIX)
 /*!
  * @brief ISR that helps deal with intcrementing our system ticks
  * @note Pushes registers onto stack, deals with saving system tick, then pops registers back on!
+ * @note Then counts down the running thread's time slice in context_switch(), which pends the switch once it runs out.
  */
 void __attribute((naked, noinline)) threads_systick_isr(void)
 {
@@ -282,7 +801,7 @@ void __attribute((naked, noinline)) threads_systick_isr(void)
 
 /*!
  * @brief ISR dealing with the Supervisor call on the threads.
- * @note Requires further investigation
+ * @note Only pends the context switch, which then happens in PendSV as soon as we return.
  */
 extern "C" void SVC_Handler(void)
 {
@@ -297,6 +816,31 @@ extern "C" void SVC_Handler(void)
   __asm volatile("b context_switch_direct");
   __asm volatile("bx lr");
 }
+#endif
+
+/*!
+ * @brief Asks for a context switch as soon as every interrupt has returned
+ * @note Safe to call from any interrupt, the switch runs in PendSV once the interrupts unwind.
+ */
+void os_pend_context_switch(void)
+{
+#if defined(OS_PORT_POSIX)
+  os_port_pend_switch();
+#else
+  SCB_ICSR = SCB_ICSR_PENDSVSET;
+#endif
+}
+
+/*!
+ * @brief Asks for a context switch because the timer fired on a wake deadline
+ * @note If a thread has the kernel stopped the switch gets dropped, so os_start() asks for it again,
+ * @note otherwise nothing would wake the thread up until the scheduler happened to run for some other reason.
+ */
+void os_wake_deadline_pend(void)
+{
+  preempt_pending = true;
+  os_pend_context_switch();
+}
 
 /*!
  *   @brief allows our program to "yield" out of current subroutine
@@ -304,11 +848,18 @@ extern "C" void SVC_Handler(void)
  */
 extern "C" void _os_yield(void)
 {
+  // So the scheduler knows we gave up our slice, rather than got preempted.
+  yield_pending = true;
 
+#if defined(OS_PORT_POSIX)
+  // No supervisor call on the host, the port pends the switch and it happens straight away.
+  os_port_pend_switch();
+#else
   // threads_svcall_isr();
   __asm volatile("svc %0"
                  :
                  : "i"(WILL_OS_SVC_NUM));
+#endif
 }
 
 /*!
@@ -319,31 +870,297 @@ extern "C" void _os_yield(void)
  */
 extern void os_thread_sleep_ms(int millisecond)
 {
-  int start_del = millis();
+  os_thread_sleep_us(millisecond > 0 ? (uint64_t)millisecond * 1000 : 0);
+}
+
+/*!
+ * @returns When a timeout starting now runs out, held at UINT64_MAX instead of wrapping around past it
+ * @param uint64_t timeout_us
+ */
+static inline uint64_t os_deadline_us(uint64_t timeout_us)
+{
+  uint64_t now = os_micros64();
+  return (timeout_us > UINT64_MAX - now) ? UINT64_MAX : now + timeout_us;
+}
+
+/*!
+ * @brief Sleeps the thread for a number of microseconds
+ * @note The kernel timer is programmed for the wake time, so we don't have to wait for the next millisecond tick.
+ * @param uint64_t microseconds
+ */
+void os_thread_sleep_us(uint64_t microseconds)
+{
+  os_sched_lock();
 
   // So the operating system knows when to start back up the next thread.
-  current_thread->interval = millisecond;
-  current_thread->previous_millis = millis();
+  wake_timers.insert(&current_thread->wake_timer, os_deadline_us(microseconds));
 
   // Signals that thread is sleeping, and must be awoken once ready.
   current_thread->flags = THREAD_SLEEPING;
 
+  os_sched_unlock();
   _os_yield();
 }
 
 /*!
- * @brief Sets up our zero thread.
+ * @brief Sleeps the thread until an absolute time
+ * @note Unlike os_thread_sleep_ms(), the time the thread spent running doesn't push the wake time back, so loops don't drift.
+ * @param uint64_t wake_ms when we want to wake up, in os_millis64() time. Returns right away if that already passed.
+ */
+void os_thread_sleep_until(uint64_t wake_ms)
+{
+  os_thread_sleep_until_us(wake_ms * 1000);
+}
+
+/*!
+ * @brief Sleeps the thread until an absolute time in microseconds
+ * @param uint64_t wake_us when we want to wake up, in os_micros64() time. Returns right away if that already passed.
+ */
+void os_thread_sleep_until_us(uint64_t wake_us)
+{
+  os_sched_lock();
+
+  if (wake_us <= os_micros64())
+  {
+    os_sched_unlock();
+    return;
+  }
+
+  wake_timers.insert(&current_thread->wake_timer, wake_us);
+  current_thread->flags = THREAD_SLEEPING;
+
+  os_sched_unlock();
+  _os_yield();
+}
+
+/*!
+ * @brief Moves a ready thread to the right spot in the ready set, after what it's ordered by changed
+ */
+static void os_sched_requeue(thread_t *thread);
+
+/*!
+ * @brief Records how a periodic job did against it's deadline
+ * @param os_periodic_t *periodic
+ * @param uint32_t response_us time from the job's release until it finished
+ */
+static inline void os_periodic_record(os_periodic_t *periodic, uint32_t response_us)
+{
+  os_periodic_stats_t *stats = &periodic->stats;
+  uint32_t deadline_us = periodic->deadline_ms * 1000;
+
+  stats->jobs++;
+  if (response_us > stats->worst_response_us)
+    stats->worst_response_us = response_us;
+
+  if (response_us <= deadline_us)
+  {
+    stats->lateness_histogram[0]++;
+    return;
+  }
+
+  stats->deadline_misses++;
+
+  // Bucket n holds jobs late by less than 2^(n-1) milliseconds.
+  uint32_t late_ms = (response_us - deadline_us) / 1000;
+  int bucket = 1;
+  while (bucket < OS_PERIODIC_LATENESS_BUCKETS - 1 && late_ms >= (1UL << (bucket - 1)))
+    bucket++;
+  stats->lateness_histogram[bucket]++;
+}
+
+/*!
+ * @brief Thread that runs a periodic job on it's release schedule
+ * @param void *arg unused, everything is in the thread's os_periodic_t
+ */
+static void os_periodic_thread_handler(void *arg)
+{
+  (void)arg;
+  os_periodic_t *periodic = current_thread->periodic;
+
+  while (1)
+  {
+    os_thread_sleep_until(periodic->release_ms);
+    periodic->job(periodic->job_arg);
+
+    uint32_t response_us = (uint32_t)(os_micros64() - periodic->release_ms * 1000);
+
+    os_sched_lock();
+    os_periodic_record(periodic, response_us);
+
+    // Next release is always one period after the last one, never after when we finished.
+    periodic->release_ms += periodic->period_ms;
+
+    // If we overran and the next job is already out, an EDF thread moves on to that job's deadline right away.
+    os_sched_requeue(current_thread);
+    os_sched_unlock();
+  }
+}
+
+/*!
+ * @brief Adds a periodic thread in either scheduling class
+ */
+static os_thread_id_t os_add_periodic_thread_class(thread_func_t job, void *arg, uint8_t thread_priority, thread_sched_class_t sched_class, uint32_t period_ms, uint32_t deadline_ms, int stack_size, void *stack);
+
+/*!
+ * @brief Adds a thread that runs a job on a fixed release schedule
+ * @note The job is released every period_ms from when the thread is added, no matter how long each job takes,
+ * @note if a job overruns the next one is released right away so the schedule stays the same.
+ * @note Every job is checked against it's deadline, see os_get_periodic_stats().
+ * @param thread_func_t job(called once every period)
+ * @param void *arg(pointer arguement to the job)
+ * @param uint8_t thread_priority (how important the thread is)
+ * @param uint32_t period_ms(time between releases)
+ * @param uint32_t deadline_ms(time after it's release each job has to be done by, 0 to use the period)
+ * @param int stack_size(size of the allocated threadstack)
+ * @param void *stack(pointer to begining of thread stack)
+ * @returns os_thread_id_t id of the thread, -1 if we couldn't add it
+ */
+os_thread_id_t os_add_periodic_thread(thread_func_t job, void *arg, uint8_t thread_priority, uint32_t period_ms, uint32_t deadline_ms, int stack_size, void *stack)
+{
+  return os_add_periodic_thread_class(job, arg, thread_priority, THREAD_CLASS_PRIORITY, period_ms, deadline_ms, stack_size, stack);
+}
+
+/*!
+ * @brief Adds a periodic thread that's scheduled earliest deadline first
+ * @note Every EDF thread runs at OS_EDF_PRIORITY against fixed priority threads, between each other
+ * @note whoever's current job has the earliest absolute deadline runs. No priorities to hand tune,
+ * @note and any set of EDF threads whose deadlines are their periods meets every deadline as long as they use under 100% of the CPU.
+ * @param thread_func_t job(called once every period)
+ * @param void *arg(pointer arguement to the job)
+ * @param uint32_t period_ms(time between releases)
+ * @param uint32_t deadline_ms(time after it's release each job has to be done by, 0 to use the period)
+ * @param int stack_size(size of the allocated threadstack)
+ * @param void *stack(pointer to begining of thread stack)
+ * @returns os_thread_id_t id of the thread, -1 if we couldn't add it
+ */
+os_thread_id_t os_add_edf_thread(thread_func_t job, void *arg, uint32_t period_ms, uint32_t deadline_ms, int stack_size, void *stack)
+{
+  return os_add_periodic_thread_class(job, arg, OS_EDF_PRIORITY, THREAD_CLASS_EDF, period_ms, deadline_ms, stack_size, stack);
+}
+
+/*!
+ * @brief Adds a periodic thread in either scheduling class
+ */
+static os_thread_id_t os_add_periodic_thread_class(thread_func_t job, void *arg, uint8_t thread_priority, thread_sched_class_t sched_class, uint32_t period_ms, uint32_t deadline_ms, int stack_size, void *stack)
+{
+  if (period_ms == 0)
+    return -1;
+
+  os_periodic_t *periodic = new os_periodic_t;
+  if (periodic == NULL)
+    return -1;
+
+  memset(periodic, 0, sizeof(os_periodic_t));
+  periodic->job = job;
+  periodic->job_arg = arg;
+  periodic->period_ms = period_ms;
+  periodic->deadline_ms = deadline_ms ? deadline_ms : period_ms;
+
+  // Kernel stays stopped until the thread has it's schedule, since it could preempt us as soon as it's added.
+  os_sched_lock();
+  os_thread_id_t thread_id = os_add_thread(&os_periodic_thread_handler, NULL, thread_priority, stack_size, stack);
+  if (thread_id == -1)
+  {
+    os_sched_unlock();
+    delete periodic;
+    return -1;
+  }
+
+  thread_t *thread = os_thread_lookup(thread_id);
+  periodic->release_ms = os_millis64();
+  thread->periodic = periodic;
+
+  // Thread went in as a fixed priority thread, so it moves over to it's class now that it has a deadline.
+  if (sched_class == THREAD_CLASS_EDF)
+  {
+    thread->sched_class = THREAD_CLASS_EDF;
+    os_sched_requeue(thread);
+  }
+  os_sched_unlock();
+
+  return thread_id;
+}
+
+/*!
+ * @brief Gets the timing records of a periodic thread
+ * @param os_thread_id_t target_thread_id
+ * @param os_periodic_stats_t *stats filled in with the records
+ * @returns false if the thread isn't periodic
+ */
+bool os_get_periodic_stats(os_thread_id_t target_thread_id, os_periodic_stats_t *stats)
+{
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  os_periodic_t *periodic = thread != NULL ? thread->periodic : NULL;
+  if (periodic != NULL)
+    *stats = periodic->stats;
+  os_sched_unlock();
+
+  return periodic != NULL;
+}
+
+/*!
+ * @brief Clears out the timing records of a periodic thread
+ * @param os_thread_id_t target_thread_id
+ * @returns false if the thread isn't periodic
+ */
+bool os_reset_periodic_stats(os_thread_id_t target_thread_id)
+{
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  os_periodic_t *periodic = thread != NULL ? thread->periodic : NULL;
+  if (periodic != NULL)
+    memset(&periodic->stats, 0, sizeof(os_periodic_stats_t));
+  os_sched_unlock();
+
+  return periodic != NULL;
+}
+
+/**
+ * @brief Idle thread handler.
+ * @note Whenever the OS doesn't have anything to do, we end up here.
+ * @note With tickless mode the core sleeps until the next interrupt, which is at latest the next wake deadline.
+ */
+void idle_thread_handler(void *params)
+{
+  (void)params;
+  while (1)
+  {
+    // Nobody else wants the CPU, so we keep the stack high water marks up to date,
+    // and free stacks that were too big for the stack pool.
+    os_stack_scan_step();
+    os_stack_pool_reap();
+#ifdef OS_TICKLESS_MODULE
+#if defined(OS_PORT_POSIX)
+    os_port_wait_for_interrupt();
+#else
+    __asm volatile("wfi");
+#endif
+    // Anything that becomes ready is more important than us and pends the switch itself, so waking up for systick
+    // doesn't need a trip through the scheduler. Only threads at our priority wait on us to give up the CPU.
+    if (os_thread_has_peer(idle_thread))
+      _os_yield();
+#else
+    _os_yield();
+#endif
+  }
+}
+
+/*!
+ * @brief Sets up our zero thread.
  * @note only to be called at setup
  * @note We do still setup the thread, but we leave it alone, as there seems to be an issue with this thread. Will look into further into the future
  */
 inline void os_setup_thread_zero(void)
 {
   // fill thread 0, which is always THREAD_running
-  // system_threads[0] = new thread_t();
-  system_threads[0].flags = THREAD_EMPTY;
-  // system_threads[0].ticks = OS_DEFAULT_TICKS;
-  // system_threads[0].stack = (uint8_t*)&_estack - DEFAULT_STACK0_SIZE;
-  system_threads[0].stack_size = DEFAULT_STACK0_SIZE;
+  thread_t *thread_zero = os_thread_slot(0);
+  thread_zero->flags = THREAD_EMPTY;
+  // thread_zero->ticks = OS_DEFAULT_TICKS;
+  // thread_zero->stack = (uint8_t*)&_estack - DEFAULT_STACK0_SIZE;
+  thread_zero->stack_size = DEFAULT_STACK0_SIZE;
+  // The main thread could be using the FPU already, so it always gets somewhere to save it.
+  thread_zero->save.fpu_save = &thread_zero_fpu_save;
   thread_count++;
 }
 
@@ -356,29 +1173,70 @@ inline void os_setup_thread_zero(void)
 void threads_init(void)
 {
   // initilize thread slots to THREAD_empty
-  for (int i = 0; i < MAX_THREADS; i++)
-    system_threads[i].flags = THREAD_EMPTY;
+  os_thread_table_init();
 
   os_setup_thread_zero();
 
+  // Nothing is sleeping yet, so the wheel starts at the current time.
+  wake_timers.init(os_micros64());
+
+  // Thread zero has been running since now as far as CPU accounting goes.
+  switched_in_cycles = os_cpu_cycles();
+  cpu_load_bucket_start_us = os_micros64();
+  edf_ready.init(edf_ready_storage_zero, OS_THREAD_SLAB_LEN);
+
   // initialize context_switch() globals from thread 0, which is MSP and always THREAD_running
-  current_thread = &system_threads[0]; // thread 0 is active
-  current_save = &system_threads[0].save;
+  current_thread = os_thread_slot(0); // thread 0 is active
+  current_save = &current_thread->save;
   current_msp = 1;
   current_sp = 0;
   current_tick_count = OS_DEFAULT_TICKS;
   current_active_state = OS_FIRST_RUN;
 
   // Code to get teensy working properly.
-#if defined(__IMXRT1062__)
+#if defined(__IMXRT1062__) || defined(OS_PORT_MPS2)
   save_svcall_isr = _VectorsRam[11];
   if (save_svcall_isr == unused_interrupt_vector)
     save_svcall_isr = 0;
   _VectorsRam[11] = SVC_Handler;
-  // current_use_systick = 0; // disable Systick calls
-  // t4_gpt_init(200);       // tick every millisecond
+
+  // Every context switch happens in PendSV at the lowest priority, so it only runs once all other interrupts unwind.
+  _VectorsRam[14] = context_switch_pendsv;
+  SCB_SHPR3 = (SCB_SHPR3 & 0xFF00FFFF) | (0xFF << 16);
+
+  // Systick keeps counting milliseconds for the core, and on top of that counts down the running thread's time slice.
+  // Wake deadlines only come off the timer, so without this threads of the same priority would never take turns.
+  save_systick_isr = _VectorsRam[15];
+  if (save_systick_isr == unused_interrupt_vector)
+    save_systick_isr = 0;
+  _VectorsRam[15] = threads_systick_isr;
+  // It calls into the kernel, so it has to be one of the interrupts os_irq_lock() masks.
+  SCB_SHPR3 = (SCB_SHPR3 & 0x00FFFFFF) | ((uint32_t)OS_KERNEL_IRQ_PRIORITY << 24);
+#endif
+
+#ifndef OS_TICKLESS_MODULE
+  current_use_systick = 1;
+#endif
+
+#if defined(__IMXRT1062__)
+  // The general purpose timer is the kernel clock, and only ever fires on the next wake deadline.
+  os_clock_start();
+
+#ifdef OS_STACK_GUARD
+  // Threads that run into their stack guard fault straight away, instead of escalating to a hard fault.
+  save_memmanage_isr = _VectorsRam[4];
+  _VectorsRam[4] = os_stack_guard_fault_isr;
+  SCB_SHCSR |= SCB_SHCSR_MEMFAULTENA;
 #endif
-  os_add_thread(&idle_thread_handler, NULL, 0, idle_thread_handler_stack_space, idle_thread_handler_stack);
+#elif defined(OS_PORT_POSIX)
+  // Signals stand in for the interrupts, and timers for systick and the general purpose timer.
+  os_port_init();
+#elif defined(OS_PORT_MPS2)
+  // CMSDK timer stands in for the general purpose timer.
+  os_port_init();
+#endif
+  os_thread_id_t idle_thread_id = os_add_thread(&idle_thread_handler, NULL, 0, idle_thread_handler_stack_space, idle_thread_handler_stack, -1, THREAD_INTEGER_ONLY);
+  idle_thread = os_thread_lookup(idle_thread_id);
 
 // If we want the void loop thread to still work
 #if defined(ARDUINO_LOOP_THREAD)
@@ -395,15 +1253,24 @@ void threads_init(void)
  */
 int os_start(int prev_state)
 {
-  __disable_irq();
+  // Interrupts hand work over by checking the state, so the check below and changing the state go together.
+  uint32_t irq_state = os_irq_lock();
 
   int old_state = current_active_state;
 
   if (prev_state == -1)
     prev_state = OS_STARTED;
 
+  // Anything interrupts handed over while we were stopped gets done before the kernel is back up.
+  if (prev_state == OS_STARTED && isr_request_head != isr_request_tail)
+    os_isr_requests_run();
+
+  // Someone more important than us became ready while we were stopped, so switch to them as soon as we're back up.
+  if (prev_state == OS_STARTED && preempt_pending)
+    os_pend_context_switch();
+
   current_active_state = prev_state;
-  __enable_irq();
+  os_irq_unlock(irq_state);
 
   return old_state;
 }
@@ -417,284 +1284,1349 @@ int os_start(int prev_state)
  */
 int os_stop(void)
 {
-  __disable_irq();
+  // No need to mask anything. If we get switched out between the two, the kernel is back to started by the time we're switched back in,
+  // And interrupts only ever read the state.
   int old_state = current_active_state;
   current_active_state = OS_STOPPED;
-  __enable_irq();
+  // Kernel state can't be touched until the store above is done.
+  __asm volatile("" ::: "memory");
   return old_state;
 }
 
 /*!
- * @brief Checks a thread, and based of it's flags will change it's behavior.
- * @note If the scheduler sees a thread sleeping, it's going to see if it needs to be woken up
- * @note If the scheduler sees a thread blocked via a mutex that has timed out, then it's going to remove that thread from it's respective semaphore and set it as thread running
- * @note If the scheduler sees a thread blocked via a mutex that either has no timeout or hasn't reached it's timeout BUT has an unlocked semaphore.
+ * @brief How many os_sched_lock() calls haven't been unlocked yet, and what the kernel was before the first one
+ * @note Only touched with the scheduler locked.
+ */
+static uint32_t sched_lock_depth = 0;
+static int sched_lock_state;
+
+/*!
+ * @brief Locks the scheduler, so the calling thread keeps running until it unlocks
+ * @note Interrupts stay live, anything they hand the kernel through a *_from_isr call waits until we unlock.
+ * @note Nests, the scheduler only unlocks once every os_sched_lock() had it's os_sched_unlock().
+ */
+void os_sched_lock(void)
+{
+  // Stopped first, so nobody else can get in between us and the count.
+  int os_state = os_stop();
+  if (sched_lock_depth++ == 0)
+    sched_lock_state = os_state;
+}
+
+/*!
+ * @brief Unlocks the scheduler, switching to whoever became ready in the meantime if they're more important than us
+ */
+void os_sched_unlock(void)
+{
+  if (--sched_lock_depth == 0)
+    os_start(sched_lock_state);
+}
+
+static inline void os_sched_lock_drop(void)
+{
+  sched_lock_depth = 0;
+}
+
+/*!
+ * @brief Appends a thread to the end of a circular thread list
+ * @param thread_t **head pointer to the head of the list
+ * @param thread_t *thread thread we are adding
  */
-static inline void check_thread_flags(thread_t *thread)
+static inline void os_list_append(thread_t **head, thread_t *thread)
 {
-  switch (thread->flags)
+  if (*head == NULL)
   {
-  case THREAD_SLEEPING:
-    // If the thread was sleeping, and we are waiting on the thread to complete.
-    if ((millis() - thread->previous_millis) >= thread->interval)
-      thread->flags = THREAD_RUNNING; // We wake up the thread.
-    break;
+    thread->sched_next = thread;
+    thread->sched_prev = thread;
+    *head = thread;
+    return;
+  }
 
-  case THREAD_BLOCKED_SEMAPHORE:
-    // If there are entrants available for the semaphore, then we run the thread.
-    if (thread->semaphore_max_count >= *thread->mutex_semaphore)
-      thread->flags = THREAD_RUNNING;
-    break;
+  // Since the list is circular, the tail sits right behind the head.
+  thread_t *tail = (*head)->sched_prev;
+  thread->sched_next = *head;
+  thread->sched_prev = tail;
+  tail->sched_next = thread;
+  (*head)->sched_prev = thread;
+}
 
-  case THREAD_BLOCKED_SEMAPHORE_TIMEOUT:
-    // If there are entrants available or our timeout has occoured
-    if (thread->semaphore_max_count >= *thread->mutex_semaphore || ((millis() - thread->previous_millis) >= thread->interval))
-      thread->flags = THREAD_RUNNING;
-    break;
+/*!
+ * @brief Removes a thread from a circular thread list
+ * @param thread_t **head pointer to the head of the list
+ * @param thread_t *thread thread we are removing
+ */
+static inline void os_list_remove(thread_t **head, thread_t *thread)
+{
+  // Last element in the list.
+  if (thread->sched_next == thread)
+  {
+    *head = NULL;
+    return;
+  }
 
-  case THREAD_BLOCKED_MUTEX:
-    // If the mutex has been release, then we grab it for the thread
-    if (*thread->mutex_semaphore == 0)
-      thread->flags = THREAD_RUNNING;
-    break;
+  thread->sched_prev->sched_next = thread->sched_next;
+  thread->sched_next->sched_prev = thread->sched_prev;
+  if (*head == thread)
+    *head = thread->sched_next;
+}
 
-  case THREAD_BLOCKED_MUTEX_TIMEOUT:
-    // If the mutex has been released or the timeout has occoured, we take care of the thread.
-    if (thread->mutex_semaphore == 0 || ((millis() - thread->previous_millis) >= thread->interval))
-      thread->flags = THREAD_RUNNING;
-    break;
+/*!
+ * @returns Whether or not a thread is scheduled by earliest deadline first right now
+ * @note An EDF thread that inherited a higher priority off of a mutex is scheduled by that priority until it gives it back.
+ */
+static inline bool os_thread_in_edf_class(thread_t *thread)
+{
+  return thread->sched_class == THREAD_CLASS_EDF && thread->thread_priority == thread->base_priority;
+}
 
-  case THREAD_BLOCKED_SIGNAL:
-    // If a thread is blocked by a signal and waiting for a particular bit to be set, we run the next thread!
-    if (thread->signal_bits_compare && *thread->signal_bit)
-      thread->flags = THREAD_RUNNING;
-    break;
+/*!
+ * @returns Whether or not thread a should run ahead of thread b
+ */
+static inline bool os_sched_before(thread_t *a, thread_t *b)
+{
+  if (a->thread_priority != b->thread_priority)
+    return a->thread_priority > b->thread_priority;
 
-  case THREAD_BLOCKED_SIGNAL_TIMEOUT:
-    // If either the thread times out or the signal is set, we run this as next thread.
-    if (thread->signal_bits_compare && *thread->signal_bit || ((millis() - thread->previous_millis) >= thread->interval))
-      thread->flags = THREAD_RUNNING;
-    break;
+  bool a_edf = os_thread_in_edf_class(a);
+  bool b_edf = os_thread_in_edf_class(b);
+
+  // Between EDF threads the earliest deadline goes first, and EDF threads go ahead of fixed priority ones.
+  if (a_edf && b_edf)
+    return a->edf_node.deadline < b->edf_node.deadline;
+  return a_edf && !b_edf;
+}
+
+/*!
+ * @returns Whether or not a ready thread has another thread at it's priority to take turns with
+ */
+static inline bool os_thread_has_peer(thread_t *thread)
+{
+  return thread->sched_list == THREAD_LIST_READY && thread->sched_next != thread;
+}
+
+/*!
+ * @brief Turns systick counting down the running thread's slice on or off
+ * @note Tickless mode only counts slices while there's someone else at the same priority, otherwise the running thread
+ * @note keeps the CPU until it blocks or something more important wakes up, so systick is only there for the core's millis().
+ */
+static inline void os_slice_update(void)
+{
+#ifdef OS_TICKLESS_MODULE
+  current_use_systick = os_thread_has_peer(current_thread);
+#endif
+}
+
+/*!
+ * @brief Puts a thread at the back of the ready list for it's priority
+ * @note O(1), Doesn't do anything if the thread is already ready.
+ * @param thread_t *thread
+ */
+static inline void os_ready_insert(thread_t *thread)
+{
+  if (thread->sched_list != THREAD_LIST_NONE)
+    return;
+
+  // EDF threads are ordered by the deadline of their current job instead.
+  if (os_thread_in_edf_class(thread))
+  {
+    edf_ready.insert(&thread->edf_node, thread->periodic->release_ms + thread->periodic->deadline_ms);
+    thread->sched_list = THREAD_LIST_EDF;
+  }
+  else
+  {
+    uint8_t priority = thread->thread_priority;
+    os_list_append(&ready_list[priority], thread);
+    ready_bitmap[priority >> 5] |= (1UL << (priority & 31));
+    ready_group_bitmap |= (1UL << (priority >> 5));
+    thread->sched_list = THREAD_LIST_READY;
+  }
+
+  // Running thread might have just got someone to take turns with.
+  os_slice_update();
+
+  // Thread is more important than the one running, so it doesn't wait for the end of the slice.
+  if (thread != current_thread && os_sched_before(thread, current_thread))
+  {
+    preempt_pending = true;
+    os_pend_context_switch();
+  }
+}
 
-  case THREAD_BLOCKED_QUEUE:
+/*!
+ * @brief Unlinks a thread from whichever scheduler list it sits in
+ * @note O(1), clears bitmap bits if we removed the last ready thread of a priority
+ * @param thread_t *thread
+ */
+static inline void os_sched_unlink(thread_t *thread)
+{
+  switch (thread->sched_list)
+  {
+  case THREAD_LIST_READY:
+  {
+    uint8_t priority = thread->thread_priority;
+    os_list_remove(&ready_list[priority], thread);
+    if (ready_list[priority] == NULL)
+    {
+      ready_bitmap[priority >> 5] &= ~(1UL << (priority & 31));
+      if (ready_bitmap[priority >> 5] == 0)
+        ready_group_bitmap &= ~(1UL << (priority >> 5));
+    }
+    break;
+  }
+  case THREAD_LIST_EDF:
+    edf_ready.remove(&thread->edf_node);
     break;
   default:
     break;
   }
+  thread->sched_list = THREAD_LIST_NONE;
 }
 
 /*!
- *   @brief Increments to next thread for context switching
- *   @note Not to be called externally!
- *   @param  none
- *   @returns none
+ * @returns Whether or not a thread blocked in this state has a timeout
+ */
+static inline bool os_thread_state_has_timeout(thread_state_t state)
+{
+  switch (state)
+  {
+  case THREAD_BLOCKED_SEMAPHORE_TIMEOUT:
+  case THREAD_BLOCKED_MUTEX_TIMEOUT:
+  case THREAD_BLOCKED_SIGNAL_TIMEOUT:
+  case THREAD_BLOCKED_FUTEX_TIMEOUT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*!
+ * @brief Takes a thread that is no longer running out of the ready set
+ * @note Threads that aren't ready cost nothing until their kernel object or their wake timer wakes them up.
+ * @param thread_t *thread
+ */
+static inline void os_sched_park(thread_t *thread)
+{
+  os_sched_unlink(thread);
+
+  // Ended threads are switched out for good by the time they get here, so their slot can go back.
+  if (thread->flags == THREAD_ENDED)
+    os_thread_free(thread);
+}
+
+/*!
+ * @brief Puts a thread back into the ready set, wherever it was before
+ * @param thread_t *thread
+ */
+static inline void os_sched_wake(thread_t *thread)
+{
+  OS_TRACE(OS_TRACE_WAKE, current_thread_id, os_thread_handle(thread), thread->flags, 0);
+  os_sched_unlink(thread);
+  thread->flags = THREAD_RUNNING;
+  os_ready_insert(thread);
+}
+
+/*!
+ * @returns The highest priority ready thread, or NULL if nothing is ready
+ * @note O(1), uses count leading zeros on the group bitmap and then the priority bitmap.
+ */
+static inline thread_t *os_ready_top(void)
+{
+  thread_t *top = NULL;
+  if (ready_group_bitmap != 0)
+  {
+    uint32_t group = 31 - __builtin_clz(ready_group_bitmap);
+    uint32_t priority = (group << 5) + (31 - __builtin_clz(ready_bitmap[group]));
+    top = ready_list[priority];
+  }
+
+  // EDF class as a whole sits at OS_EDF_PRIORITY, and it's earliest deadline is always on top of the heap.
+  DeadlineHeapNode *edf_top = edf_ready.peek();
+  if (edf_top != NULL && (top == NULL || OS_EDF_PRIORITY >= top->thread_priority))
+    return (thread_t *)edf_top->ptr;
+
+  return top;
+}
+
+/*!
+ * @brief Takes a thread off of whichever wait queue it's sitting on, without touching priorities.
+ * @param thread_t *thread
+ */
+static inline void os_wait_queue_remove(thread_t *thread)
+{
+  os_wait_queue_t *queue = thread->wait_queue;
+  if (queue == NULL)
+    return;
+
+  if (thread->wait_prev != NULL)
+    thread->wait_prev->wait_next = thread->wait_next;
+  else
+    queue->head = thread->wait_next;
+
+  if (thread->wait_next != NULL)
+    thread->wait_next->wait_prev = thread->wait_prev;
+
+  thread->wait_queue = NULL;
+  thread->wait_next = NULL;
+  thread->wait_prev = NULL;
+}
+
+/*!
+ * @brief Adds a thread to a wait queue, behind every thread of the same or higher priority.
+ * @param os_wait_queue_t *queue
+ * @param thread_t *thread
+ */
+static inline void os_wait_queue_insert(os_wait_queue_t *queue, thread_t *thread)
+{
+  thread_t *prev = NULL;
+  thread_t *next = queue->head;
+
+  while (next != NULL && next->thread_priority >= thread->thread_priority)
+  {
+    prev = next;
+    next = next->wait_next;
+  }
+
+  thread->wait_prev = prev;
+  thread->wait_next = next;
+  if (prev != NULL)
+    prev->wait_next = thread;
+  else
+    queue->head = thread;
+  if (next != NULL)
+    next->wait_prev = thread;
+
+  thread->wait_queue = queue;
+}
+
+/*!
+ * @returns The priority a thread should run at, it's own or the highest priority waiting on something it owns.
+ * @note Wait queues are kept in priority order, so we only have to look at the head of each one.
+ */
+static inline uint8_t os_thread_inherited_priority(thread_t *thread)
+{
+  uint8_t priority = thread->base_priority;
+  for (os_wait_queue_t *queue = thread->owned_queues; queue != NULL; queue = queue->owned_next)
+  {
+    if (queue->head != NULL && queue->head->thread_priority > priority)
+      priority = queue->head->thread_priority;
+  }
+  return priority;
+}
+
+/*!
+ * @brief Pends a context switch if someone that's ready should be running instead of the current thread
+ * @note For when the running thread got less important, since os_ready_insert() only checks the thread it inserts.
+ */
+static inline void os_sched_check_current(void)
+{
+  thread_t *top = os_ready_top();
+  if (top != NULL && top != current_thread && os_sched_before(top, current_thread))
+  {
+    preempt_pending = true;
+    os_pend_context_switch();
+  }
+}
+
+static void os_sched_requeue(thread_t *thread)
+{
+  if (thread->sched_list == THREAD_LIST_NONE)
+    return;
+
+  os_sched_unlink(thread);
+  os_ready_insert(thread);
+  if (thread == current_thread)
+    os_sched_check_current();
+}
+
+/*!
+ * @brief Changes the priority a thread runs at, moving it to the right spot in the ready set or it's wait queue.
+ * @param thread_t *thread
+ * @param uint8_t priority
+ */
+static inline void os_thread_set_effective_priority(thread_t *thread, uint8_t priority)
+{
+  if (thread->sched_list != THREAD_LIST_NONE)
+  {
+    os_sched_unlink(thread);
+    thread->thread_priority = priority;
+    os_ready_insert(thread);
+  }
+  else
+    thread->thread_priority = priority;
+
+  // If we just dropped the running thread below someone that's ready, they get to go now.
+  if (thread == current_thread)
+    os_sched_check_current();
+
+  os_wait_queue_t *queue = thread->wait_queue;
+  if (queue != NULL)
+  {
+    os_wait_queue_remove(thread);
+    os_wait_queue_insert(queue, thread);
+  }
+}
+
+/*!
+ * @brief Recomputes the inherited priority of a thread, and of every owner down the chain of objects it's blocked on.
+ * @note Handles raising and dropping priority, stops as soon as a priority doesn't change.
+ * @param thread_t *thread
+ */
+static void os_priority_inheritance_update(thread_t *thread)
+{
+  while (thread != NULL)
+  {
+    uint8_t priority = os_thread_inherited_priority(thread);
+    if (priority == thread->thread_priority)
+      return;
+
+    os_thread_set_effective_priority(thread, priority);
+
+    // If we are blocked on something that's owned, that owner might need to change too.
+    if (thread->wait_queue == NULL)
+      return;
+    thread = thread->wait_queue->owner;
+  }
+}
+
+/*!
+ * @brief Takes a thread off of whichever wait queue it's sitting on.
+ * @note If the queue has an owner, it no longer inherits our priority.
+ * @param thread_t *thread
+ */
+static inline void os_wait_queue_unlink(thread_t *thread)
+{
+  os_wait_queue_t *queue = thread->wait_queue;
+  if (queue == NULL)
+    return;
+
+  os_wait_queue_remove(thread);
+  if (queue->owner != NULL)
+    os_priority_inheritance_update(queue->owner);
+}
+
+/*!
+ * @brief Hands ownership of a wait queue's kernel object to a thread
+ * @note The owner runs at the priority of it's highest priority waiter(transitively through whatever it's blocked on),
+ * @note and drops back once it gives the object up.
+ * @note Must be called with the kernel stopped.
+ * @param os_wait_queue_t *queue
+ * @param thread_t *owner new owner, NULL when the object is released
+ */
+void os_wait_queue_set_owner(os_wait_queue_t *queue, thread_t *owner)
+{
+  thread_t *old_owner = queue->owner;
+  if (old_owner == owner)
+    return;
+
+  // Old owner gives the object up, and drops back to whatever it still inherits.
+  if (old_owner != NULL)
+  {
+    os_wait_queue_t **link = &old_owner->owned_queues;
+    while (*link != NULL && *link != queue)
+      link = &(*link)->owned_next;
+    if (*link != NULL)
+      *link = queue->owned_next;
+    queue->owned_next = NULL;
+    queue->owner = NULL;
+    os_priority_inheritance_update(old_owner);
+  }
+
+  // New owner takes on the priority of everyone still waiting.
+  if (owner != NULL)
+  {
+    queue->owner = owner;
+    queue->owned_next = owner->owned_queues;
+    owner->owned_queues = queue;
+    os_priority_inheritance_update(owner);
+  }
+}
+
+/*!
+ * @brief Moves a ready thread behind every other thread at it's priority
+ * @note O(1), since the lists are circular moving the head along puts the old head at the back.
+ * @param thread_t *thread
+ */
+static inline void os_ready_rotate(thread_t *thread)
+{
+  uint8_t priority = thread->thread_priority;
+  if (ready_list[priority] == thread)
+  {
+    ready_list[priority] = thread->sched_next;
+    return;
+  }
+
+  os_list_remove(&ready_list[priority], thread);
+  os_list_append(&ready_list[priority], thread);
+}
+
+/*!
+ * @brief Wakes up every thread whose sleep or blocking timeout has run out
+ * @note Threads blocked on a kernel object are taken off that object's wait queue.
+ * @param uint64_t now current time from os_micros64()
+ */
+static inline void os_expire_wake_timers(uint64_t now)
+{
+  TimingWheelNode *node = wake_timers.advance(now);
+  while (node != NULL)
+  {
+    TimingWheelNode *next = node->next;
+    thread_t *thread = (thread_t *)node->ptr;
+
+    if (thread->wait_queue != NULL)
+    {
+      os_wait_queue_unlink(thread);
+      thread->wake_status = THREAD_WAKE_TIMEOUT;
+    }
+    os_sched_wake(thread);
+
+    node = next;
+  }
+}
+
+/*!
+ * @brief Closes out the CPU load bucket we are filling once it's long enough, and starts the next one.
+ * @param uint64_t now current time from os_micros64()
+ */
+static inline void os_cpu_load_update(uint64_t now)
+{
+  uint64_t elapsed_us = now - cpu_load_bucket_start_us;
+  if (elapsed_us < OS_CPU_LOAD_BUCKET_US)
+    return;
+
+  cpu_load_buckets[cpu_load_bucket_index].busy_cycles = busy_cycles - cpu_load_bucket_start_busy;
+  cpu_load_buckets[cpu_load_bucket_index].elapsed_us = elapsed_us;
+  cpu_load_bucket_index = (cpu_load_bucket_index + 1) % OS_CPU_LOAD_BUCKETS;
+
+  cpu_load_bucket_start_us = now;
+  cpu_load_bucket_start_busy = busy_cycles;
+}
+
+/*!
+ *   @brief Increments to next thread for context switching
+ *   @note Not to be called externally!
+ *   @param  none
+ *   @returns none
+ */
+inline void os_get_next_thread()
+{
+
+  // First, save the current_sp set by context_switch
+  current_thread->sp = current_sp;
+
+  // did we overflow the stack (don't check thread 0)?
+  // allow an extra 8 bytes for a call to the ISR and one additional call or variable
+  // Threads with an MPU guard would have faulted as soon as they went over, so they don't need checking.
+  if (current_thread_id && !current_thread->guard_rbar && ((uint8_t *)current_thread->sp - current_thread->stack <= 8))
+  {
+    os_stack_fault_record(current_thread, false, 0, 0, (uint32_t)(uintptr_t)current_thread->sp);
+    stack_overflow_isr();
+  }
+
+  // Charge the thread we are leaving for the time it ran.
+  uint32_t now_cycles = os_cpu_cycles();
+  uint32_t ran_cycles = now_cycles - switched_in_cycles;
+  current_thread->run_cycles += ran_cycles;
+  if (current_thread != idle_thread)
+    busy_cycles += ran_cycles;
+  switched_in_cycles = now_cycles;
+
+  bool yielded = yield_pending;
+  yield_pending = false;
+
+  // Whether the thread we are leaving gave up the CPU itself, or still wanted to run.
+  bool voluntary = yielded || current_thread->flags != THREAD_RUNNING;
+
+  // If the thread we are leaving blocked, slept or ended, it leaves the ready set.
+  current_thread->ticks_left = 0;
+  if (current_thread->flags != THREAD_RUNNING)
+    os_sched_park(current_thread);
+  // If it used up or gave up it's slice, it goes behind the other threads at it's priority.
+  else if (current_thread->sched_list == THREAD_LIST_READY && (current_tick_count == 0 || yielded))
+  {
+    if (current_tick_count == 0)
+      current_thread->slices_consumed++;
+    os_ready_rotate(current_thread);
+  }
+  // Otherwise it got preempted, so it stays at the front of it's priority and keeps the rest of it's slice.
+  else
+    current_thread->ticks_left = current_tick_count;
+
+  // Interrupts might have handed over work while the kernel was stopped.
+  os_isr_requests_run();
+
+  // Anyone whose sleep or timeout ran out goes back into the ready set.
+  uint64_t now = os_micros64();
+  os_expire_wake_timers(now);
+  os_cpu_load_update(now);
+
+  // Highest priority ready thread runs first!
+  thread_t *thread = os_ready_top();
+
+  // Threads can have their state changed while they sit in the ready set(suspended, killed),
+  // So we park those here the first time they make it to the top.
+  while (thread->flags != THREAD_RUNNING)
+  {
+    os_sched_park(thread);
+    thread = os_ready_top();
+  }
+
+  if (thread != current_thread)
+  {
+    OS_TRACE(OS_TRACE_SWITCH, current_thread_id, os_thread_handle(thread), current_thread->flags, voluntary);
+    if (voluntary)
+      current_thread->voluntary_switches++;
+    else
+      current_thread->preempted_switches++;
+    thread->switch_ins++;
+  }
+
+  // So the astute may realize here, that there's no termination code.
+  // The reason is because the lowest priority thread is the remainder thread, which is never parked
+  // So there is always something ready to run.
+
+#if defined(__IMXRT1062__) || defined(OS_PORT_POSIX) || defined(OS_PORT_MPS2)
+  // Timer only fires once the earliest waiting thread needs to wake up, so a thread waking up doesn't wait on the tick.
+  // With tickless mode, if we are idle that means we sleep until then.
+  uint64_t next_wake;
+  os_tickless_deadline_t next_wake_deadline;
+  os_tickless_deadline_reset(&next_wake_deadline);
+  if (wake_timers.next_expiry(&next_wake))
+    os_tickless_deadline_add(&next_wake_deadline, next_wake);
+#if defined(OS_PORT_POSIX) || defined(OS_PORT_MPS2)
+  os_port_timer_reprogram(os_tickless_timer_us(&next_wake_deadline, now));
+#else
+  t4_gpt_reprogram(os_tickless_timer_us(&next_wake_deadline, now));
+#endif
+#endif
+
+  // Anyone we woke up above is already accounted for, so we don't need to come straight back here.
+  preempt_pending = false;
+#if defined(OS_PORT_POSIX)
+  os_port_clear_switch();
+#else
+  SCB_ICSR = SCB_ICSR_PENDSVCLR;
+#endif
+
+  // Load up all the important registers from memory back into the operating system.
+  current_tick_count = thread->ticks_left > 0 ? thread->ticks_left : thread->ticks;
+  thread->ticks_left = 0;
+  current_thread = thread;
+  current_thread_id = os_thread_handle(thread);
+  current_save = &(thread->save);
+  current_msp = 0;
+  current_sp = thread->sp;
+  os_slice_update();
+
+#ifdef OS_STACK_GUARD
+  os_stack_guard_load(thread);
+#endif
+}
+
+/*!
+ * @brief Blocks the current thread on a kernel object's wait queue until it's woken up or times out
+ * @note Must be entered with the scheduler locked, our os_sched_lock() is undone before we yield, so the scheduler is unlocked once we return.
+ * @note Timeout is only used with one of the *_TIMEOUT thread states.
+ * @param os_wait_queue_t *queue wait queue of the kernel object
+ * @param thread_state_t state blocked state the thread sits in
+ * @param uint64_t timeout_us
+ * @returns thread_wake_status_t why we woke up, THREAD_WAKE_NONE if we never actually got switched out
+ */
+thread_wake_status_t os_wait_queue_block(os_wait_queue_t *queue, thread_state_t state, uint64_t timeout_us)
+{
+  thread_t *this_thread = current_thread;
+
+  this_thread->wake_status = THREAD_WAKE_NONE;
+  OS_TRACE(OS_TRACE_BLOCK, current_thread_id, current_thread_id, state, (uintptr_t)queue);
+  os_wait_queue_insert(queue, this_thread);
+
+  // Whoever holds the object now runs at least at our priority until they give it up.
+  if (queue->owner != NULL)
+    os_priority_inheritance_update(queue->owner);
+  if (os_thread_state_has_timeout(state))
+    wake_timers.insert(&this_thread->wake_timer, os_deadline_us(timeout_us));
+  this_thread->flags = state;
+
+  // reboot the OS kernel, and context switch out of the thread.
+  os_sched_unlock();
+  _os_yield();
+
+  // If our caller had the scheduler locked too, the yield doesn't go anywhere, so we take ourselves back off the queue.
+  os_sched_lock();
+  if (this_thread->wake_status == THREAD_WAKE_NONE)
+  {
+    os_wait_queue_unlink(this_thread);
+    wake_timers.cancel(&this_thread->wake_timer);
+    os_sched_wake(this_thread);
+  }
+  thread_wake_status_t wake_status = this_thread->wake_status;
+  os_sched_unlock();
+
+  return wake_status;
+}
+
+/*!
+ * @brief Wakes up a specific thread waiting on a wait queue
+ * @note Must be called with the kernel stopped.
+ * @param thread_t *thread
+ */
+void os_wait_queue_wake(thread_t *thread)
+{
+  os_wait_queue_unlink(thread);
+  // Woken up before the timeout, so the timeout never happens.
+  wake_timers.cancel(&thread->wake_timer);
+  thread->wake_status = THREAD_WAKE_SIGNALED;
+  os_sched_wake(thread);
+}
+
+/*!
+ * @brief Wakes up the highest priority thread waiting on a wait queue
+ * @note Must be called with the kernel stopped.
+ * @param os_wait_queue_t *queue
+ * @returns thread_t* thread that we woke up, NULL if nobody was waiting
+ */
+thread_t *os_wait_queue_wake_one(os_wait_queue_t *queue)
+{
+  thread_t *thread = queue->head;
+  if (thread != NULL)
+    os_wait_queue_wake(thread);
+  return thread;
+}
+
+/*!
+ *   @brief  deletes a thread from the system.
+ *   @note  be careful, since this also ends the system kernel and isr's
+ *   @param none
+ *   @return none
+ */
+void os_del_process(void)
+{
+  // Stopping the Will-OS system
+  os_sched_lock();
+
+  // Pointer to the thread we are using.
+  thread_t *me = current_thread;
+
+  // Setting our current thread to an "ended" state
+  // Our slot goes back on the free list once the scheduler switches us out.
+  me->flags = THREAD_ENDED;
+
+  // Restart the will-os kernel
+  os_sched_unlock();
+
+  // Nothing to come back to, so we switch out straight away.
+  _os_yield();
+}
+
+/*!
+ *   @brief Given a thread pointer, arguements towards thread pointer, stack address to thread pointer, and stack size, we can setup the isr interrupts for thread.
+ *   @note Called whenever we add another thread.
+ *   @param will_os_thread_func_t thread pointer to program counter start of thread
+ *   @param void *arg address pointer of arguements to pass into will-os
+ *   @param void *stack_addr pointer to the begining of the stack address.
+ *   @param int stack_size size of the stack for this thread
+ *   @returns pointer to the new threadstack.
+ */
+#if !defined(OS_PORT_POSIX)
+void *os_loadstack(thread_func_t p, void *arg, void *stackaddr, int stack_size)
+{
+
+  interrupt_stack_t *process_frame = (interrupt_stack_t *)((uint8_t *)stackaddr + stack_size - sizeof(interrupt_stack_t) - 8);
+  // Clearing up and setting all the registers.
+  process_frame->r0 = (uint32_t)arg;
+  process_frame->r1 = 0;
+  process_frame->r2 = 0;
+  process_frame->r3 = 0;
+  process_frame->r12 = 0;
+  process_frame->lr = (uint32_t)os_del_process;
+  process_frame->pc = ((uint32_t)p);
+  process_frame->xpsr = 0x1000000;
+  uint8_t *ret = (uint8_t *)process_frame;
+  return (void *)ret;
+}
+#endif
+
+/*!
+ * @brief Puts the kernel back the way os_add_thread() found it, whether or not the thread got added
+ * @note If the operating system was started before, we restart the OS.
+ * @param int old_state what os_stop() gave back
+ */
+static inline void os_add_thread_restart(int old_state)
+{
+  current_active_state = old_state;
+  if (old_state == OS_STARTED || old_state == OS_FIRST_RUN)
+    os_start();
+}
+
+/*!
+ * @brief Adds a thread to Will-OS Kernel
+ * @note Paralelism at it's finest!
+ * @param will_os_thread_func_t thread(pointer to thread function call begining of program counter)
+ * @param void *arg(pointer arguement to parameters for thread)
+ * @param void *stack(pointer to begining of thread stack)
+ * @param int stack_size(size of the allocated threadstack)
+ * @param int ticks(time slice the thread gets before other threads at the same priority run, -1 for the default)
+ * @param thread_fpu_mode_t fpu_mode(THREAD_INTEGER_ONLY threads don't get their floating point registers saved, so they must never use the FPU)
+ * @returns none
+ */
+os_thread_id_t os_add_thread(thread_func_t p, void *arg, uint8_t thread_priority, int stack_size, void *stack, int ticks, thread_fpu_mode_t fpu_mode)
+{
+  int old_state = os_stop();
+
+  // If we don't allocate a valid stack size, then we just choose the default stack size
+  if (stack_size == -1)
+    stack_size = OS_DEFAULT_STACK_SIZE;
+
+  // Same goes for the time slice
+  if (ticks == -1)
+    ticks = OS_DEFAULT_TICKS;
+
+  // Free slot straight off the free list, the thread table grows if it's out.
+  thread_t *tp = os_thread_alloc();
+  if (tp == NULL)
+  {
+    os_add_thread_restart(old_state);
+    return -1;
+  }
+
+  // An ended thread might never have made it back to the scheduler, so make sure it's out of every list
+  os_sched_unlink(tp);
+
+  // The previous thread's stack went back when it ended, but it's release schedule if it was periodic is still here.
+  if (tp->periodic != NULL)
+  {
+    delete tp->periodic;
+    tp->periodic = NULL;
+  }
+
+#if defined(OS_PORT_POSIX)
+  // Interrupts land on thread stacks, and a signal frame on the host is far bigger than an exception frame,
+  // So stacks too small for one get swapped for a big enough one out of the stack pool.
+  if (stack_size < OS_PORT_MIN_STACK_SIZE)
+  {
+    stack_size = OS_PORT_MIN_STACK_SIZE;
+    stack = NULL;
+  }
+#endif
+
+  // If there is no stack allocated, then we get one from the stack pool, which might round the size up.
+  if (stack == NULL)
+  {
+    stack = os_stack_pool_alloc(&stack_size);
+    if (stack == NULL)
+    {
+      os_thread_free_push(tp);
+      os_add_thread_restart(old_state);
+      return -1;
+    }
+    tp->my_stack = 1;
+    tp->stack_alloc_size = stack_size;
+  }
+  // Otherwise our stack is defined by something else!
+  else
+    tp->my_stack = 0;
+
+  // Preconfigure all the propper variables
+  tp->stack = (uint8_t *)stack;
+  tp->stack_size = stack_size;
+  tp->save.fpu_save = NULL;
+
+#ifdef __ARM_PCS_VFP
+  // Threads that might use the FPU keep their floating point save area at the top of their stack,
+  // 8 byte aligned so the stack we hand out below it stays aligned too.
+  if (fpu_mode == THREAD_FPU_ENABLED)
+  {
+    uintptr_t fpu_save = ((uintptr_t)tp->stack + tp->stack_size - sizeof(software_fpu_stack_t)) & ~(uintptr_t)7;
+    tp->save.fpu_save = (software_fpu_stack_t *)fpu_save;
+    tp->stack_size = fpu_save - (uintptr_t)tp->stack;
+  }
+#else
+  (void)fpu_mode;
+#endif
+
+  // Paint the stack so we can tell how deep it ever got, before the first frame goes on top of it.
+  memset(tp->stack, OS_STACK_PAINT, tp->stack_size);
+  tp->stack_untouched = tp->stack_size;
+
+  tp->guard_rbar = 0;
+#ifdef OS_STACK_GUARD
+  tp->guard_rbar = os_stack_guard_rbar(tp->stack, tp->stack_size);
+#endif
+
+#if defined(OS_PORT_POSIX)
+  tp->sp = os_port_init_context(&tp->save.context, p, arg, tp->stack, tp->stack_size);
+#else
+  void *psp = os_loadstack(p, arg, tp->stack, tp->stack_size);
+  tp->sp = psp;
+  tp->save.lr = 0xFFFFFFF9;
+#endif
+  tp->ticks = ticks;
+  tp->slices_consumed = 0;
+  tp->ticks_left = 0;
+  tp->run_cycles = 0;
+  tp->switch_ins = 0;
+  tp->voluntary_switches = 0;
+  tp->preempted_switches = 0;
+  tp->sched_class = THREAD_CLASS_PRIORITY;
+  tp->edf_node.ptr = (void *)tp;
+  tp->wake_timer.ptr = (void *)tp;
+  tp->flags = THREAD_RUNNING;
+  thread_count++;
+
+  // How important is this thread?
+  // Note that since we put that in the priority thread,
+  tp->thread_priority = thread_priority;
+  tp->base_priority = thread_priority;
+  tp->owned_queues = NULL;
+
+  // Signals sent to whoever had the slot before don't carry over.
+  tp->thread_set_flags = 0;
+  tp->signal_waiters.head = NULL;
+
+  // Thread is ready to go, so it goes into the ready list for it's priority.
+  // Done before restarting the kernel so we can't get switched out with half a list.
+  os_ready_insert(tp);
+
+  // Taken before the kernel is back up, a more important thread runs straight away and might end and give the slot back before we return.
+  os_thread_id_t thread_id = os_thread_handle(tp);
+
+  os_add_thread_restart(old_state);
+  return thread_id;
+}
+
+/*!
+ * @brief Adds a thread to Will-OS Kernel
+ * @note Paralelism at it's finest!
+ * @param will_os_thread_func_t thread(pointer to thread function call begining of program counter)
+ * @param void *arg(pointer arguement to parameters for thread)
+ * @param void *stack(pointer to begining of thread stack)
+ * @param int stack_size(size of the allocated threadstack)
+ * @returns none
+ */
+os_thread_id_t os_add_thread(thread_func_t p, void *arg, int stack_size, void *stack) { return os_add_thread(p, arg, 128, stack_size, stack); }
+
+/*!
+ *   @brief Allows us to change the Will-OS System tick.
+ *   @note If you want more precision in your system ticks, take care of this here.
+ *   @param int tick_microseconds
+ *   @returns none
+ */
+bool os_set_microsecond_timer(int tick_microseconds)
+{
+  // return t4_gpt_init(tick_microseconds);
+
+  return false;
+}
+
+/*!
+ * @brief Changes the time slice of a thread
+ * @note Takes effect the next time the thread is switched in.
+ * @param os_thread_id_t target_thread_id
+ * @param int ticks number of system ticks the thread runs before other threads of the same priority get a turn
+ * @returns whether or not the thread exists
+ */
+bool os_set_thread_ticks(os_thread_id_t target_thread_id, int ticks)
+{
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL && ticks >= 0)
+  {
+    thread->ticks = ticks;
+    return true;
+  }
+  return false;
+}
+
+/*!
+ * @returns The time slice of a thread in system ticks, -1 if the thread doesn't exist
+ */
+int os_get_thread_ticks(os_thread_id_t target_thread_id)
+{
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+    return thread->ticks;
+  return -1;
+}
+
+/*!
+ * @returns How many full time slices a thread has used up, 0 if the thread doesn't exist
+ */
+uint32_t os_get_thread_slices(os_thread_id_t target_thread_id)
+{
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+    return thread->slices_consumed;
+  return 0;
+}
+
+/*!
+ * @brief Takes a snapshot of the runtime statistics of every thread
+ * @note Taken with the kernel stopped, so every thread's numbers are from the same moment.
+ * @note The idle thread's run cycles stop counting while the core sleeps in WFI, use os_get_cpu_load() for how busy the CPU is.
+ * @param os_thread_stats_t *stats array filled in with one entry for each thread
+ * @param int max_threads how many entries fit in stats
+ * @returns How many entries we filled in
  */
-inline void os_get_next_thread()
+int os_get_thread_stats(os_thread_stats_t *stats, int max_threads)
 {
+  int count = 0;
+  os_sched_lock();
 
-  // First, save the current_sp set by context_switch
-  current_thread->sp = current_sp;
-
-  // did we overflow the stack (don't check thread 0)?
-  // allow an extra 8 bytes for a call to the ISR and one additional call or variable
-  if (current_thread_id && ((uint8_t *)current_thread->sp - current_thread->stack <= 8))
-    stack_overflow_isr();
-
-  static PriorityQueueNaiveNode *current_node;
+  // Running thread hasn't been charged for it's current run yet.
+  uint32_t running_cycles = os_cpu_cycles() - switched_in_cycles;
 
-  // Whichever thread we want to use.
-  thread_t *thread;
+  for (int n = 0; n < thread_slot_count && count < max_threads; n++)
+  {
+    thread_t *thread = os_thread_slot(n);
+    if (thread->flags == THREAD_EMPTY || thread->free_listed)
+      continue;
+
+    os_thread_stats_t *entry = &stats[count++];
+    entry->thread_id = os_thread_handle(thread);
+    entry->state = thread->flags;
+    entry->priority = thread->thread_priority;
+    entry->idle = (thread == idle_thread);
+    entry->run_cycles = thread->run_cycles + (thread == current_thread ? running_cycles : 0);
+    entry->switch_ins = thread->switch_ins;
+    entry->voluntary_switches = thread->voluntary_switches;
+    entry->preempted_switches = thread->preempted_switches;
+  }
 
-  // We look at the highest priority node first
-  current_node = thread_priorities.peek_top_node();
+  os_sched_unlock();
+  return count;
+}
 
-  // Iterate through until we have a thread we need to pick up
-  while (1)
-  {
-    // Casting general pointer as a thread pointer
-    thread = (thread_t *)current_node->ptr;
+/*!
+ * @returns How many CPU cycles there are in a microsecond, at the speed the core is running at right now
+ */
+static inline float os_cpu_cycles_per_us(void)
+{
+#if defined(__IMXRT1062__)
+  return F_CPU_ACTUAL / 1000000.0f;
+#else
+  return F_CPU / 1000000.0f;
+#endif
+}
 
-    // Checking to see what the threads are doing.
-    check_thread_flags(thread);
+/*!
+ * @brief How busy the CPU was over the CPU load window
+ * @note Everything except the idle thread counts as busy, including interrupts that came in while a thread was running.
+ * @returns Percentage of the window the CPU was busy, 0-100
+ */
+float os_get_cpu_load(void)
+{
+  os_sched_lock();
 
-    // The highest priority thread runs first!
-    if (thread->flags == THREAD_RUNNING)
-      break;
+  // Bucket we are filling right now counts too, so the load is never stale.
+  uint64_t window_busy = busy_cycles - cpu_load_bucket_start_busy;
+  if (current_thread != idle_thread)
+    window_busy += os_cpu_cycles() - switched_in_cycles;
+  uint64_t window_us = os_micros64() - cpu_load_bucket_start_us;
 
-    // If nothing works out, we move on to the next thread.
-    current_node = current_node->next;
+  for (int n = 0; n < OS_CPU_LOAD_BUCKETS; n++)
+  {
+    window_busy += cpu_load_buckets[n].busy_cycles;
+    window_us += cpu_load_buckets[n].elapsed_us;
   }
 
-  // So the astute may realize here, that there's no termination code.
-  // The reason is because the lowest priority thread is the remainder thread, and that thread does literally nothing but exit out
-  // And check for something that's ready again
+  os_sched_unlock();
 
-  // Load up all the important registers from memory back into the operating system.
-  current_tick_count = thread->ticks;
-  current_thread = thread;
-  current_save = &(thread->save);
-  current_msp = 0;
-  current_sp = thread->sp;
+  if (window_us == 0)
+    return 0;
+
+  float load = 100.0f * (float)window_busy / ((float)window_us * os_cpu_cycles_per_us());
+  return load > 100.0f ? 100.0f : load;
 }
 
 /*!
- *   @brief  deletes a thread from the system.
- *   @note  be careful, since this also ends the system kernel and isr's
- *   @param none
- *   @return none
+ * @brief Prints a top style table of every thread's runtime statistics
+ * @note Allocates the snapshot, since there's no telling how many threads there are.
+ * @param Print *out where to print it, like &Serial
  */
-void os_del_process(void)
+void os_print_thread_stats(Print *out)
 {
-  // Stopping the Will-OS system
-  int old_state = os_stop();
+  // Threads added after we allocate just don't make it into this table.
+  int max_threads = os_thread_slots();
+  os_thread_stats_t *stats = new os_thread_stats_t[max_threads];
+  if (stats == NULL)
+    return;
+  int count = os_get_thread_stats(stats, max_threads);
+
+  uint64_t total_cycles = 0;
+  for (int n = 0; n < count; n++)
+    total_cycles += stats[n].run_cycles;
+
+  out->printf("cpu load %.1f%%\n", os_get_cpu_load());
+  out->printf("%4s %4s %5s %6s %10s %10s %10s %10s\n", "id", "prio", "state", "cpu%", "run_ms", "switch_in", "voluntary", "preempted");
+  for (int n = 0; n < count; n++)
+  {
+    float share = total_cycles ? 100.0f * (float)stats[n].run_cycles / (float)total_cycles : 0;
+    unsigned long run_ms = (unsigned long)((float)stats[n].run_cycles / (os_cpu_cycles_per_us() * 1000.0f));
+    out->printf("%4d %4u %5d %6.1f %10lu %10lu %10lu %10lu%s\n", (int)stats[n].thread_id, (unsigned)stats[n].priority, (int)stats[n].state, share,
+                run_ms, (unsigned long)stats[n].switch_ins, (unsigned long)stats[n].voluntary_switches,
+                (unsigned long)stats[n].preempted_switches, stats[n].idle ? " idle" : "");
+  }
 
-  // Pointer to the thread we are using.
-  thread_t *me = &system_threads[current_thread_id];
+  delete[] stats;
+}
 
-  thread_count--;
+/*!
+ * @brief Where the idle thread is in it's pass over the thread stacks
+ */
+static int stack_scan_thread = 0;
+static uint8_t *stack_scan_stack = NULL;
+static int stack_scan_offset = 0;
 
-  // Setting our current thread to an "ended" state
-  me->flags = THREAD_ENDED;
+/*!
+ * @returns Offset of the first word aligned byte in a stack we can scan, since we scan a word at a time
+ */
+static inline int os_stack_scan_start(thread_t *thread)
+{
+#ifdef OS_STACK_GUARD
+  // Nothing can ever be written to the guard, and reading it from it's own thread would fault.
+  if (thread->guard_rbar)
+    return os_stack_guard_end(thread) - thread->stack;
+#endif
+  return (4 - ((uintptr_t)thread->stack & 3)) & 3;
+}
 
-  // Restart the will-os kernel
-  os_start(old_state);
+/*!
+ * @brief Checks up to max_words stack words for paint, starting from the bottom of the stack at offset
+ * @param thread_t *thread whose stack we are checking
+ * @param int *offset where to start, moved up past every painted word we found
+ * @param int max_words how many words to check at most
+ * @returns whether or not we found the high water mark, which is the first word that isn't painted anymore, or the top of the stack
+ */
+static inline bool os_stack_scan_words(thread_t *thread, int *offset, int max_words)
+{
+  const uint32_t paint = OS_STACK_PAINT * 0x01010101UL;
+  const uint8_t *stack = thread->stack;
 
-  //_os_yield();
+  while (max_words-- > 0)
+  {
+    if (*offset + 4 > thread->stack_size)
+      return true;
+    if (*(const uint32_t *)(stack + *offset) != paint)
+      return true;
+    *offset += 4;
+  }
+  return false;
 }
 
 /*!
- *   @brief Given a thread pointer, arguements towards thread pointer, stack address to thread pointer, and stack size, we can setup the isr interrupts for thread.
- *   @note Called whenever we add another thread.
- *   @param will_os_thread_func_t thread pointer to program counter start of thread
- *   @param void *arg address pointer of arguements to pass into will-os
- *   @param void *stack_addr pointer to the begining of the stack address.
- *   @param int stack_size size of the stack for this thread
- *   @returns pointer to the new threadstack.
+ * @brief Lowers the thread's untouched stack bytes to what a scan found, paint never comes back so it only goes down.
  */
-void *os_loadstack(thread_func_t p, void *arg, void *stackaddr, int stack_size)
+static inline void os_stack_scan_done(thread_t *thread, int offset)
 {
-
-  interrupt_stack_t *process_frame = (interrupt_stack_t *)((uint8_t *)stackaddr + stack_size - sizeof(interrupt_stack_t) - 8);
-  // Clearing up and setting all the registers.
-  process_frame->r0 = (uint32_t)arg;
-  process_frame->r1 = 0;
-  process_frame->r2 = 0;
-  process_frame->r3 = 0;
-  process_frame->r12 = 0;
-  process_frame->lr = (uint32_t)os_del_process;
-  process_frame->pc = ((uint32_t)p);
-  process_frame->xpsr = 0x1000000;
-  uint8_t *ret = (uint8_t *)process_frame;
-  return (void *)ret;
+  if (offset < thread->stack_untouched)
+    thread->stack_untouched = offset;
 }
 
 /*!
- * @brief Adds a thread to Will-OS Kernel
- * @note Paralelism at it's finest!
- * @param will_os_thread_func_t thread(pointer to thread function call begining of program counter)
- * @param void *arg(pointer arguement to parameters for thread)
- * @param void *stack(pointer to begining of thread stack)
- * @param int stack_size(size of the allocated threadstack)
- * @returns none
+ * @returns whether or not a thread has a painted stack we can scan
  */
-os_thread_id_t os_add_thread(thread_func_t p, void *arg, uint8_t thread_priority, int stack_size, void *stack)
+static inline bool os_stack_scannable(thread_t *thread)
 {
-  int old_state = os_stop();
+  return thread->flags != THREAD_EMPTY && thread->flags != THREAD_ENDED && thread->stack != NULL && thread->stack_untouched >= 0;
+}
 
-  // If we don't allocate a valid stack size, then we just choose the default stack size
-  if (stack_size == -1)
-    stack_size = OS_DEFAULT_STACK_SIZE;
+/*!
+ * @brief Checks the next few words of the thread stack we are scanning for it's high water mark
+ * @note Run from the idle thread, a thread's stack scan is spread out over as many passes as it takes.
+ */
+static void os_stack_scan_step(void)
+{
+  // So the thread and it's stack can't be swapped out from under us partway through.
+  os_sched_lock();
+  thread_t *thread = os_thread_slot(stack_scan_thread);
 
-  for (int i = 1; i < MAX_THREADS; i++)
+  // If the slot got a new thread since we last looked, we start over on the new stack.
+  if (os_stack_scannable(thread) && thread->stack == stack_scan_stack)
   {
+    if (os_stack_scan_words(thread, &stack_scan_offset, OS_STACK_SCAN_WORDS))
+    {
+      os_stack_scan_done(thread, stack_scan_offset);
+      stack_scan_stack = NULL;
+    }
+  }
+  else
+    stack_scan_stack = NULL;
 
-    if (system_threads[i].flags == THREAD_ENDED || system_threads[i].flags == THREAD_EMPTY)
-    {                                    // free thread
-      thread_t *tp = &system_threads[i]; // working on this thread
-
-      // If there was a previously allocated stack and it was allocated by the previous innstance
-      if (tp->stack && tp->my_stack)
-        delete[] tp->stack;
-
-      // If there is no stack allocated, then we allocate our own
-      if (stack == NULL)
+  // Moving on to the next thread with a painted stack.
+  if (stack_scan_stack == NULL)
+  {
+    for (int n = 0; n < thread_slot_count; n++)
+    {
+      stack_scan_thread = (stack_scan_thread + 1) % thread_slot_count;
+      thread = os_thread_slot(stack_scan_thread);
+      if (os_stack_scannable(thread))
       {
-        stack = new uint8_t[stack_size];
-        tp->my_stack = 1;
+        stack_scan_stack = thread->stack;
+        stack_scan_offset = os_stack_scan_start(thread);
+        break;
       }
-      // Otherwise our stack is defined by something else!
-      else
-        tp->my_stack = 0;
-
-      // Preconfigure all the propper variables
-      tp->stack = (uint8_t *)stack;
-      tp->stack_size = stack_size;
-      void *psp = os_loadstack(p, arg, tp->stack, tp->stack_size);
-      tp->sp = psp;
-      tp->ticks = OS_DEFAULT_TICKS;
-      tp->flags = THREAD_RUNNING;
-      tp->save.lr = 0xFFFFFFF9;
-      current_active_state = old_state;
-      thread_count++;
-
-      // How important is this thread?
-      // Note that since we put that in the priority thread,
-      tp->thread_priority = thread_priority;
-
-      // If the operating system was started before, we restart the OS
-      if (old_state == OS_STARTED || old_state == OS_FIRST_RUN)
-        os_start();
-
-      // Inserts thread into a priority heap, allowing us to organize threads by priority.
-      thread_priorities.insert((void *)tp, (uint16_t)thread_priority);
-
-      return i;
     }
   }
+  os_sched_unlock();
+}
 
-  if (old_state == OS_STARTED)
-    os_start();
+/*!
+ * @returns The thread if it exists and it's stack was painted, NULL otherwise
+ */
+static inline thread_t *os_stack_thread(os_thread_id_t target_thread_id)
+{
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  return thread != NULL && os_stack_scannable(thread) ? thread : NULL;
+}
 
-  return -1;
+/*!
+ * @brief Deepest a thread's stack has ever been, as of the idle thread's last pass over it
+ * @note Constant time, the idle thread keeps it up to date a few words at a time in the background.
+ * @param os_thread_id_t target_thread_id
+ * @returns Bytes of stack used at the high water mark, or -1 if the thread doesn't exist or it's stack wasn't painted
+ */
+int os_get_stack_high_water(os_thread_id_t target_thread_id)
+{
+  thread_t *thread = os_stack_thread(target_thread_id);
+  if (thread == NULL)
+    return -1;
+  return thread->stack_size - thread->stack_untouched;
 }
 
 /*!
- * @brief Adds a thread to Will-OS Kernel
- * @note Paralelism at it's finest!
- * @param will_os_thread_func_t thread(pointer to thread function call begining of program counter)
- * @param void *arg(pointer arguement to parameters for thread)
- * @param void *stack(pointer to begining of thread stack)
- * @param int stack_size(size of the allocated threadstack)
- * @returns none
+ * @brief Scans a thread's whole stack for it's high water mark right now
+ * @note Takes time in the size of the stack, the scheduler is held off while we scan.
+ * @param os_thread_id_t target_thread_id
+ * @returns Bytes of stack used at the high water mark, or -1 if the thread doesn't exist or it's stack wasn't painted
  */
-os_thread_id_t os_add_thread(thread_func_t p, void *arg, int stack_size, void *stack) { return os_add_thread(p, arg, 128, stack_size, stack); }
+int os_scan_stack_high_water(os_thread_id_t target_thread_id)
+{
+  os_sched_lock();
+  int high_water = -1;
+  thread_t *thread = os_stack_thread(target_thread_id);
+  if (thread != NULL)
+  {
+    int offset = os_stack_scan_start(thread);
+    os_stack_scan_words(thread, &offset, thread->stack_size / 4);
+    os_stack_scan_done(thread, offset);
+    high_water = thread->stack_size - thread->stack_untouched;
+  }
+  os_sched_unlock();
+  return high_water;
+}
 
 /*!
- *   @brief Allows us to change the Will-OS System tick.
- *   @note If you want more precision in your system ticks, take care of this here.
- *   @param int tick_microseconds
- *   @returns none
+ * @returns Stack size we would recommend for a thread with this high water mark
  */
-bool os_set_microsecond_timer(int tick_microseconds)
+static int os_recommend_stack_size(thread_t *thread, int high_water)
 {
-  // return t4_gpt_init(tick_microseconds);
+  int margin = high_water * OS_STACK_MARGIN_PERCENT / 100;
+  if (margin < OS_STACK_MARGIN_MIN_BYTES)
+    margin = OS_STACK_MARGIN_MIN_BYTES;
+  int recommended = high_water + margin;
+
+  // FPU threads have their save area carved off the top, with up to 7 bytes lost to aligning it.
+  if (thread->save.fpu_save != NULL)
+    recommended += sizeof(software_fpu_stack_t) + 7;
+
+#ifdef OS_STACK_GUARD
+  // Same goes for the guard at the bottom, which can land anywhere in it's first guard sized block.
+  if (thread->guard_rbar)
+    recommended += 2 * OS_STACK_GUARD_SIZE - 1;
+#endif
+  recommended = (recommended + 7) & ~7;
+  return recommended;
+}
 
-  return false;
+/*!
+ * @brief Stack size we would give os_add_thread() for this thread, based off it's high water mark and the safety margin
+ * @note Includes the floating point save area of FPU threads, so it can be passed straight in as the stack size.
+ * @param os_thread_id_t target_thread_id
+ * @returns Recommended stack size in bytes, or -1 if the thread doesn't exist or it's stack wasn't painted
+ */
+int os_get_recommended_stack_size(os_thread_id_t target_thread_id)
+{
+  int high_water = os_scan_stack_high_water(target_thread_id);
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (high_water < 0 || thread == NULL)
+    return -1;
+  return os_recommend_stack_size(thread, high_water);
+}
+
+/*!
+ * @brief Prints every thread's stack size, high water mark and the stack size we would recommend instead
+ * @note Only as good as the workload that ran before it, so run the worst case first.
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_stack_report(Print *out)
+{
+  int total_size = 0;
+  int total_recommended = 0;
+
+  out->printf("%4s %4s %5s %8s %8s %6s %10s\n", "id", "prio", "state", "size", "peak", "peak%", "recommend");
+  for (int n = 0; n < thread_slot_count; n++)
+  {
+    // Directory can move if a thread is added while we print, so we only look slots up with the kernel stopped.
+    os_sched_lock();
+    thread_t *thread = os_thread_slot(n);
+    os_thread_id_t thread_id = os_thread_handle(thread);
+    os_sched_unlock();
+
+    int high_water = os_scan_stack_high_water(thread_id);
+    if (high_water < 0)
+      continue;
+
+    // What the thread was added with, give or take aligning the FPU save area, so it compares against the recommendation.
+    int size = thread->stack_size;
+    if (thread->save.fpu_save != NULL)
+      size = (uint8_t *)thread->save.fpu_save + sizeof(software_fpu_stack_t) - thread->stack;
+
+    int recommended = os_recommend_stack_size(thread, high_water);
+    total_size += size;
+    total_recommended += recommended;
+
+    const char *advice = "";
+    if (high_water + 8 >= thread->stack_size)
+      advice = " overflowed";
+    else if (recommended > size)
+      advice = " grow";
+    else if (recommended < size)
+      advice = " shrink";
+
+    out->printf("%4d %4u %5d %8d %8d %6.1f %10d%s\n", (int)thread_id, (unsigned)thread->thread_priority, (int)thread->flags, size, high_water,
+                100.0f * (float)high_water / (float)thread->stack_size, recommended, advice);
+  }
+  out->printf("stacks use %d bytes, %d bytes with the recommended sizes\n", total_size, total_recommended);
 }
 
 /*!
  * @brief Sets the state of a thread to suspended.
  * @brief If thread doesn't exist, then
+ * @note A thread that was blocked or sleeping is taken off it's wait queue and wake timer, so once it's resumed it comes back
+ * @note from whatever it was waiting on without getting it, the same as a spurious wakeup.
  * @param Which thread are we trying to get our state for
  * @returns os_thread_id_t
  */
 os_thread_id_t os_suspend_thread(os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
   {
-    system_threads[target_thread_id].flags = THREAD_SUSPENDED;
+    // Ended threads are waiting on the scheduler to give their slot back, suspending them would keep it forever.
+    if (thread->flags != THREAD_ENDED)
+    {
+      // Otherwise a kernel object could hand itself to us, or our timer could wake us, while we're suspended.
+      if (thread->wait_queue != NULL || thread->flags != THREAD_RUNNING)
+      {
+        os_wait_queue_unlink(thread);
+        wake_timers.cancel(&thread->wake_timer);
+        thread->wake_status = THREAD_WAKE_NONE;
+      }
+      thread->flags = THREAD_SUSPENDED;
+    }
+    os_sched_unlock();
     return target_thread_id;
   }
+  os_sched_unlock();
   // Otherwise tell system that thread doesn't exist.
   return THREAD_DNE;
 }
@@ -707,11 +2639,18 @@ os_thread_id_t os_suspend_thread(os_thread_id_t target_thread_id)
  */
 os_thread_id_t os_resume_thread(os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
   {
-    system_threads[target_thread_id].flags = THREAD_RUNNING;
+    // Suspended threads were taken out of the ready set, so they have to be put back in.
+    // Suspending took them off any wait queue, so nothing else can wake them up in the meantime.
+    if (thread->flags == THREAD_SUSPENDED && thread->wait_queue == NULL)
+      os_sched_wake(thread);
+    os_sched_unlock();
     return target_thread_id;
   }
+  os_sched_unlock();
   // Otherwise tell system that thread doesn't exist.
   return THREAD_DNE;
 }
@@ -719,16 +2658,40 @@ os_thread_id_t os_resume_thread(os_thread_id_t target_thread_id)
 /*!
  * @brief Sets the state of a thread to be killed
  * @brief If thread doesn't exist or hasn't been run before, then
- * @note One of the biggest limitations of this atm, is that we don't deallocate the thread stack space until we create another thread.
- * @note in the future we should work on this
- * @note Meaning
+ * @note It's slot and stack are given back as soon as it's switched out, right away if it isn't the one running.
+ * @note Mutexes it held stay locked, there's no one left to unlock them. Threads waiting on them stop lending it their priority.
  * @param Which thread are we trying to get our state for
  * @returns os_thread_id_t
  */
 os_thread_id_t os_kill_thread(os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
-    system_threads[target_thread_id].flags = THREAD_ENDED;
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+  {
+    // Dead threads can't be left on a kernel object's wait queue or in the timing wheel.
+    os_wait_queue_unlink(thread);
+    wake_timers.cancel(&thread->wake_timer);
+    thread->flags = THREAD_ENDED;
+
+    // We can't give back the slot of the thread we are running on until we are switched out of it, the scheduler does that.
+    if (thread != current_thread)
+    {
+      os_sched_unlink(thread);
+      os_thread_free(thread);
+    }
+    else
+    {
+      // Any lock our caller still holds is never going to be unlocked, so the unlock below is the last one.
+      // If they had the kernel stopped too, it's started back up so we actually get switched out.
+      sched_lock_depth = 1;
+      if (sched_lock_state == OS_STOPPED)
+        sched_lock_state = OS_STARTED;
+    }
+    os_sched_unlock();
+    return target_thread_id;
+  }
+  os_sched_unlock();
   // Otherwise tell system that thread doesn't exist.
   return THREAD_DNE;
 }
@@ -750,11 +2713,86 @@ void os_kill_self_thread(void)
  */
 thread_state_t os_get_thread_state(os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
-    return system_threads[target_thread_id].flags;
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+    return thread->flags;
   return THREAD_DNE;
 }
 
+/*!
+ * @brief 64 bit version of millis() that doesn't wrap around
+ * @note Same clock as os_micros64(), so the two can be mixed.
+ * @returns milliseconds since startup
+ */
+uint64_t os_millis64(void)
+{
+  return os_micros64() / 1000;
+}
+
+/*!
+ * @brief Last count we read off the clock and how many times it wrapped, to make it 64 bits.
+ */
+static uint32_t clock_last_count = 0;
+static uint32_t clock_wraps = 0;
+
+/*!
+ * @brief Where the clock was when the general purpose timer took over, so it carries on from there.
+ */
+static uint64_t clock_base_us = 0;
+
+#if defined(__IMXRT1062__)
+/*!
+ * @brief Whether or not the general purpose timer is running as the kernel clock yet
+ * @note Until then, and if there isn't a free timer, the clock runs off micros().
+ */
+static bool clock_started = false;
+
+/*!
+ * @brief Starts the general purpose timer as the kernel clock
+ */
+static void os_clock_start(void)
+{
+  uint32_t irq_state = os_irq_lock();
+  uint64_t now = os_micros64();
+  if (t4_gpt_init(OS_TICKLESS_MAX_SLEEP_US))
+  {
+    // Timer counts up from zero, so it picks up from wherever micros() got to.
+    clock_base_us = now;
+    clock_last_count = 0;
+    clock_wraps = 0;
+    clock_started = true;
+  }
+  os_irq_unlock(irq_state);
+}
+#endif
+
+/*!
+ * @brief 64 bit monotonic microsecond clock, what every sleep and timeout in the kernel runs on
+ * @note On the Teensy 4 it counts on a free running general purpose timer off the 24MHz oscillator,
+ * @note so unlike the cycle counter it doesn't stop when the core sleeps or change when the core clock does.
+ * @note Needs to be called at least once every 71 minutes, which the scheduler takes care of.
+ * @returns microseconds since startup
+ */
+uint64_t os_micros64(void)
+{
+  // Can be called from both threads and the context switch, so keep the check and update together.
+  uint32_t irq_state = os_irq_lock();
+
+#if defined(__IMXRT1062__)
+  uint32_t now = clock_started ? t4_gpt_count() : micros();
+#else
+  uint32_t now = micros();
+#endif
+  if (now < clock_last_count)
+    clock_wraps++;
+  clock_last_count = now;
+  uint64_t ret = clock_base_us + (((uint64_t)clock_wraps << 32) | now);
+
+  os_irq_unlock(irq_state);
+
+  return ret;
+}
+
 /*!
  * @returns The current thread's ID.
  */
@@ -776,11 +2814,25 @@ thread_t *_os_current_thread(void)
  */
 int os_get_stack_used(os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
-    return system_threads[target_thread_id].stack + system_threads[target_thread_id].stack_size - (uint8_t *)system_threads[target_thread_id].sp;
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+    return thread->stack + thread->stack_size - (uint8_t *)thread->sp;
   return -1;
 }
 
+/*!
+ * @brief Sets signal bits on a thread, and wakes it up if it was waiting on one of them
+ * @note Scheduler has to be locked.
+ * @param thread_t *thread
+ * @param uint32_t bits
+ */
+static void os_thread_set_bits(thread_t *thread, uint32_t bits)
+{
+  thread->thread_set_flags |= bits;
+  if (thread->signal_waiters.head == thread && (thread->signal_bits_compare & thread->thread_set_flags))
+    os_wait_queue_wake(thread);
+}
+
 /*!
  * @brief Allows us to send signals to each thread by setting a bitmask
  * @note This uses preset flags to allow us to set and clear clags in a thread
@@ -788,7 +2840,9 @@ int os_get_stack_used(os_thread_id_t target_thread_id)
  */
 void os_thread_signal(thread_signal_t thread_signal)
 {
-  system_threads[current_thread_id].thread_set_flags |= (1 << (uint32_t)thread_signal);
+  os_sched_lock();
+  os_thread_set_bits(current_thread, (1 << (uint32_t)thread_signal));
+  os_sched_unlock();
 }
 
 /*!
@@ -798,7 +2852,9 @@ void os_thread_signal(thread_signal_t thread_signal)
  */
 void os_thread_clear(thread_signal_t thread_signal)
 {
-  system_threads[current_thread_id].thread_set_flags &= ~(1 << (uint32_t)thread_signal);
+  os_sched_lock();
+  current_thread->thread_set_flags &= ~(1 << (uint32_t)thread_signal);
+  os_sched_unlock();
 }
 
 /*!
@@ -809,12 +2865,100 @@ void os_thread_clear(thread_signal_t thread_signal)
  */
 bool os_signal_thread(thread_signal_t thread_signal, os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
+  // Kernel is stopped so an interrupt signalling the same thread can't get lost halfway through.
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+    os_thread_set_bits(thread, (1 << (uint32_t)thread_signal));
+  os_sched_unlock();
+  return thread != NULL;
+}
+
+/*!
+ * @brief Sets signal bits on a thread on behalf of an interrupt
+ * @note Looked up by id once we get here, if the request sat in the queue the slot might have gone to another thread since.
+ * @param void *object unused
+ * @param void *data os_thread_id_t of the thread we are signalling
+ * @param uint32_t arg bits we are setting
+ */
+static bool os_signal_thread_isr_request(void *object, void *data, uint32_t arg)
+{
+  (void)object;
+  thread_t *thread = os_thread_lookup((os_thread_id_t)(intptr_t)data);
+  if (thread == NULL)
+    return false;
+  os_thread_set_bits(thread, arg);
+  return true;
+}
+
+/*!
+ * @brief Interrupt safe version of os_signal_thread()
+ * @note Never blocks, see os_isr_request() for how it gets to the kernel.
+ * @param thread_signal_t thread_signal(there are 32 thread signals per thread)
+ * @param os_thread_id_t target_thread_id which thread we want to signal
+ * @returns false if the thread doesn't exist or the signal had to be dropped
+ */
+bool os_signal_thread_from_isr(thread_signal_t thread_signal, os_thread_id_t target_thread_id)
+{
+  return os_isr_request(&os_signal_thread_isr_request, NULL, (void *)(intptr_t)target_thread_id, (1 << (uint32_t)thread_signal));
+}
+
+/*!
+ * @brief Runs every interrupt request that was queued while the kernel was stopped
+ * @note Called with kernel interrupts masked and the kernel stopped.
+ */
+static void os_isr_requests_run(void)
+{
+  while (isr_request_tail != isr_request_head)
   {
-    system_threads[target_thread_id].thread_set_flags |= (1 << (uint32_t)thread_signal);
-    return true;
+    os_isr_request_t *request = &isr_requests[isr_request_tail];
+    request->func(request->object, request->data, request->arg);
+    isr_request_tail = (isr_request_tail + 1) % OS_ISR_REQUEST_QUEUE_LEN;
   }
-  return false;
+}
+
+/*!
+ * @brief Runs a kernel operation on behalf of an interrupt, used to build all the *_from_isr calls.
+ * @note If no thread is in the middle of changing kernel state, the operation runs right away with kernel interrupts masked.
+ * @note Otherwise it's queued up and runs as soon as that thread restarts the kernel.
+ * @note Either way, a context switch is pended if a thread with a higher priority than the running one became ready.
+ * @param os_isr_request_func_t func operation to run, called with the kernel stopped and kernel interrupts masked
+ * @param void *object
+ * @param void *data
+ * @param uint32_t arg
+ * @returns What the operation returned if it ran right away, true if it was queued, false if the queue was full and it got dropped.
+ */
+bool os_isr_request(os_isr_request_func_t func, void *object, void *data, uint32_t arg)
+{
+  // Might be nested in another interrupt that's doing the same, os_irq_unlock() puts back whatever mask that one had.
+  uint32_t irq_state = os_irq_lock();
+
+  bool ret = true;
+
+  // Threads only change kernel state with the kernel stopped, and the context switch runs with kernel interrupts masked,
+  // So if the kernel is running nobody is halfway through anything and we can go ahead.
+  if (current_active_state == OS_STARTED)
+  {
+    ret = func(object, data, arg);
+  }
+  else
+  {
+    uint32_t next_head = (isr_request_head + 1) % OS_ISR_REQUEST_QUEUE_LEN;
+    if (next_head == isr_request_tail)
+      ret = false;
+    else
+    {
+      isr_requests[isr_request_head].func = func;
+      isr_requests[isr_request_head].object = object;
+      isr_requests[isr_request_head].data = data;
+      isr_requests[isr_request_head].arg = arg;
+      isr_request_head = next_head;
+    }
+  }
+
+  os_irq_unlock(irq_state);
+
+  return ret;
 }
 
 /**
@@ -824,11 +2968,7 @@ bool os_signal_thread(thread_signal_t thread_signal, os_thread_id_t target_threa
  */
 thread_t *os_get_indexed_thread(os_thread_id_t thread_id)
 {
-  if (thread_id < thread_count)
-  {
-    return &system_threads[thread_id];
-  }
-  return NULL;
+  return os_thread_lookup(thread_id);
 }
 
 /*!
@@ -839,12 +2979,13 @@ thread_t *os_get_indexed_thread(os_thread_id_t thread_id)
  */
 bool os_signal_thread_clear(thread_signal_t thread_signal, os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
-  {
-    system_threads[target_thread_id].thread_set_flags &= ~(1 << (uint32_t)thread_signal);
-    return true;
-  }
-  return false;
+  // Kernel is stopped so an interrupt signalling the same thread can't get lost halfway through.
+  os_sched_lock();
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
+    thread->thread_set_flags &= ~(1 << (uint32_t)thread_signal);
+  os_sched_unlock();
+  return thread != NULL;
 }
 
 /*!
@@ -855,9 +2996,10 @@ bool os_signal_thread_clear(thread_signal_t thread_signal, os_thread_id_t target
  */
 thread_signal_status_t os_checkbits_thread(thread_signal_t thread_signal, os_thread_id_t target_thread_id)
 {
-  if (target_thread_id < thread_count)
+  thread_t *thread = os_thread_lookup(target_thread_id);
+  if (thread != NULL)
   {
-    if (OS_CHECK_BIT(system_threads[target_thread_id].thread_set_flags, (uint32_t)thread_signal))
+    if (OS_CHECK_BIT(thread->thread_set_flags, (uint32_t)thread_signal))
       return THREAD_SIGNAL_SET;
     return THREAD_SIGNAL_CLEAR;
   }
@@ -871,33 +3013,48 @@ thread_signal_status_t os_checkbits_thread(thread_signal_t thread_signal, os_thr
  */
 thread_signal_status_t os_thread_checkbits(thread_signal_t thread_signal)
 {
-  if (OS_CHECK_BIT(system_threads[current_thread_id].thread_set_flags, (uint32_t)thread_signal))
+  if (OS_CHECK_BIT(current_thread->thread_set_flags, (uint32_t)thread_signal))
     return THREAD_SIGNAL_SET;
   return THREAD_SIGNAL_CLEAR;
 }
 
 /*!
  * @brief Hangs thread until either timeout or until thread signal bits have been set
- * @note Best not to
- *
+ * @param thread_signal_t thread_signal
+ * @param uint32_t timeout_ms, 0 to wait for as long as it takes
  */
 thread_signal_status_t os_thread_waitbits(thread_signal_t thread_signal, uint32_t timeout_ms)
 {
-  if (os_thread_checkbits(thread_signal) == THREAD_SIGNAL_SET)
-    return THREAD_SIGNAL_SET;
+  return os_thread_waitbits_us(thread_signal, (uint64_t)timeout_ms * 1000);
+}
 
-  uint32_t start = millis();
+/*!
+ * @brief Hangs thread until either timeout or until thread signal bits have been set
+ * @param thread_signal_t thread_signal
+ * @param uint64_t timeout_us, 0 to wait for as long as it takes
+ */
+thread_signal_status_t os_thread_waitbits_us(thread_signal_t thread_signal, uint64_t timeout_us)
+{
+  // Lock the scheduler so a signal can't come in between checking and going to sleep.
+  os_sched_lock();
 
-  while (1)
+  while (os_thread_checkbits(thread_signal) != THREAD_SIGNAL_SET)
   {
-    if (os_thread_checkbits(thread_signal) == THREAD_SIGNAL_SET)
+    // We're the only one ever on our own wait queue, we sleep there until os_signal_thread() wakes us or we time out.
+    current_thread->signal_bits_compare = (1 << (uint32_t)thread_signal);
+    thread_state_t block_state = timeout_us ? THREAD_BLOCKED_SIGNAL_TIMEOUT : THREAD_BLOCKED_SIGNAL;
+    if (os_wait_queue_block(&current_thread->signal_waiters, block_state, timeout_us) == THREAD_WAKE_SIGNALED)
       return THREAD_SIGNAL_SET;
 
-    if (timeout_ms && (millis() - start > timeout_ms))
-      return THREAD_SIGNAL_TIMEOUT;
+    // Timed out, or never went to sleep. The bit might have been set in the meantime anyway.
+    if (timeout_us)
+      return (os_thread_checkbits(thread_signal) == THREAD_SIGNAL_SET) ? THREAD_SIGNAL_SET : THREAD_SIGNAL_TIMEOUT;
 
-    _os_yield();
+    os_sched_lock();
   }
+
+  os_sched_unlock();
+  return THREAD_SIGNAL_SET;
 }
 
 /*!
@@ -906,10 +3063,5 @@ thread_signal_status_t os_thread_waitbits(thread_signal_t thread_signal, uint32_
  */
 void os_thread_waitbits_notimeout(thread_signal_t thread_signal)
 {
-  while (1)
-  {
-    if (os_thread_checkbits(thread_signal) == THREAD_SIGNAL_SET)
-      return;
-    _os_yield();
-  }
+  os_thread_waitbits_us(thread_signal, 0);
 }
\ No newline at end of file
@@ -38,13 +38,28 @@ Last Edit Date: 8/9/2020
 #include <Arduino.h>
 #include <stdint.h>
 
+// So we can configure modules
+#include "enabled_modules.h"
+
 // So we can malloc stuff on our faster memory
 #include "DS_HELPER/fast_malloc.hpp"
 
 /*!
- * @brief Allows us to have priority to our scheduled threads.
+ * @brief Keeps track of every sleep and blocking timeout in the kernel.
  */
-#include "DS_HELPER/priority_queue.hpp"
+#include "DS_HELPER/timing_wheel.hpp"
+#include "DS_HELPER/deadline_heap.hpp"
+
+// Keeps track of the next wake deadline so the kernel timer fires right when a thread needs to wake up.
+#include "OSTicklessKernel.h"
+
+#if defined(OS_PORT_POSIX)
+// Host port, stands in for the Cortex-M when the kernel runs as a normal process.
+#include "OSPortPosix.h"
+#elif defined(OS_PORT_MPS2)
+// QEMU MPS2 board, the same Cortex-M kernel with CMSDK timers standing in for the Teensy's.
+#include "OSPortMps2.h"
+#endif
 
 /*!
  * @brief Enumerated State of different operating system states.
@@ -78,18 +93,93 @@ enum thread_state_t
   THREAD_BLOCKED_SIGNAL = 10,
   THREAD_BLOCKED_SIGNAL_TIMEOUT = 11,
   THREAD_BLOCKED_QUEUE = 12,
+  THREAD_BLOCKED_FUTEX = 13,
+  THREAD_BLOCKED_FUTEX_TIMEOUT = 14,
+};
+
+/*!
+ *   @brief How many thread control blocks we allocate at a time when the thread table runs out, has to be a power of 2
+ *   @note There's no thread limit besides memory, the table grows a slab at a time and slabs are never given back.
+ *   @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_THREAD_SLAB_LEN
+static const int OS_THREAD_SLAB_LEN = 8;
+#else
+static const int OS_THREAD_SLAB_LEN = EXTERN_OS_THREAD_SLAB_LEN;
+#endif
+
+/*!
+ *   @brief Bits of an os_thread_id_t that say which slot of the thread table the thread is in, the rest count how many times the slot was reused
+ */
+static const int OS_THREAD_INDEX_BITS = 15;
+static const int OS_THREAD_MAX_SLOTS = 1 << OS_THREAD_INDEX_BITS;
+
+/*!
+ * @brief Number of distinct thread priorities the scheduler supports
+ * @note Priorities are a uint8_t, higher number means higher priority. The idle thread sits at 0.
+ */
+static const int OS_NUM_PRIORITIES = 256;
+
+/*!
+ * @brief Which scheduler list a thread is currently linked into
+ * @note A thread is either ready to run, or not tracked by the scheduler at all.
+ * @note Threads that aren't ready are woken up by a kernel object's wait queue or their wake timer.
+ */
+enum thread_sched_list_t
+{
+  THREAD_LIST_NONE = 0,
+  THREAD_LIST_READY = 1,
+  THREAD_LIST_EDF = 2
+};
+
+/*!
+ * @brief How the scheduler decides when a thread runs
+ */
+enum thread_sched_class_t
+{
+  // Fixed priority, round robin between threads of the same priority.
+  THREAD_CLASS_PRIORITY = 0,
+  // Earliest deadline first, between every ready thread in the class.
+  THREAD_CLASS_EDF = 1
 };
 
 /*!
- *   @brief Maximum amount of threads the Will-OS supports
- *   @note Unless we transition to a linked list(which is unlikely), this will remain the max limit
+ * @brief Priority the earliest deadline first class as a whole runs at against fixed priority threads
+ * @note EDF threads go ahead of fixed priority threads of the same priority.
+ * @note Can be defined as a preprocessor command
  */
-#ifndef OS_EXTERN_MAX_THREADS
-static const int MAX_THREADS = 24;
+#ifndef EXTERN_OS_EDF_PRIORITY
+static const uint8_t OS_EDF_PRIORITY = 200;
 #else
-static const int MAX_THREADS = OS_EXTERN_MAX_THREADS;
+static const uint8_t OS_EDF_PRIORITY = EXTERN_OS_EDF_PRIORITY;
 #endif
 
+/*!
+ * @brief Why a thread blocked on a kernel object was woken back up
+ */
+enum thread_wake_status_t
+{
+  THREAD_WAKE_NONE = 0,
+  THREAD_WAKE_SIGNALED = 1,
+  THREAD_WAKE_TIMEOUT = 2
+};
+
+/*!
+ * @brief Wait queue owned by a kernel object(mutex, semaphore, signal, queue)
+ * @note Intrusive list of blocked threads through their wait_next/wait_prev links, highest priority first.
+ * @note Queues with an owner(mutexes) lend the priority of their highest waiter to the owner.
+ */
+typedef struct os_wait_queue_t
+{
+  struct thread_t *head = NULL;
+
+  // Thread holding the kernel object, NULL if the object doesn't track ownership or isn't held.
+  struct thread_t *owner = NULL;
+
+  // Next queue owned by the same thread.
+  struct os_wait_queue_t *owned_next = NULL;
+} os_wait_queue_t;
+
 /*!
  * @brief Default Tick set to 100 microseconds per tick
  * @note As far as I know, this isn't the real tick, considering ISR happens 1,000/s not 10,000/s
@@ -172,36 +262,12 @@ typedef struct
 } interrupt_stack_t;
 
 /*!
- *   @brief Stack frame saved by context switch
- *   @note Used for switching between threads, we save all relevant registers between threads somewhere, and get them when needed
+ *   @brief Floating point registers saved by context switch
+ *   @note Only s16-s31, s0-s15 and the FPSCR are lazily stacked by the hardware in the interrupt frame.
+ *   @note Only threads that have used the FPU ever get these saved and restored.
  */
 typedef struct
 {
-  uint32_t r4;
-  uint32_t r5;
-  uint32_t r6;
-  uint32_t r7;
-  uint32_t r8;
-  uint32_t r9;
-  uint32_t r10;
-  uint32_t r11;
-  uint32_t lr;
-  uint32_t s0;
-  uint32_t s1;
-  uint32_t s2;
-  uint32_t s3;
-  uint32_t s4;
-  uint32_t s5;
-  uint32_t s6;
-  uint32_t s7;
-  uint32_t s8;
-  uint32_t s9;
-  uint32_t s10;
-  uint32_t s11;
-  uint32_t s12;
-  uint32_t s13;
-  uint32_t s14;
-  uint32_t s15;
   uint32_t s16;
   uint32_t s17;
   uint32_t s18;
@@ -218,14 +284,102 @@ typedef struct
   uint32_t s29;
   uint32_t s30;
   uint32_t s31;
-  uint32_t fpscr;
+} software_fpu_stack_t;
+
+#if defined(OS_PORT_POSIX)
+/*!
+ *   @brief Context saved by the host port's context switch
+ *   @note The host saves every register in the ucontext, floating point included.
+ */
+typedef struct
+{
+  os_port_context_t context;
+  software_fpu_stack_t *fpu_save;
+} software_stack_t;
+#else
+/*!
+ *   @brief Stack frame saved by context switch
+ *   @note Used for switching between threads, we save all relevant registers between threads somewhere, and get them when needed
+ *   @note Layout is shared with the context switch assembly, fpu_save has to come right after lr.
+ */
+typedef struct
+{
+  uint32_t r4;
+  uint32_t r5;
+  uint32_t r6;
+  uint32_t r7;
+  uint32_t r8;
+  uint32_t r9;
+  uint32_t r10;
+  uint32_t r11;
+  uint32_t lr;
+  // Where s16-s31 go if the thread has used the FPU, NULL for integer only threads.
+  software_fpu_stack_t *fpu_save;
 } software_stack_t;
+#endif
+
+/*!
+ *   @brief Whether or not a thread gets it's floating point registers saved on a context switch
+ */
+enum thread_fpu_mode_t
+{
+  // Thread can use the FPU, we reserve room to save s16-s31 at the top of it's stack.
+  THREAD_FPU_ENABLED = 0,
+  // Thread never touches the FPU, so it gets the full stack and a smaller save area.
+  THREAD_INTEGER_ONLY = 1
+};
+
+/*!
+ * @brief How many buckets the lateness histogram of a periodic thread has
+ * @note Bucket 0 is jobs that made their deadline, bucket n is jobs that were late by less than 2^(n-1) milliseconds,
+ * @note and the last bucket is everything later than that.
+ */
+#define OS_PERIODIC_LATENESS_BUCKETS 8
+
+/*!
+ * @brief Timing records of a periodic thread
+ */
+typedef struct os_periodic_stats_t
+{
+  // How many jobs have finished
+  uint32_t jobs;
+
+  // How many jobs finished after their deadline
+  uint32_t deadline_misses;
+
+  // Longest time from a job's release until it finished, in microseconds
+  uint32_t worst_response_us;
+
+  // How late jobs were, see OS_PERIODIC_LATENESS_BUCKETS
+  uint32_t lateness_histogram[OS_PERIODIC_LATENESS_BUCKETS];
+} os_periodic_stats_t;
+
+/*!
+ * @brief Release schedule of a periodic thread
+ */
+typedef struct os_periodic_t
+{
+  // Job that runs once every period
+  void (*job)(void *arg);
+  void *job_arg;
+
+  // Time between releases
+  uint32_t period_ms;
+
+  // Time after it's release a job has to be done by
+  uint32_t deadline_ms;
+
+  // When the current job was released, in os_millis64() time
+  uint64_t release_ms;
+
+  os_periodic_stats_t stats;
+} os_periodic_t;
 
 /*!
  *   @brief Struct that contains information for each thread
  *   @note Used to deal with thread context switching
  */
-typedef struct
+typedef struct thread_t
 {
   // Size of stack
   int stack_size;
@@ -236,6 +390,9 @@ typedef struct
   // Whether or not stack was allocated by thread creation function
   int my_stack = 0;
 
+  // Size the stack pool handed our stack out with, if we got it from there.
+  int stack_alloc_size = 0;
+
   // Where we save all our registers for context switching .
   software_stack_t save;
 
@@ -245,30 +402,94 @@ typedef struct
   // Program counter register.
   void *sp;
 
-  // Thread ticks
+  // Thread ticks, how many system ticks the thread gets before the next thread at it's priority runs.
   int ticks;
 
+  // How many full time slices the thread has used up.
+  volatile uint32_t slices_consumed;
+
+  // What was left of the thread's slice when a higher priority thread preempted it, 0 for a fresh slice.
+  int ticks_left;
+
+  // THREAD CPU ACCOUNTING CODE BEGIN //
+  // CPU cycles the thread has run for, up to when it was last switched out.
+  uint64_t run_cycles;
+  // How many times the thread was switched in.
+  uint32_t switch_ins;
+  // How many times the thread was switched out because it blocked, slept, yielded or ended.
+  uint32_t voluntary_switches;
+  // How many times the thread was switched out while it still wanted to run, by a higher priority thread or the end of it's slice.
+  uint32_t preempted_switches;
+  // THREAD CPU ACCOUNTING CODE END //
+
+  // Bytes at the bottom of the stack that were still painted at the last scan, -1 if the stack was never painted.
+  int stack_untouched = -1;
+
+  // MPU region base register of the guard at the bottom of the stack, 0 if the thread doesn't have one.
+  uint32_t guard_rbar = 0;
+
+  // Which slot of the thread table this is, and how many times the slot was freed, together they make up the thread's id.
+  uint16_t slot_index = 0;
+  uint16_t generation = 0;
+
+  // Next free slot while this one sits on the free list.
+  struct thread_t *free_next = NULL;
+  bool free_listed = false;
+
+  // Release schedule and timing records if this is a periodic thread, NULL otherwise.
+  os_periodic_t *periodic = NULL;
+
+  // Which scheduling class the thread is in.
+  thread_sched_class_t sched_class = THREAD_CLASS_PRIORITY;
+
+  // Where an EDF thread sits in the EDF ready heap, keyed by the absolute deadline of it's current job.
+  DeadlineHeapNode edf_node;
+
   // Flags to set or clear signals to a thread.
   volatile uint32_t thread_set_flags = 0x0000;
 
-  // Thread priority
+  // Where the thread sleeps in os_thread_waitbits() until os_signal_thread() sets one of the bits it's waiting on.
+  os_wait_queue_t signal_waiters;
+
+  // Thread priority, the effective one the scheduler uses. Can be raised above the base priority by priority inheritance.
   uint8_t thread_priority;
 
-  // Next time the thread will run (in milliseconds)
-  uint32_t previous_millis;
-  uint32_t interval;
+  // Priority the thread was created with.
+  uint8_t base_priority;
+
+  // Wait queues of the kernel objects we own, whose waiters lend us their priority.
+  os_wait_queue_t *owned_queues = NULL;
+
+  // Wakes the thread up once it's sleep or blocking timeout runs out, sits in the kernel timing wheel.
+  TimingWheelNode wake_timer;
 
   // THREAD SIGNAL CODE BEGIN //
-  // Bits that we are waiting on for a signal
-  volatile uint32_t *signal_bit;
-  // Bits that we are comparing to.
+  // Bits that we are comparing to when we are waiting on a signal.
   volatile uint32_t signal_bits_compare;
   // THREAD SIGNAL CODE END //
 
-  // THREAD MUTEX SEMAPHORE CODE BEGIN //
-  volatile uint32_t *mutex_semaphore;
-  volatile uint32_t semaphore_max_count;
-  // THREAD MUTEX SEMAPHORE CODE END //
+  // THREAD FUTEX CODE BEGIN //
+  // Word we are sleeping on in os_wait_on(), threads waiting on other words can share our wait queue.
+  volatile uint32_t *futex_addr;
+  // THREAD FUTEX CODE END //
+
+  // THREAD WAIT QUEUE CODE BEGIN //
+  // Wait queue of the kernel object we are blocked on, NULL if we aren't blocked on anything.
+  os_wait_queue_t *wait_queue = NULL;
+  // Links in that wait queue.
+  struct thread_t *wait_next;
+  struct thread_t *wait_prev;
+  // Why we were woken up, set by whoever takes us off the wait queue.
+  volatile thread_wake_status_t wake_status;
+  // THREAD WAIT QUEUE CODE END //
+
+  // THREAD SCHEDULER CODE BEGIN //
+  // Links into the circular ready list of our priority.
+  struct thread_t *sched_next;
+  struct thread_t *sched_prev;
+  // Which of the scheduler lists we are linked into right now.
+  thread_sched_list_t sched_list = THREAD_LIST_NONE;
+  // THREAD SCHEDULER CODE END //
 
 } thread_t;
 
@@ -300,11 +521,79 @@ typedef void (*os_isr_function_t)();
  *   @brief Ensures that all memory access appearing before this program point are taken care of.
  *   @note To understand more, visit: https://www.keil.com/support/man/docs/armasm/armasm_dom1361289870356.htm
  */
+#if defined(OS_PORT_POSIX)
+#define __flush_cpu_pipeline() __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#else
 #define __flush_cpu_pipeline() __asm__ volatile("DMB");
+#endif
+
+/*!
+ * @returns Whether or not interrupts are masked right now, so code that might already be in a masked section only unmasks if it masked
+ */
+static inline uint32_t os_get_primask(void)
+{
+#if defined(OS_PORT_POSIX)
+  return os_port_irq_masked();
+#else
+  uint32_t primask;
+  __asm volatile("mrs %0, primask" : "=r"(primask));
+  return primask;
+#endif
+}
+
+/*!
+ * @brief Priority an interrupt has to be at or under(numerically at or over) to call into the kernel, it's what os_irq_lock() masks
+ * @note Interrupts more urgent than this, like motor control or encoders, are never held off by the kernel, but they must never call
+ * @note a *_from_isr function or anything else in the kernel. Systick is put at this priority, and PendSV and the general purpose timer at 255.
+ * @note Has to be a priority the chip implements, the Teensy 4 has 16 of them in steps of 16.
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_KERNEL_IRQ_PRIORITY
+static const uint8_t OS_KERNEL_IRQ_PRIORITY = 32;
+#else
+static const uint8_t OS_KERNEL_IRQ_PRIORITY = EXTERN_OS_KERNEL_IRQ_PRIORITY;
+#endif
+
+/*!
+ * @brief Masks every interrupt that can call into the kernel, for data the kernel shares with them
+ * @note On the Cortex-M it raises BASEPRI to OS_KERNEL_IRQ_PRIORITY, so interrupts more urgent than that still get in.
+ * @note Nests, hand what it returns back to os_irq_unlock(). Keep it to a few instructions, for anything longer that only threads touch use os_sched_lock().
+ * @returns The mask we had before
+ */
+static inline uint32_t os_irq_lock(void)
+{
+#if defined(OS_PORT_POSIX)
+  // Signals have no priorities, so they all get masked.
+  uint32_t masked = os_port_irq_masked();
+  os_port_irq_disable();
+  return masked;
+#else
+  uint32_t basepri;
+  __asm volatile("mrs %0, basepri" : "=r"(basepri));
+  // Only ever raises the mask, so it's fine if we were already in a more strict one.
+  __asm volatile("msr basepri_max, %0 \n isb" : : "r"((uint32_t)OS_KERNEL_IRQ_PRIORITY) : "memory");
+  return basepri;
+#endif
+}
+
+/*!
+ * @brief Puts back the interrupt mask os_irq_lock() replaced
+ * @param uint32_t prev what os_irq_lock() returned
+ */
+static inline void os_irq_unlock(uint32_t prev)
+{
+#if defined(OS_PORT_POSIX)
+  if (!prev)
+    os_port_irq_enable();
+#else
+  __asm volatile("msr basepri, %0" : : "r"(prev) : "memory");
+#endif
+}
 
 /*!
  * @brief  Thread id value
- * @note
+ * @note Slot of the thread table in the low OS_THREAD_INDEX_BITS, and the slot's generation above that.
+ * @note Once a thread is gone it's slot gets a new generation, so an old id can't reach whoever gets the slot next.
  */
 typedef int os_thread_id_t;
 
@@ -329,6 +618,12 @@ extern "C"
    */
   void context_switch_pit_isr(void);
 
+  /*!
+   * @brief PendSV handler that actually does the context switch
+   * @note Runs at the lowest priority, so switches requested from interrupts happen as soon as they unwind.
+   */
+  void context_switch_pendsv(void);
+
   /*!
    * @brief function that is to be called in assembly to access contexts for thread switching
    * @note  Should only be called for assembly use, not user use
@@ -362,6 +657,18 @@ extern "C"
  */
 extern "C" void _os_yield(void);
 
+/*!
+ * @brief Asks for a context switch as soon as every interrupt has returned
+ * @note Safe to call from any interrupt, the switch runs in PendSV once the interrupts unwind.
+ */
+void os_pend_context_switch(void);
+
+/*!
+ * @brief Asks for a context switch because the timer fired on a wake deadline
+ * @note For the ports' timer interrupts. If a thread has the kernel stopped, the switch waits for os_start().
+ */
+void os_wake_deadline_pend(void);
+
 /**
  * @brief Idle thread handler.
  * @note Whenever the OS doesn't have anything to do, we check stuff here.
@@ -385,6 +692,73 @@ void idle_thread_handler(void *paramters);
 extern void os_thread_sleep_ms(int millisecond);
 #define os_thread_delay_ms(millisecond) os_thread_sleep_ms(millisecond)
 
+/*!
+ * @brief Sleeps the thread for a number of microseconds
+ * @note The kernel timer is programmed for the wake time, so we don't have to wait for the next millisecond tick.
+ * @param uint64_t microseconds
+ */
+void os_thread_sleep_us(uint64_t microseconds);
+#define os_thread_delay_us(microseconds) os_thread_sleep_us(microseconds)
+
+/*!
+ * @brief Sleeps the thread until an absolute time
+ * @note Unlike os_thread_sleep_ms(), the time the thread spent running doesn't push the wake time back, so loops don't drift.
+ * @param uint64_t wake_ms when we want to wake up, in os_millis64() time. Returns right away if that already passed.
+ */
+void os_thread_sleep_until(uint64_t wake_ms);
+
+/*!
+ * @brief Sleeps the thread until an absolute time in microseconds
+ * @param uint64_t wake_us when we want to wake up, in os_micros64() time. Returns right away if that already passed.
+ */
+void os_thread_sleep_until_us(uint64_t wake_us);
+
+/*!
+ * @brief Adds a thread that runs a job on a fixed release schedule
+ * @note The job is released every period_ms from when the thread is added, no matter how long each job takes,
+ * @note if a job overruns the next one is released right away so the schedule stays the same.
+ * @note Every job is checked against it's deadline, see os_get_periodic_stats().
+ * @param thread_func_t job(called once every period)
+ * @param void *arg(pointer arguement to the job)
+ * @param uint8_t thread_priority (how important the thread is)
+ * @param uint32_t period_ms(time between releases)
+ * @param uint32_t deadline_ms(time after it's release each job has to be done by, 0 to use the period)
+ * @param int stack_size(size of the allocated threadstack)
+ * @param void *stack(pointer to begining of thread stack)
+ * @returns os_thread_id_t id of the thread, -1 if we couldn't add it
+ */
+os_thread_id_t os_add_periodic_thread(thread_func_t job, void *arg, uint8_t thread_priority, uint32_t period_ms, uint32_t deadline_ms, int stack_size, void *stack);
+
+/*!
+ * @brief Adds a periodic thread that's scheduled earliest deadline first
+ * @note Every EDF thread runs at OS_EDF_PRIORITY against fixed priority threads, between each other
+ * @note whoever's current job has the earliest absolute deadline runs. No priorities to hand tune,
+ * @note and any set of EDF threads whose deadlines are their periods meets every deadline as long as they use under 100% of the CPU.
+ * @param thread_func_t job(called once every period)
+ * @param void *arg(pointer arguement to the job)
+ * @param uint32_t period_ms(time between releases)
+ * @param uint32_t deadline_ms(time after it's release each job has to be done by, 0 to use the period)
+ * @param int stack_size(size of the allocated threadstack)
+ * @param void *stack(pointer to begining of thread stack)
+ * @returns os_thread_id_t id of the thread, -1 if we couldn't add it
+ */
+os_thread_id_t os_add_edf_thread(thread_func_t job, void *arg, uint32_t period_ms, uint32_t deadline_ms, int stack_size, void *stack);
+
+/*!
+ * @brief Gets the timing records of a periodic thread
+ * @param os_thread_id_t target_thread_id
+ * @param os_periodic_stats_t *stats filled in with the records
+ * @returns false if the thread isn't periodic
+ */
+bool os_get_periodic_stats(os_thread_id_t target_thread_id, os_periodic_stats_t *stats);
+
+/*!
+ * @brief Clears out the timing records of a periodic thread
+ * @param os_thread_id_t target_thread_id
+ * @returns false if the thread isn't periodic
+ */
+bool os_reset_periodic_stats(os_thread_id_t target_thread_id);
+
 /*!
  * @brief Sleeps the thread through a hypervisor call.
  * @note Checks in roughly every milliscond until thread is ready to start running again
@@ -423,9 +797,11 @@ void os_get_next_thread();
  * @param uint8_t thread_priority (how important the thread is)
  * @param void *stack(pointer to begining of thread stack)
  * @param int stack_size(size of the allocated threadstack)
+ * @param int ticks(time slice the thread gets before other threads at the same priority run, -1 for the default)
+ * @param thread_fpu_mode_t fpu_mode(THREAD_INTEGER_ONLY threads don't get their floating point registers saved, so they must never use the FPU)
  * @returns none
  */
-os_thread_id_t os_add_thread(thread_func_t p, void *arg, uint8_t thread_priority, int stack_size, void *stack);
+os_thread_id_t os_add_thread(thread_func_t p, void *arg, uint8_t thread_priority, int stack_size, void *stack, int ticks = -1, thread_fpu_mode_t fpu_mode = THREAD_FPU_ENABLED);
 
 /*!
  * @brief Adds a thread to Will-OS Kernel
@@ -446,9 +822,240 @@ os_thread_id_t os_add_thread(thread_func_t p, void *arg, int stack_size, void *s
  */
 bool os_set_microsecond_timer(int tick_microseconds);
 
+/*!
+ * @brief Changes the time slice of a thread
+ * @note Takes effect the next time the thread is switched in.
+ * @param os_thread_id_t target_thread_id
+ * @param int ticks number of system ticks the thread runs before other threads of the same priority get a turn
+ * @returns whether or not the thread exists
+ */
+bool os_set_thread_ticks(os_thread_id_t target_thread_id, int ticks);
+
+/*!
+ * @returns The time slice of a thread in system ticks, -1 if the thread doesn't exist
+ */
+int os_get_thread_ticks(os_thread_id_t target_thread_id);
+
+/*!
+ * @returns How many full time slices a thread has used up, 0 if the thread doesn't exist
+ */
+uint32_t os_get_thread_slices(os_thread_id_t target_thread_id);
+
+/*!
+ * @returns The current CPU cycle count
+ * @note Uses the DWT cycle counter when there is one, otherwise micros() scaled up to cycles.
+ */
+static inline uint32_t os_cpu_cycles(void)
+{
+#if defined(ARM_DWT_CYCCNT)
+  return ARM_DWT_CYCCNT;
+#else
+  return micros() * (F_CPU / 1000000);
+#endif
+}
+
+/*!
+ * @brief How long each bucket of the CPU load window is
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_CPU_LOAD_BUCKET_US
+static const uint32_t OS_CPU_LOAD_BUCKET_US = 100000;
+#else
+static const uint32_t OS_CPU_LOAD_BUCKET_US = EXTERN_OS_CPU_LOAD_BUCKET_US;
+#endif
+
+/*!
+ * @brief How many buckets the CPU load window slides over, so the window is OS_CPU_LOAD_BUCKETS * OS_CPU_LOAD_BUCKET_US long
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_CPU_LOAD_BUCKETS
+static const int OS_CPU_LOAD_BUCKETS = 10;
+#else
+static const int OS_CPU_LOAD_BUCKETS = EXTERN_OS_CPU_LOAD_BUCKETS;
+#endif
+
+/*!
+ * @brief Runtime statistics of a thread at the time of the snapshot
+ */
+typedef struct
+{
+  os_thread_id_t thread_id;
+  thread_state_t state;
+  uint8_t priority;
+
+  // Whether or not this is the idle thread, whose run time is the time nobody else wanted the CPU.
+  bool idle;
+
+  // CPU cycles the thread has run for, including the current run if it's running right now.
+  uint64_t run_cycles;
+
+  // How many times the thread was switched in.
+  uint32_t switch_ins;
+
+  // How many times it was switched out because it blocked, slept, yielded or ended.
+  uint32_t voluntary_switches;
+
+  // How many times it was switched out while it still wanted to run.
+  uint32_t preempted_switches;
+} os_thread_stats_t;
+
+/*!
+ * @brief Takes a snapshot of the runtime statistics of every thread
+ * @note Taken with the kernel stopped, so every thread's numbers are from the same moment.
+ * @note The idle thread's run cycles stop counting while the core sleeps in WFI, use os_get_cpu_load() for how busy the CPU is.
+ * @param os_thread_stats_t *stats array filled in with one entry for each thread
+ * @param int max_threads how many entries fit in stats
+ * @returns How many entries we filled in
+ */
+int os_get_thread_stats(os_thread_stats_t *stats, int max_threads);
+
+/*!
+ * @brief How busy the CPU was over the CPU load window
+ * @note Everything except the idle thread counts as busy, including interrupts that came in while a thread was running.
+ * @returns Percentage of the window the CPU was busy, 0-100
+ */
+float os_get_cpu_load(void);
+
+/*!
+ * @brief Prints a top style table of every thread's runtime statistics
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_thread_stats(Print *out);
+
+/*!
+ * @brief Byte every thread stack is painted with when the thread is added, so we can tell how deep it ever got.
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_STACK_PAINT
+static const uint8_t OS_STACK_PAINT = 0xA5;
+#else
+static const uint8_t OS_STACK_PAINT = EXTERN_OS_STACK_PAINT;
+#endif
+
+/*!
+ * @brief How many stack words the idle thread checks each time around, so a scan never holds off the scheduler for long
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_STACK_SCAN_WORDS
+static const int OS_STACK_SCAN_WORDS = 64;
+#else
+static const int OS_STACK_SCAN_WORDS = EXTERN_OS_STACK_SCAN_WORDS;
+#endif
+
+/*!
+ * @brief Safety margin the stack report adds on top of the deepest a thread's stack ever got, in percent and at least so many bytes
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_STACK_MARGIN_PERCENT
+static const int OS_STACK_MARGIN_PERCENT = 25;
+#else
+static const int OS_STACK_MARGIN_PERCENT = EXTERN_OS_STACK_MARGIN_PERCENT;
+#endif
+
+#ifndef EXTERN_OS_STACK_MARGIN_MIN_BYTES
+static const int OS_STACK_MARGIN_MIN_BYTES = 64;
+#else
+static const int OS_STACK_MARGIN_MIN_BYTES = EXTERN_OS_STACK_MARGIN_MIN_BYTES;
+#endif
+
+/*!
+ * @brief Deepest a thread's stack has ever been, as of the idle thread's last pass over it
+ * @note Constant time, the idle thread keeps it up to date a few words at a time in the background.
+ * @param os_thread_id_t target_thread_id
+ * @returns Bytes of stack used at the high water mark, or -1 if the thread doesn't exist or it's stack wasn't painted
+ */
+int os_get_stack_high_water(os_thread_id_t target_thread_id);
+
+/*!
+ * @brief Scans a thread's whole stack for it's high water mark right now
+ * @note Takes time in the size of the stack, the scheduler is held off while we scan.
+ * @param os_thread_id_t target_thread_id
+ * @returns Bytes of stack used at the high water mark, or -1 if the thread doesn't exist or it's stack wasn't painted
+ */
+int os_scan_stack_high_water(os_thread_id_t target_thread_id);
+
+/*!
+ * @brief Stack size we would give os_add_thread() for this thread, based off it's high water mark and the safety margin
+ * @note Includes the floating point save area of FPU threads, so it can be passed straight in as the stack size.
+ * @param os_thread_id_t target_thread_id
+ * @returns Recommended stack size in bytes, or -1 if the thread doesn't exist or it's stack wasn't painted
+ */
+int os_get_recommended_stack_size(os_thread_id_t target_thread_id);
+
+/*!
+ * @brief Prints every thread's stack size, high water mark and the stack size we would recommend instead
+ * @note Only as good as the workload that ran before it, so run the worst case first.
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_stack_report(Print *out);
+
+// MPU stack guards only exist on the Teensy 4's Cortex-M7.
+#if defined(OS_STACK_GUARD_MODULE) && defined(__IMXRT1062__)
+#define OS_STACK_GUARD
+#endif
+
+/*!
+ * @brief Size of the no access MPU region at the bottom of each thread stack, has to be a power of 2 and at least 32
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_STACK_GUARD_SIZE
+static const uint32_t OS_STACK_GUARD_SIZE = 32;
+#else
+static const uint32_t OS_STACK_GUARD_SIZE = EXTERN_OS_STACK_GUARD_SIZE;
+#endif
+
+/*!
+ * @brief MPU region we reprogram on every switch for the running thread's stack guard
+ * @note Highest region wins where regions overlap, so the guard takes over from the RAM region it sits in.
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_STACK_GUARD_REGION
+static const uint32_t OS_STACK_GUARD_REGION = 15;
+#else
+static const uint32_t OS_STACK_GUARD_REGION = EXTERN_OS_STACK_GUARD_REGION;
+#endif
+
+/*!
+ * @brief What we know about the last thread that overflowed it's stack
+ */
+typedef struct
+{
+  os_thread_id_t thread_id;
+
+  // Whether the MPU guard caught it as it happened, or the check at switch time caught it afterwards.
+  bool guard;
+
+  // Address the thread tried to touch, 0 if it overflowed pushing an interrupt frame.
+  uint32_t fault_address;
+
+  // Instruction that overflowed, 0 if we don't know.
+  uint32_t pc;
+
+  // Where the thread's stack pointer was.
+  uint32_t sp;
+
+  uint8_t *stack;
+  int stack_size;
+} os_stack_fault_t;
+
+/*!
+ * @brief Gets what we know about the last stack overflow
+ * @param os_stack_fault_t *fault filled in with the last overflow
+ * @returns How many threads have overflowed their stack since startup, 0 means fault wasn't filled in
+ */
+uint32_t os_get_stack_fault(os_stack_fault_t *fault);
+
+/*!
+ * @brief Prints which thread last overflowed it's stack and where
+ * @param Print *out where to print it, like &Serial
+ */
+void os_print_stack_fault(Print *out);
+
 /*!
  * @brief Sets the state of a thread to suspended.
  * @brief If thread doesn't exist, then
+ * @note A thread that was blocked or sleeping is taken off it's wait queue and wake timer, so once it's resumed it comes back
+ * @note from whatever it was waiting on without getting it, the same as a spurious wakeup.
  * @param Which thread are we trying to get our state for
  * @returns will_thread_state_t
  */
@@ -465,6 +1072,8 @@ os_thread_id_t os_resume_thread(os_thread_id_t target_thread_id);
 /*!
  * @brief Sets the state of a thread to dead
  * @brief If thread doesn't exist, then
+ * @note It's slot and stack are given back as soon as it's switched out, right away if it isn't the one running.
+ * @note Mutexes it held stay locked, there's no one left to unlock them. Threads waiting on them stop lending it their priority.
  * @param Which thread are we trying to get our state for
  * @returns will_thread_state_t
  */
@@ -478,6 +1087,7 @@ void os_kill_self_thread(void);
 /*!
  *   @brief Stops the entire Will-OS Kernel
  *   @note Try to avoid stopping the kernel whenever possible.
+ *   @note Only stops the scheduler, interrupts stay live. Hand what it returns back to os_start(), os_sched_lock() does that for you.
  *   @param none
  *   @returns int original state of machine
  */
@@ -491,16 +1101,81 @@ int os_stop(void);
  */
 int os_start(int prev_state = -1);
 
+/*!
+ * @brief Locks the scheduler, so the calling thread keeps running until it unlocks
+ * @note Interrupts stay live, anything they hand the kernel through a *_from_isr call waits until we unlock. So it's for data only threads touch,
+ * @note data interrupts touch too needs os_irq_lock().
+ * @note Nests, the scheduler only unlocks once every os_sched_lock() had it's os_sched_unlock(). Blocking or sleeping with it locked doesn't switch out.
+ */
+void os_sched_lock(void);
+
+/*!
+ * @brief Unlocks the scheduler, switching to whoever became ready in the meantime if they're more important than us
+ */
+void os_sched_unlock(void);
+
 /*!
  * @returns The current thread's ID.
  */
 os_thread_id_t os_current_id(void);
 
+/*!
+ * @brief 64 bit version of millis() that doesn't wrap around
+ * @note Same clock as os_micros64(), so the two can be mixed.
+ * @returns milliseconds since startup
+ */
+uint64_t os_millis64(void);
+
+/*!
+ * @brief 64 bit monotonic microsecond clock, what every sleep and timeout in the kernel runs on
+ * @note On the Teensy 4 it counts on a free running general purpose timer off the 24MHz oscillator,
+ * @note so unlike the cycle counter it doesn't stop when the core sleeps or change when the core clock does.
+ * @note Needs to be called at least once every 71 minutes, which the scheduler takes care of.
+ * @returns microseconds since startup
+ */
+uint64_t os_micros64(void);
+
 /*!
  * @return Current pointer to thread information
  */
 thread_t *_os_current_thread(void);
 
+/*!
+ * @brief Blocks the current thread on a kernel object's wait queue until it's woken up or times out
+ * @note Must be entered with the scheduler locked, our os_sched_lock() is undone before we yield, so the scheduler is unlocked once we return.
+ * @note Timeout is only used with one of the *_TIMEOUT thread states.
+ * @param os_wait_queue_t *queue wait queue of the kernel object
+ * @param thread_state_t state blocked state the thread sits in
+ * @param uint64_t timeout_us
+ * @returns thread_wake_status_t why we woke up, THREAD_WAKE_NONE if we never actually got switched out
+ */
+thread_wake_status_t os_wait_queue_block(os_wait_queue_t *queue, thread_state_t state, uint64_t timeout_us);
+
+/*!
+ * @brief Wakes up the highest priority thread waiting on a wait queue
+ * @note Must be called with the kernel stopped.
+ * @param os_wait_queue_t *queue
+ * @returns thread_t* thread that we woke up, NULL if nobody was waiting
+ */
+thread_t *os_wait_queue_wake_one(os_wait_queue_t *queue);
+
+/*!
+ * @brief Wakes up a specific thread waiting on a wait queue
+ * @note Must be called with the kernel stopped.
+ * @param thread_t *thread
+ */
+void os_wait_queue_wake(thread_t *thread);
+
+/*!
+ * @brief Hands ownership of a wait queue's kernel object to a thread
+ * @note The owner runs at the priority of it's highest priority waiter(transitively through whatever it's blocked on),
+ * @note and drops back once it gives the object up.
+ * @note Must be called with the kernel stopped.
+ * @param os_wait_queue_t *queue
+ * @param thread_t *owner new owner, NULL when the object is released
+ */
+void os_wait_queue_set_owner(os_wait_queue_t *queue, thread_t *owner);
+
 /*!
  * @brief unused ISR routine that we can use for whatever
  * @note I guess we have this here if we wanna use it
@@ -560,6 +1235,37 @@ bool os_signal_thread(thread_signal_t thread_signal, os_thread_id_t target_threa
  */
 bool os_signal_thread_clear(thread_signal_t thread_signal, os_thread_id_t target_thread_id);
 
+/*!
+ * @brief Interrupt safe version of os_signal_thread()
+ * @note Never blocks, see os_isr_request() for how it gets to the kernel.
+ * @param thread_signal_t thread_signal(there are 32 thread signals per thread)
+ * @param os_thread_id_t target_thread_id which thread we want to signal
+ * @returns false if the thread doesn't exist or the signal had to be dropped
+ */
+bool os_signal_thread_from_isr(thread_signal_t thread_signal, os_thread_id_t target_thread_id);
+
+/*!
+ * @brief Kernel operation that an interrupt hands over to the kernel
+ * @param void *object kernel object the operation works on
+ * @param void *data
+ * @param uint32_t arg
+ * @returns whether or not the operation succeeded
+ */
+typedef bool (*os_isr_request_func_t)(void *object, void *data, uint32_t arg);
+
+/*!
+ * @brief Runs a kernel operation on behalf of an interrupt, used to build all the *_from_isr calls.
+ * @note If no thread is in the middle of changing kernel state, the operation runs right away with kernel interrupts masked.
+ * @note Otherwise it's queued up and runs as soon as that thread restarts the kernel.
+ * @note Either way, a context switch is pended if a thread with a higher priority than the running one became ready.
+ * @param os_isr_request_func_t func operation to run, called with the kernel stopped and kernel interrupts masked
+ * @param void *object
+ * @param void *data
+ * @param uint32_t arg
+ * @returns What the operation returned if it ran right away, true if it was queued, false if the queue was full and it got dropped.
+ */
+bool os_isr_request(os_isr_request_func_t func, void *object, void *data, uint32_t arg);
+
 /**
  * @brief When we want to get the pointer to the datastruct of the thread from the thread ID
  * @param os_thread_id_t
@@ -567,6 +1273,11 @@ bool os_signal_thread_clear(thread_signal_t thread_signal, os_thread_id_t target
  */
 thread_t *os_get_indexed_thread(os_thread_id_t thread_id);
 
+/*!
+ * @returns How many thread control blocks the thread table has allocated, used or not
+ */
+int os_thread_slots(void);
+
 /*!
  * @brief We can check if there are bits that are signaled
  * @param which bits we want to check,
@@ -582,6 +1293,21 @@ thread_signal_status_t os_thread_checkbits(thread_signal_t thread_signal);
  */
 thread_signal_status_t os_checkbits_thread(thread_signal_t thread_signal, os_thread_id_t target_thread_id);
 
+/*!
+ * @brief Hangs thread until either timeout or until thread signal bits have been set
+ * @param thread_signal_t thread_signal
+ * @param uint32_t timeout_ms, 0 to wait for as long as it takes
+ */
+thread_signal_status_t os_thread_waitbits(thread_signal_t thread_signal, uint32_t timeout_ms);
+
+/*!
+ * @brief Hangs thread until either timeout or until thread signal bits have been set
+ * @note The thread sleeps out of the ready set in the meantime, os_signal_thread() or os_signal_thread_from_isr() wakes it up.
+ * @param thread_signal_t thread_signal
+ * @param uint64_t timeout_us, 0 to wait for as long as it takes
+ */
+thread_signal_status_t os_thread_waitbits_us(thread_signal_t thread_signal, uint64_t timeout_us);
+
 /*!
  * @brief Hangs thread until signal has been cleared
  * @param thread_signal_t thread_signal
@@ -0,0 +1,90 @@
+#ifndef _OSTICKLESSKERNEL_H
+#define _OSTICKLESSKERNEL_H
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+// Deliberately only depends on stdint, so the deadline logic can be compiled and checked on a host machine.
+#include <stdint.h>
+
+/*!
+ * @brief Shortest time we will ever program the kernel timer for
+ * @note Used when a deadline has already passed, so we switch as soon as possible
+ */
+#ifndef EXTERN_OS_TICKLESS_MIN_SLEEP_US
+static const uint32_t OS_TICKLESS_MIN_SLEEP_US = 10;
+#else
+static const uint32_t OS_TICKLESS_MIN_SLEEP_US = EXTERN_OS_TICKLESS_MIN_SLEEP_US;
+#endif
+
+/*!
+ * @brief Longest time we will ever program the kernel timer for
+ * @note Used when nothing is sleeping, so we still check in every once in a while.
+ * @note Has to stay well under the 71 minutes the 32 bit microsecond timer takes to wrap, so os_micros64() catches every wrap.
+ */
+#ifndef EXTERN_OS_TICKLESS_MAX_SLEEP_US
+static const uint32_t OS_TICKLESS_MAX_SLEEP_US = 1000000;
+#else
+static const uint32_t OS_TICKLESS_MAX_SLEEP_US = EXTERN_OS_TICKLESS_MAX_SLEEP_US;
+#endif
+
+/*!
+ * @brief Earliest wake deadline of every thread sleeping or blocked with a timeout
+ */
+typedef struct
+{
+  // Whether or not any thread is waiting on a deadline
+  bool valid;
+  // Microsecond time the earliest thread needs to be woken up at, in os_micros64() time
+  uint64_t deadline_us;
+} os_tickless_deadline_t;
+
+/*!
+ * @brief Clears out the earliest deadline, done before we add the deadlines of waiting threads
+ * @param os_tickless_deadline_t *deadline
+ */
+static inline void os_tickless_deadline_reset(os_tickless_deadline_t *deadline)
+{
+  deadline->valid = false;
+  deadline->deadline_us = 0;
+}
+
+/*!
+ * @brief Adds the deadline of a waiting thread, keeping whichever one is earliest.
+ * @param os_tickless_deadline_t *deadline
+ * @param uint64_t thread_deadline_us when the thread has to be woken up
+ */
+static inline void os_tickless_deadline_add(os_tickless_deadline_t *deadline, uint64_t thread_deadline_us)
+{
+  if (!deadline->valid || thread_deadline_us < deadline->deadline_us)
+  {
+    deadline->valid = true;
+    deadline->deadline_us = thread_deadline_us;
+  }
+}
+
+/*!
+ * @brief Works out how long the kernel timer should wait before it fires again
+ * @note Deadlines are kept on the same clock the timer counts on, so it never fires early.
+ * @param os_tickless_deadline_t *deadline earliest deadline of any waiting thread
+ * @param uint64_t now_us current os_micros64()
+ * @returns microseconds until the kernel timer should fire.
+ */
+static inline uint32_t os_tickless_timer_us(const os_tickless_deadline_t *deadline, uint64_t now_us)
+{
+  if (!deadline->valid)
+    return OS_TICKLESS_MAX_SLEEP_US;
+
+  // Deadline has already passed, or is too close to program, so get back here as soon as we can.
+  if (deadline->deadline_us <= now_us + OS_TICKLESS_MIN_SLEEP_US)
+    return OS_TICKLESS_MIN_SLEEP_US;
+
+  if (deadline->deadline_us - now_us >= OS_TICKLESS_MAX_SLEEP_US)
+    return OS_TICKLESS_MAX_SLEEP_US;
+
+  return (uint32_t)(deadline->deadline_us - now_us);
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "OSTraceKernel.h"
+
+#ifdef TRACE_MODULE
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+// Ring buffer is indexed with a mask, so it has to be a power of 2.
+static_assert((OS_TRACE_BUFFER_LEN & (OS_TRACE_BUFFER_LEN - 1)) == 0, "OS_TRACE_BUFFER_LEN has to be a power of 2");
+
+// tools/trace_to_perfetto.py unpacks records and the header by these sizes.
+static_assert(sizeof(os_trace_record_t) == 12, "trace records have to stay 12 bytes");
+static_assert(sizeof(os_trace_header_t) == 20, "trace header has to stay 20 bytes");
+
+/*!
+ * @brief Ring buffer of records, and how many records were ever written into it.
+ */
+os_trace_record_t os_trace_buffer[OS_TRACE_BUFFER_LEN];
+volatile uint32_t os_trace_head = 0;
+volatile bool os_trace_enabled = true;
+
+/*!
+ * @brief Starts or stops recording
+ * @note Recording is on from startup, stop it before dumping so the dump doesn't race new records.
+ */
+void os_trace_enable(bool enable)
+{
+  os_trace_enabled = enable;
+}
+
+/*!
+ * @brief Empties out the trace buffer
+ */
+void os_trace_clear(void)
+{
+  uint32_t irq_state = os_irq_lock();
+  os_trace_head = 0;
+  os_irq_unlock(irq_state);
+}
+
+/*!
+ * @brief Fills in the dump header for the records in the buffer right now
+ */
+static inline void os_trace_fill_header(os_trace_header_t *header, uint32_t head)
+{
+  header->magic = OS_TRACE_MAGIC;
+  header->version = OS_TRACE_VERSION;
+  header->record_size = sizeof(os_trace_record_t);
+#if defined(__IMXRT1062__)
+  header->cycles_per_us = F_CPU_ACTUAL / 1000000;
+#else
+  header->cycles_per_us = F_CPU / 1000000;
+#endif
+  header->count = head < OS_TRACE_BUFFER_LEN ? head : OS_TRACE_BUFFER_LEN;
+  header->dropped = head - header->count;
+}
+
+/*!
+ * @brief Copies the trace buffer out, oldest record first
+ * @param os_trace_header_t *header filled in with how many records we copied and how to decode them
+ * @param os_trace_record_t *records where the records go
+ * @param uint32_t max_records how many records fit in records
+ */
+void os_trace_snapshot(os_trace_header_t *header, os_trace_record_t *records, uint32_t max_records)
+{
+  uint32_t irq_state = os_irq_lock();
+  uint32_t head = os_trace_head;
+  os_trace_fill_header(header, head);
+
+  // If we can't fit everything, we keep the newest records.
+  if (header->count > max_records)
+  {
+    header->dropped += header->count - max_records;
+    header->count = max_records;
+  }
+
+  uint32_t start = head - header->count;
+  for (uint32_t n = 0; n < header->count; n++)
+    records[n] = os_trace_buffer[(start + n) & (OS_TRACE_BUFFER_LEN - 1)];
+  os_irq_unlock(irq_state);
+}
+
+/*!
+ * @brief Writes the trace buffer out in binary, header first and then the records oldest first
+ * @note Decode it on the host with tools/trace_to_perfetto.py. Stops recording while it's dumping.
+ * @param Print *out where to write it, like &Serial
+ */
+void os_trace_dump(Print *out)
+{
+  bool was_enabled = os_trace_enabled;
+  os_trace_enabled = false;
+
+  // Nothing can be written while recording is off, so we can dump straight out of the buffer.
+  uint32_t head = os_trace_head;
+  os_trace_header_t header;
+  os_trace_fill_header(&header, head);
+  out->write((const uint8_t *)&header, sizeof(header));
+
+  uint32_t start = head - header.count;
+  for (uint32_t n = 0; n < header.count; n++)
+    out->write((const uint8_t *)&os_trace_buffer[(start + n) & (OS_TRACE_BUFFER_LEN - 1)], sizeof(os_trace_record_t));
+
+  os_trace_enabled = was_enabled;
+}
+
+#endif
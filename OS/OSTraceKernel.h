@@ -0,0 +1,169 @@
+#ifndef _OSTRACEKERNEL_H
+#define _OSTRACEKERNEL_H
+
+// So we can configure modules
+#include "enabled_modules.h"
+
+#include <Arduino.h>
+#include "OSThreadKernel.h"
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Kinds of events the kernel trace records
+ * @note tools/trace_to_perfetto.py decodes these, so only ever add to the end.
+ */
+enum os_trace_event_t
+{
+  // Thread switched out for another one. other: thread switched in, arg: state of the thread switched out, data: 1 if it gave up the CPU itself
+  OS_TRACE_SWITCH = 1,
+  // Thread went back into the ready set. other: thread woken up, arg: state it was woken out of
+  OS_TRACE_WAKE = 2,
+  // Thread blocked on a kernel object. arg: blocked state, which says what kind of object, data: address of the object's wait queue
+  OS_TRACE_BLOCK = 3,
+  // Interrupt started. arg: interrupt number
+  OS_TRACE_ISR_ENTER = 4,
+  // Interrupt finished. arg: interrupt number
+  OS_TRACE_ISR_EXIT = 5,
+  // User marker. arg: marker id, data: user value
+  OS_TRACE_MARKER = 6
+};
+
+/*!
+ * @brief One trace record, fixed size so the ring buffer is just an array
+ */
+typedef struct
+{
+  // CPU cycle count when the event happened
+  uint32_t cycles;
+  // os_trace_event_t
+  uint8_t event;
+  // Thread that was running when the event happened
+  uint8_t thread;
+  // Thread the event happened to, if it's a different one
+  uint8_t other;
+  // Meaning depends on the event
+  uint8_t arg;
+  uint32_t data;
+} os_trace_record_t;
+
+/*!
+ * @brief Header at the start of a trace dump, followed by the records oldest first.
+ */
+typedef struct
+{
+  // "WOST"
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  // So the decoder can turn cycles into time
+  uint32_t cycles_per_us;
+  // How many records follow
+  uint32_t count;
+  // How many records were overwritten before the dump because the ring buffer was full
+  uint32_t dropped;
+} os_trace_header_t;
+
+static const uint32_t OS_TRACE_MAGIC = 0x54534F57;
+static const uint16_t OS_TRACE_VERSION = 1;
+
+#ifdef TRACE_MODULE
+
+/*!
+ * @brief How many records the ring buffer holds, has to be a power of 2
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_TRACE_BUFFER_LEN
+static const uint32_t OS_TRACE_BUFFER_LEN = 1024;
+#else
+static const uint32_t OS_TRACE_BUFFER_LEN = EXTERN_OS_TRACE_BUFFER_LEN;
+#endif
+
+/*!
+ * @brief Ring buffer of records, and how many records were ever written into it.
+ */
+extern os_trace_record_t os_trace_buffer[OS_TRACE_BUFFER_LEN];
+extern volatile uint32_t os_trace_head;
+extern volatile bool os_trace_enabled;
+
+/*!
+ * @brief Writes a record into the trace ring buffer, overwriting the oldest one once it's full
+ * @note Safe from threads, the kernel and interrupts that can call into the kernel(see OS_KERNEL_IRQ_PRIORITY).
+ * @note Inline with those interrupts masked for a few instructions, so it only costs a few dozen cycles.
+ */
+static inline void os_trace_write(uint8_t event, uint8_t thread, uint8_t other, uint8_t arg, uint32_t data)
+{
+  uint32_t irq_state = os_irq_lock();
+
+  // Checked with interrupts masked, so nothing gets written once a dump turned recording off.
+  if (!os_trace_enabled)
+  {
+    os_irq_unlock(irq_state);
+    return;
+  }
+
+  os_trace_record_t *record = &os_trace_buffer[os_trace_head & (OS_TRACE_BUFFER_LEN - 1)];
+  os_trace_head = os_trace_head + 1;
+  record->cycles = os_cpu_cycles();
+  record->event = event;
+  record->thread = thread;
+  record->other = other;
+  record->arg = arg;
+  record->data = data;
+
+  os_irq_unlock(irq_state);
+}
+
+#define OS_TRACE(event, thread, other, arg, data) os_trace_write((event), (uint8_t)(thread), (uint8_t)(other), (uint8_t)(arg), (uint32_t)(data))
+
+/*!
+ * @brief Starts or stops recording
+ * @note Recording is on from startup, stop it before dumping so the dump doesn't race new records.
+ */
+void os_trace_enable(bool enable);
+
+/*!
+ * @brief Empties out the trace buffer
+ */
+void os_trace_clear(void);
+
+/*!
+ * @brief Copies the trace buffer out, oldest record first
+ * @param os_trace_header_t *header filled in with how many records we copied and how to decode them
+ * @param os_trace_record_t *records where the records go
+ * @param uint32_t max_records how many records fit in records
+ */
+void os_trace_snapshot(os_trace_header_t *header, os_trace_record_t *records, uint32_t max_records);
+
+/*!
+ * @brief Writes the trace buffer out in binary, header first and then the records oldest first
+ * @note Decode it on the host with tools/trace_to_perfetto.py. Stops recording while it's dumping.
+ * @param Print *out where to write it, like &Serial
+ */
+void os_trace_dump(Print *out);
+
+#else
+
+#define OS_TRACE(event, thread, other, arg, data)
+
+#endif
+
+/*!
+ * @brief Marks an interrupt starting and finishing in the trace, put one at each end of an interrupt handler.
+ * @note Compiles to nothing without TRACE_MODULE.
+ */
+#define OS_TRACE_ISR_ENTER(irq) OS_TRACE(OS_TRACE_ISR_ENTER, os_current_id(), 0, (irq), 0)
+#define OS_TRACE_ISR_EXIT(irq) OS_TRACE(OS_TRACE_ISR_EXIT, os_current_id(), 0, (irq), 0)
+
+/*!
+ * @brief Puts a user marker in the trace
+ * @note Compiles to nothing without TRACE_MODULE.
+ * @param id which marker, shows up as it's name in the decoded trace
+ * @param value anything you want to see next to it
+ */
+#define OS_TRACE_MARKER(id, value) OS_TRACE(OS_TRACE_MARKER, os_current_id(), 0, (id), (value))
+
+#endif
@@ -0,0 +1,134 @@
+#include "Arduino.h"
+
+#include <stdarg.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+HostSerial Serial;
+
+/*!
+ * @brief Masks interrupts around anything that goes into libc's heap or stdio, since a thread switched out halfway through would leave them locked.
+ */
+class PortIrqLock
+{
+public:
+  PortIrqLock() : was_masked(os_port_irq_masked()) { __disable_irq(); }
+  ~PortIrqLock()
+  {
+    if (!was_masked)
+      __enable_irq();
+  }
+
+private:
+  uint32_t was_masked;
+};
+
+/*!
+ * @brief Waits without giving up the CPU, like delay() on the board
+ */
+void delay(uint32_t ms)
+{
+  delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  uint64_t end = os_port_nanos() + (uint64_t)us * 1000;
+  uint64_t now;
+  while ((now = os_port_nanos()) < end)
+  {
+    struct timespec wait;
+    wait.tv_sec = (end - now) / 1000000000ULL;
+    wait.tv_nsec = (end - now) % 1000000000ULL;
+    nanosleep(&wait, NULL);
+  }
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t count = 0;
+  while (size--)
+    count += this->write(*buffer++);
+  return count;
+}
+
+int Print::printf(const char *format, ...)
+{
+  PortIrqLock lock;
+
+  char small[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (len < 0)
+    return len;
+
+  if ((size_t)len < sizeof(small))
+  {
+    this->write((const uint8_t *)small, len);
+    return len;
+  }
+
+  char *big = new char[len + 1];
+  va_start(args, format);
+  vsnprintf(big, len + 1, format, args);
+  va_end(args);
+  this->write((const uint8_t *)big, len);
+  delete[] big;
+  return len;
+}
+
+int HostSerial::available(void)
+{
+  struct pollfd fd;
+  fd.fd = STDIN_FILENO;
+  fd.events = POLLIN;
+  fd.revents = 0;
+  return poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN) ? 1 : 0;
+}
+
+int HostSerial::read(void)
+{
+  if (!this->available())
+    return -1;
+  uint8_t c;
+  return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+void HostSerial::flush(void)
+{
+  PortIrqLock lock;
+  fflush(stdout);
+}
+
+size_t HostSerial::write(uint8_t b)
+{
+  PortIrqLock lock;
+  return fputc(b, stdout) == EOF ? 0 : 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+  PortIrqLock lock;
+  return fwrite(buffer, 1, size, stdout);
+}
+
+/*!
+ * @brief Runs the sketch, weak so a host tool can have it's own main()
+ */
+__attribute__((weak)) int main(void)
+{
+  // Output shows up a line at a time, even piped into something.
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  setup();
+  while (1)
+    loop();
+}
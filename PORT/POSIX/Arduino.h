@@ -0,0 +1,114 @@
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Just enough of the Arduino core for the kernel to build and run on a host machine
+ * @note Putting PORT/POSIX on the include path ahead of everything else picks the host port, see PORT/POSIX/README.MD
+ */
+
+#ifndef OS_PORT_POSIX
+#define OS_PORT_POSIX
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "OSPortPosix.h"
+
+/*!
+ * @brief The cycle counter counts nanoseconds on the host, so the core "runs" at 1GHz as far as the kernel's accounting goes.
+ */
+#define F_CPU 1000000000UL
+#define ARM_DWT_CYCCNT ((uint32_t)os_port_nanos())
+
+#define __disable_irq() os_port_irq_disable()
+#define __enable_irq() os_port_irq_enable()
+
+// Memory placement doesn't mean anything on the host.
+#define DMAMEM
+#define FASTRUN
+#define EXTMEM
+
+/*!
+ * @returns milliseconds since startup
+ */
+static inline uint32_t millis(void)
+{
+  return (uint32_t)(os_port_nanos() / 1000000);
+}
+
+/*!
+ * @returns microseconds since startup
+ */
+static inline uint32_t micros(void)
+{
+  return (uint32_t)(os_port_nanos() / 1000);
+}
+
+/*!
+ * @brief Waits without giving up the CPU, like delay() on the board
+ */
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+/*!
+ * @brief Sketch entry points, main() calls setup() once and then loop() forever.
+ */
+void setup(void);
+void loop(void);
+
+/*!
+ * @brief Anything that can be printed to, like Print in the Arduino core
+ */
+class Print
+{
+public:
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return this->write((const uint8_t *)str, strlen(str)); }
+
+  size_t print(const char *str) { return this->write(str); }
+  size_t print(char c) { return this->write((uint8_t)c); }
+  size_t print(int n) { return this->printf("%d", n); }
+  size_t print(unsigned int n) { return this->printf("%u", n); }
+  size_t print(long n) { return this->printf("%ld", n); }
+  size_t print(unsigned long n) { return this->printf("%lu", n); }
+  size_t print(double n, int digits = 2) { return this->printf("%.*f", digits, n); }
+
+  size_t println(void) { return this->write("\n"); }
+  template <typename T>
+  size_t println(T value) { return this->print(value) + this->println(); }
+
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/*!
+ * @brief Serial port of the host, which is stdout, and stdin to read from
+ */
+class HostSerial : public Print
+{
+public:
+  void begin(uint32_t baud) { (void)baud; }
+  operator bool() { return true; }
+
+  int available(void);
+  int read(void);
+  void flush(void);
+
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif
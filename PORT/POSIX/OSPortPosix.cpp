@@ -0,0 +1,457 @@
+#include "OSPortPosix.h"
+#include "OS/OSThreadKernel.h"
+
+#ifdef OS_PORT_POSIX
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+// These are what the assembly context switch works off of on the board, the host switch uses the same ones.
+extern "C"
+{
+  extern int current_active_state;
+  extern int current_tick_count;
+  extern int current_use_systick;
+  extern void *current_save;
+  extern int current_msp;
+  extern void *current_sp;
+}
+
+/*!
+ * @brief Where a thread goes once it's function returns, lr points here on the board
+ */
+extern void os_del_process(void);
+
+volatile sig_atomic_t os_port_primask = 0;
+volatile uint64_t os_port_irq_pending = 0;
+volatile sig_atomic_t os_port_switch_pending = 0;
+
+/*!
+ * @brief Interrupt handler hooked up to each signal, pending interrupts are kept as a bit per signal so only the first 64 fit
+ */
+static const int OS_PORT_MAX_SIGNALS = 64;
+static void (*port_isrs[OS_PORT_MAX_SIGNALS])(void);
+
+/*!
+ * @brief Every signal we use as an interrupt, new threads start with all of them unblocked
+ */
+static sigset_t port_signals;
+
+/*!
+ * @brief Timer standing in for systick, and the one standing in for the general purpose timer
+ */
+static timer_t tick_timer;
+static timer_t wake_timer;
+static bool timers_started = false;
+
+/*!
+ * @returns CLOCK_MONOTONIC in nanoseconds
+ */
+static inline uint64_t os_port_clock_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*!
+ * @brief When the process started, so time counts up from 0 like it does on the board
+ */
+static const uint64_t port_start_ns = os_port_clock_ns();
+
+/*!
+ * @returns Nanoseconds since startup off CLOCK_MONOTONIC
+ */
+uint64_t os_port_nanos(void)
+{
+  return os_port_clock_ns() - port_start_ns;
+}
+
+/*!
+ * @brief Swaps to whichever thread the scheduler picks, what context_switch_pendsv does on the board
+ * @note Called with interrupts masked. Comes back once this thread gets switched back in.
+ */
+static void os_port_context_switch(void)
+{
+  os_port_switch_pending = 0;
+
+  // Nothing switches while a thread has the kernel stopped, os_start() pends the switch again if it's still needed.
+  if (current_active_state != OS_STARTED)
+    return;
+
+  software_stack_t *from = (software_stack_t *)current_save;
+
+  // The main thread's stack isn't ours to check, for everyone else this is close enough to the stack pointer.
+  volatile uint8_t sp_marker = 0;
+  if (!current_msp)
+    current_sp = (void *)&sp_marker;
+
+  load_next_thread_asm();
+
+  software_stack_t *to = (software_stack_t *)current_save;
+  if (to != from)
+    swapcontext(&from->context.uc, &to->context.uc);
+}
+
+/*!
+ * @brief Runs every pending interrupt, then the pending context switch, then unmasks interrupts
+ * @note Has to be called with interrupts masked. It's what returning from an exception does on the board.
+ */
+void os_port_exception_return(void)
+{
+  while (1)
+  {
+    // Interrupts tail chain, lowest signal first.
+    uint64_t pending = __atomic_exchange_n(&os_port_irq_pending, 0, __ATOMIC_SEQ_CST);
+    while (pending)
+    {
+      int signal = __builtin_ctzll(pending);
+      pending &= pending - 1;
+      if (port_isrs[signal])
+        port_isrs[signal]();
+    }
+    if (os_port_irq_pending)
+      continue;
+
+    // PendSV is the lowest priority, so the switch only happens once every interrupt is done.
+    if (os_port_switch_pending)
+    {
+      os_port_context_switch();
+      continue;
+    }
+
+    os_port_primask = 0;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    // Anything that snuck in right before we unmasked still needs to run.
+    if (!os_port_irq_pending && !os_port_switch_pending)
+      return;
+    os_port_primask = 1;
+  }
+}
+
+/*!
+ * @brief Every signal we use as an interrupt comes here
+ * @note Masked interrupts are only marked pending, otherwise we take the interrupt right away on the stack of whatever thread was running.
+ */
+static void os_port_signal_handler(int signal)
+{
+  int saved_errno = errno;
+
+  __atomic_fetch_or(&os_port_irq_pending, 1ULL << signal, __ATOMIC_SEQ_CST);
+  if (!os_port_primask)
+  {
+    os_port_primask = 1;
+    os_port_exception_return();
+  }
+
+  errno = saved_errno;
+}
+
+/*!
+ * @brief Asks for a context switch, stands in for setting PENDSVSET
+ * @note From a thread with interrupts unmasked the switch happens straight away, otherwise as soon as they're unmasked.
+ */
+void os_port_pend_switch(void)
+{
+  os_port_switch_pending = 1;
+  if (!os_port_primask)
+  {
+    os_port_primask = 1;
+    os_port_exception_return();
+  }
+}
+
+/*!
+ * @brief Drops a pending context switch, stands in for setting PENDSVCLR
+ */
+void os_port_clear_switch(void)
+{
+  os_port_switch_pending = 0;
+}
+
+/*!
+ * @brief Where every thread starts out
+ */
+static void os_port_thread_entry(void)
+{
+  // A thread is switched in for the first time here, instead of back in os_port_context_switch(), so we finish the exception off.
+  os_port_exception_return();
+
+  os_port_context_t *context = &((software_stack_t *)current_save)->context;
+  context->func(context->arg);
+
+  // Same as returning into os_del_process() through lr on the board.
+  os_del_process();
+}
+
+/*!
+ * @brief Sets up a new thread's context, stands in for the exception frame os_loadstack() builds
+ * @param os_port_context_t *context where the thread's context goes
+ * @param void (*func)(void *) what the thread runs, the thread ends if it returns
+ * @param void *arg
+ * @param uint8_t *stack
+ * @param int stack_size
+ * @returns The thread's starting stack pointer
+ */
+void *os_port_init_context(os_port_context_t *context, void (*func)(void *), void *arg, uint8_t *stack, int stack_size)
+{
+  getcontext(&context->uc);
+  context->uc.uc_stack.ss_sp = stack;
+  context->uc.uc_stack.ss_size = stack_size - OS_PORT_STACK_TOP_RESERVE;
+  context->uc.uc_link = NULL;
+
+  // Threads added from an interrupt would otherwise start out with that interrupt's signal blocked.
+  for (int signal = 1; signal < OS_PORT_MAX_SIGNALS; signal++)
+    if (sigismember(&port_signals, signal) == 1)
+      sigdelset(&context->uc.uc_sigmask, signal);
+
+  context->func = func;
+  context->arg = arg;
+  makecontext(&context->uc, os_port_thread_entry, 0);
+
+  return stack + stack_size - OS_PORT_STACK_TOP_RESERVE;
+}
+
+/*!
+ * @brief Systick, counts down the running thread's time slice the same way context_switch() does in the assembly
+ */
+static void os_port_systick_isr(void)
+{
+  if (!current_use_systick)
+    return;
+
+  if (current_tick_count == 0)
+    os_port_pend_switch();
+  else
+    current_tick_count--;
+}
+
+/*!
+ * @brief Fires on the next wake deadline, same as the general purpose timer interrupt on the board
+ */
+static void os_port_wake_timer_isr(void)
+{
+  // Only fires on a wake deadline, the running thread keeps the rest of it's slice if it's still the most important.
+  os_wake_deadline_pend();
+}
+
+/*!
+ * @brief Runs an interrupt handler whenever a signal comes in, so *_from_isr() calls can be tested off the board
+ * @note The handler runs with interrupts masked, and a context switch it asks for happens once it returns.
+ * @param int signal(ex SIGUSR1)
+ * @param void (*isr)(void)
+ * @returns false if the signal is out of range
+ */
+bool os_port_attach_isr(int signal, void (*isr)(void))
+{
+  if (signal <= 0 || signal >= OS_PORT_MAX_SIGNALS)
+    return false;
+
+  port_isrs[signal] = isr;
+  sigaddset(&port_signals, signal);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = os_port_signal_handler;
+  // Interrupts don't nest on the host, the rest just wait pending until the handler is done.
+  action.sa_mask = port_signals;
+  action.sa_flags = SA_RESTART;
+  return sigaction(signal, &action, NULL) == 0;
+}
+
+/*!
+ * @brief Starts a timer on CLOCK_MONOTONIC that raises a signal
+ */
+static bool os_port_timer_create(timer_t *timer, int signal)
+{
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = signal;
+  return timer_create(CLOCK_MONOTONIC, &event, timer) == 0;
+}
+
+/*!
+ * @brief Stops the timers as the process exits, so no thread gets switched in halfway through exit()
+ */
+static void os_port_exit(void)
+{
+  os_port_primask = 1;
+  if (timers_started)
+  {
+    timer_delete(tick_timer);
+    timer_delete(wake_timer);
+    timers_started = false;
+  }
+}
+
+/*!
+ * @brief Starts up the host port, called from threads_init()
+ * @note Hooks up the signals and starts the tick and the wake timer.
+ */
+void os_port_init(void)
+{
+  if (timers_started)
+    return;
+
+  int wake_signal = SIGRTMIN;
+  os_port_attach_isr(SIGALRM, os_port_systick_isr);
+  os_port_attach_isr(wake_signal, os_port_wake_timer_isr);
+
+  if (!os_port_timer_create(&tick_timer, SIGALRM) || !os_port_timer_create(&wake_timer, wake_signal))
+  {
+    perror("will-os: timer_create");
+    abort();
+  }
+  timers_started = true;
+  atexit(os_port_exit);
+
+  if (OS_PORT_TICK_US)
+  {
+    struct itimerspec tick;
+    tick.it_value.tv_sec = OS_PORT_TICK_US / 1000000;
+    tick.it_value.tv_nsec = (OS_PORT_TICK_US % 1000000) * 1000;
+    tick.it_interval = tick.it_value;
+    timer_settime(tick_timer, 0, &tick, NULL);
+  }
+}
+
+/*!
+ * @brief Sets when the wake timer fires next, stands in for the general purpose timer's compare
+ * @param uint32_t microseconds from now
+ */
+void os_port_timer_reprogram(uint32_t microseconds)
+{
+  if (!timers_started)
+    return;
+
+  struct itimerspec wake;
+  wake.it_interval.tv_sec = 0;
+  wake.it_interval.tv_nsec = 0;
+  wake.it_value.tv_sec = microseconds / 1000000;
+  wake.it_value.tv_nsec = (microseconds % 1000000) * 1000;
+  timer_settime(wake_timer, 0, &wake, NULL);
+}
+
+/*!
+ * @brief Sleeps the process until the next signal, stands in for WFI
+ * @note Interrupts that came in before we got here already ran, so there's nothing we can sleep through.
+ */
+void os_port_wait_for_interrupt(void)
+{
+  pause();
+}
+
+#if defined(__GLIBC__)
+/*
+glibc's heap takes a lock that isn't safe to take again from a signal handler. If an interrupt lands while a thread is
+in malloc() and switches to another thread that allocates, or the scheduler frees a reaped stack or a periodic schedule,
+the process deadlocks on that lock, since every kernel thread is the same pthread to glibc. So we put our own malloc()
+in front of glibc's that masks interrupts while it's in there. Interrupts that come in meanwhile stay pending like they
+would anywhere else the kernel masks them, and run once we're out. Covers new and delete too, they go through malloc().
+*/
+extern "C"
+{
+  extern void *__libc_malloc(size_t size);
+  extern void __libc_free(void *ptr);
+  extern void *__libc_calloc(size_t count, size_t size);
+  extern void *__libc_realloc(void *ptr, size_t size);
+  extern void *__libc_memalign(size_t alignment, size_t size);
+}
+
+/*!
+ * @brief Masks interrupts on the way into the heap, unless they already are
+ * @returns Whether we masked them, and have to unmask them on the way out
+ */
+static inline bool os_port_heap_enter(void)
+{
+  if (os_port_primask)
+    return false;
+  os_port_irq_disable();
+  return true;
+}
+
+/*!
+ * @brief Unmasks interrupts on the way out of the heap, if we were the ones that masked them
+ * @note Whatever came in while we were in the heap runs here, so errno is kept from it.
+ */
+static inline void os_port_heap_exit(bool masked)
+{
+  if (!masked)
+    return;
+  int saved_errno = errno;
+  os_port_irq_enable();
+  errno = saved_errno;
+}
+
+extern "C"
+{
+  void *malloc(size_t size) noexcept
+  {
+    bool masked = os_port_heap_enter();
+    void *ptr = __libc_malloc(size);
+    os_port_heap_exit(masked);
+    return ptr;
+  }
+
+  void free(void *ptr) noexcept
+  {
+    if (ptr == NULL)
+      return;
+    bool masked = os_port_heap_enter();
+    __libc_free(ptr);
+    os_port_heap_exit(masked);
+  }
+
+  void *calloc(size_t count, size_t size) noexcept
+  {
+    bool masked = os_port_heap_enter();
+    void *ptr = __libc_calloc(count, size);
+    os_port_heap_exit(masked);
+    return ptr;
+  }
+
+  void *realloc(void *ptr, size_t size) noexcept
+  {
+    bool masked = os_port_heap_enter();
+    void *new_ptr = __libc_realloc(ptr, size);
+    os_port_heap_exit(masked);
+    return new_ptr;
+  }
+
+  void *memalign(size_t alignment, size_t size) noexcept
+  {
+    bool masked = os_port_heap_enter();
+    void *ptr = __libc_memalign(alignment, size);
+    os_port_heap_exit(masked);
+    return ptr;
+  }
+
+  void *aligned_alloc(size_t alignment, size_t size) noexcept
+  {
+    return memalign(alignment, size);
+  }
+
+  int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept
+  {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+      return EINVAL;
+
+    void *aligned = memalign(alignment, size);
+    if (aligned == NULL)
+      return ENOMEM;
+    *ptr = aligned;
+    return 0;
+  }
+}
+#endif
+
+#endif
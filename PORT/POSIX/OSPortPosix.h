@@ -0,0 +1,164 @@
+#ifndef _OSPORTPOSIX_H
+#define _OSPORTPOSIX_H
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Host port of the kernel, so it runs as a normal Linux process.
+ * @note Everything the Cortex-M gives the kernel has a stand in here:
+ * @note - Interrupts are signals. __disable_irq() masks them in software, signals that come in while masked are held pending,
+ * @note   and run as soon as they're unmasked, the same way the NVIC holds them.
+ * @note - PendSV is a pending flag, the switch runs once every interrupt is done and interrupts are unmasked, with swapcontext() in place of the assembly.
+ * @note - Systick is a timer signal counting down the running thread's time slice, the general purpose timer is a second timer for the next wake deadline.
+ * @note - The clock is CLOCK_MONOTONIC, and the cycle counter counts nanoseconds.
+ * @note Only one thread of the process ever runs kernel threads, the kernel isn't made thread safe against other pthreads.
+ */
+
+#include <stdint.h>
+#include <signal.h>
+#include <ucontext.h>
+
+/*!
+ * @brief How often the timer signal standing in for systick counts down the running thread's time slice, 0 for no tick
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_PORT_TICK_US
+static const uint32_t OS_PORT_TICK_US = 1000;
+#else
+static const uint32_t OS_PORT_TICK_US = EXTERN_OS_PORT_TICK_US;
+#endif
+
+/*!
+ * @brief Smallest stack a thread gets on the host
+ * @note Interrupts run on the stack of whichever thread they land on, and a signal frame is kilobytes, not the 32 bytes of an exception frame.
+ * @note Threads asking for less, including ones handing in their own stack, get one this size out of the stack pool.
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_PORT_MIN_STACK_SIZE
+static const int OS_PORT_MIN_STACK_SIZE = 32768;
+#else
+static const int OS_PORT_MIN_STACK_SIZE = EXTERN_OS_PORT_MIN_STACK_SIZE;
+#endif
+
+/*!
+ * @brief Bytes at the top of every thread stack that never hold a frame
+ * @note A thread is still on it's stack while it switches out for the last time, and that's when the stack pool puts it's free list node at the top.
+ */
+static const int OS_PORT_STACK_TOP_RESERVE = 32;
+
+/*!
+ * @brief Saved context of a thread, what the assembly keeps in software_stack_t on the board
+ */
+typedef struct
+{
+  ucontext_t uc;
+
+  // What a new thread runs, it's entry picks these up the first time it's switched in.
+  void (*func)(void *);
+  void *arg;
+} os_port_context_t;
+
+/*!
+ * @brief Interrupt mask, signals that came in while it was set, and whether a context switch is pending
+ * @note Only to be touched through the functions below.
+ */
+extern volatile sig_atomic_t os_port_primask;
+extern volatile uint64_t os_port_irq_pending;
+extern volatile sig_atomic_t os_port_switch_pending;
+
+/*!
+ * @brief Runs every pending interrupt, then the pending context switch, then unmasks interrupts
+ * @note Has to be called with interrupts masked. It's what returning from an exception does on the board.
+ */
+void os_port_exception_return(void);
+
+/*!
+ * @brief Masks interrupts, stands in for __disable_irq()
+ */
+static inline void os_port_irq_disable(void)
+{
+  os_port_primask = 1;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+/*!
+ * @brief Unmasks interrupts, stands in for __enable_irq()
+ * @note Anything that came in while we were masked runs right here, like it would on the board.
+ */
+static inline void os_port_irq_enable(void)
+{
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  os_port_primask = 0;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (os_port_irq_pending || os_port_switch_pending)
+  {
+    os_port_primask = 1;
+    os_port_exception_return();
+  }
+}
+
+/*!
+ * @returns Whether or not interrupts are masked, what reading PRIMASK gives on the board
+ */
+static inline uint32_t os_port_irq_masked(void)
+{
+  return os_port_primask;
+}
+
+/*!
+ * @brief Starts up the host port, called from threads_init()
+ * @note Hooks up the signals and starts the tick and the wake timer.
+ */
+void os_port_init(void);
+
+/*!
+ * @brief Asks for a context switch, stands in for setting PENDSVSET
+ * @note From a thread with interrupts unmasked the switch happens straight away, otherwise as soon as they're unmasked.
+ */
+void os_port_pend_switch(void);
+
+/*!
+ * @brief Drops a pending context switch, stands in for setting PENDSVCLR
+ */
+void os_port_clear_switch(void);
+
+/*!
+ * @brief Sets up a new thread's context, stands in for the exception frame os_loadstack() builds
+ * @param os_port_context_t *context where the thread's context goes
+ * @param void (*func)(void *) what the thread runs, the thread ends if it returns
+ * @param void *arg
+ * @param uint8_t *stack
+ * @param int stack_size
+ * @returns The thread's starting stack pointer
+ */
+void *os_port_init_context(os_port_context_t *context, void (*func)(void *), void *arg, uint8_t *stack, int stack_size);
+
+/*!
+ * @brief Sets when the wake timer fires next, stands in for the general purpose timer's compare
+ * @param uint32_t microseconds from now
+ */
+void os_port_timer_reprogram(uint32_t microseconds);
+
+/*!
+ * @brief Sleeps the process until the next signal, stands in for WFI
+ */
+void os_port_wait_for_interrupt(void);
+
+/*!
+ * @brief Runs an interrupt handler whenever a signal comes in, so *_from_isr() calls can be tested off the board
+ * @note The handler runs with interrupts masked, and a context switch it asks for happens once it returns.
+ * @param int signal(ex SIGUSR1)
+ * @param void (*isr)(void)
+ * @returns false if the signal is out of range
+ */
+bool os_port_attach_isr(int signal, void (*isr)(void));
+
+/*!
+ * @returns Nanoseconds since startup off CLOCK_MONOTONIC
+ */
+uint64_t os_port_nanos(void);
+
+#endif
@@ -0,0 +1,237 @@
+#include "Arduino.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief CMSDK APB UART 0
+ */
+#define MPS2_UART0_DATA (*(volatile uint32_t *)0x40004000)
+#define MPS2_UART0_STATE (*(volatile uint32_t *)0x40004004)
+#define MPS2_UART0_CTRL (*(volatile uint32_t *)0x40004008)
+#define MPS2_UART0_BAUDDIV (*(volatile uint32_t *)0x40004010)
+#define MPS2_UART_STATE_TXFULL ((uint32_t)(1 << 0))
+#define MPS2_UART_STATE_RXFULL ((uint32_t)(1 << 1))
+#define MPS2_UART_CTRL_TXEN ((uint32_t)(1 << 0))
+#define MPS2_UART_CTRL_RXEN ((uint32_t)(1 << 1))
+
+/*!
+ * @brief Where the heap is, from the linker script
+ */
+extern unsigned long __heap_start;
+extern unsigned long __heap_end;
+
+Mps2Serial Serial;
+
+/*!
+ * @brief Busy waits, like delay() on the board
+ */
+void delay(uint32_t ms)
+{
+  delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  uint64_t end = os_port_nanos() + (uint64_t)us * 1000;
+  while (os_port_nanos() < end)
+    ;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t count = 0;
+  while (size--)
+    count += this->write(*buffer++);
+  return count;
+}
+
+int Print::printf(const char *format, ...)
+{
+  char small[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (len < 0)
+    return len;
+
+  if ((size_t)len < sizeof(small))
+  {
+    this->write((const uint8_t *)small, len);
+    return len;
+  }
+
+  char *big = new char[len + 1];
+  va_start(args, format);
+  vsnprintf(big, len + 1, format, args);
+  va_end(args);
+  this->write((const uint8_t *)big, len);
+  delete[] big;
+  return len;
+}
+
+void Mps2Serial::begin(uint32_t baud)
+{
+  MPS2_UART0_BAUDDIV = OS_MPS2_SYSCLK_HZ / (baud ? baud : 115200);
+  MPS2_UART0_CTRL = MPS2_UART_CTRL_TXEN | MPS2_UART_CTRL_RXEN;
+}
+
+int Mps2Serial::available(void)
+{
+  return MPS2_UART0_STATE & MPS2_UART_STATE_RXFULL ? 1 : 0;
+}
+
+int Mps2Serial::read(void)
+{
+  if (!this->available())
+    return -1;
+  return MPS2_UART0_DATA & 0xFF;
+}
+
+void Mps2Serial::flush(void)
+{
+  while (MPS2_UART0_STATE & MPS2_UART_STATE_TXFULL)
+    ;
+}
+
+size_t Mps2Serial::write(uint8_t b)
+{
+  while (MPS2_UART0_STATE & MPS2_UART_STATE_TXFULL)
+    ;
+  MPS2_UART0_DATA = b;
+  return 1;
+}
+
+/*!
+ * @brief Masks interrupts around the heap, since a thread switched out halfway through malloc() would leave it locked
+ * @note newlib calls these itself, they nest since free() can end up back in malloc().
+ */
+static uint32_t malloc_lock_depth = 0;
+static uint32_t malloc_lock_primask = 0;
+
+extern "C" void __malloc_lock(struct _reent *r)
+{
+  (void)r;
+  uint32_t primask;
+  __asm volatile("mrs %0, primask" : "=r"(primask));
+  __disable_irq();
+  if (malloc_lock_depth++ == 0)
+    malloc_lock_primask = primask;
+}
+
+extern "C" void __malloc_unlock(struct _reent *r)
+{
+  (void)r;
+  if (--malloc_lock_depth == 0 && !malloc_lock_primask)
+    __enable_irq();
+}
+
+// What newlib needs from the board, stdout and stderr go out the UART.
+extern "C"
+{
+  void *_sbrk(ptrdiff_t increment)
+  {
+    static uint8_t *heap_top = (uint8_t *)&__heap_start;
+    if (heap_top + increment > (uint8_t *)&__heap_end || heap_top + increment < (uint8_t *)&__heap_start)
+    {
+      errno = ENOMEM;
+      return (void *)-1;
+    }
+    uint8_t *prev = heap_top;
+    heap_top += increment;
+    return prev;
+  }
+
+  int _write(int fd, const char *buf, int len)
+  {
+    if (fd != 1 && fd != 2)
+    {
+      errno = EBADF;
+      return -1;
+    }
+    Serial.write((const uint8_t *)buf, len);
+    return len;
+  }
+
+  int _read(int fd, char *buf, int len)
+  {
+    if (fd != 0)
+    {
+      errno = EBADF;
+      return -1;
+    }
+    int count = 0;
+    int c;
+    while (count < len && (c = Serial.read()) >= 0)
+      buf[count++] = (char)c;
+    return count;
+  }
+
+  int _close(int fd)
+  {
+    (void)fd;
+    return -1;
+  }
+
+  int _fstat(int fd, struct stat *st)
+  {
+    (void)fd;
+    st->st_mode = S_IFCHR;
+    return 0;
+  }
+
+  int _isatty(int fd)
+  {
+    (void)fd;
+    return 1;
+  }
+
+  int _lseek(int fd, int offset, int whence)
+  {
+    (void)fd;
+    (void)offset;
+    (void)whence;
+    return 0;
+  }
+
+  int _getpid(void)
+  {
+    return 1;
+  }
+
+  int _kill(int pid, int sig)
+  {
+    (void)pid;
+    (void)sig;
+    errno = EINVAL;
+    return -1;
+  }
+
+  void _exit(int status)
+  {
+    os_port_exit(status);
+  }
+
+  // We link with -nostartfiles, so there's no crti.o to give __libc_init_array() these.
+  void _init(void) {}
+  void _fini(void) {}
+}
+
+/*!
+ * @brief Runs the sketch, weak so a sketch can have it's own main()
+ */
+__attribute__((weak)) int main(void)
+{
+  Serial.begin(115200);
+
+  setup();
+  while (1)
+    loop();
+}
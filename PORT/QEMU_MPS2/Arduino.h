@@ -0,0 +1,153 @@
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Just enough of the Arduino core for the kernel to run on the MPS2 boards QEMU emulates
+ * @note Putting PORT/QEMU_MPS2 on the include path ahead of everything else picks this port, see PORT/QEMU_MPS2/README.MD
+ */
+
+#ifndef OS_PORT_MPS2
+#define OS_PORT_MPS2
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "OSPortMps2.h"
+
+/*!
+ * @brief The cycle counter counts nanoseconds of QEMU's virtual clock, so the core "runs" at 1GHz as far as the kernel's accounting goes.
+ * @note With -icount shift=0 that's one instruction a nanosecond, so cycles are instructions.
+ */
+#define F_CPU 1000000000UL
+#define ARM_DWT_CYCCNT (os_port_cycles())
+
+#define __disable_irq() __asm__ volatile("CPSID i" ::: "memory")
+#define __enable_irq() __asm__ volatile("CPSIE i" ::: "memory")
+
+// Everything is in the same SSRAM on the MPS2, so memory placement doesn't mean anything.
+#define DMAMEM
+#define FASTRUN
+#define EXTMEM
+
+// System control block, same names as the Teensy core so the kernel doesn't care which board it's on.
+#define SCB_ICSR (*(volatile uint32_t *)0xE000ED04)
+#define SCB_ICSR_PENDSVSET ((uint32_t)(1 << 28))
+#define SCB_ICSR_PENDSVCLR ((uint32_t)(1 << 27))
+#define SCB_ICSR_PENDSTSET ((uint32_t)(1 << 26))
+#define SCB_VTOR (*(volatile uint32_t *)0xE000ED08)
+#define SCB_SHPR3 (*(volatile uint32_t *)0xE000ED20)
+#define SCB_SHCSR (*(volatile uint32_t *)0xE000ED24)
+#define SCB_CPACR (*(volatile uint32_t *)0xE000ED88)
+
+#define SYST_CSR (*(volatile uint32_t *)0xE000E010)
+#define SYST_RVR (*(volatile uint32_t *)0xE000E014)
+#define SYST_CVR (*(volatile uint32_t *)0xE000E018)
+#define SYST_CSR_ENABLE ((uint32_t)(1 << 0))
+#define SYST_CSR_TICKINT ((uint32_t)(1 << 1))
+#define SYST_CSR_CLKSOURCE ((uint32_t)(1 << 2))
+
+#define NVIC_NUM_INTERRUPTS 32
+#define NVIC_ENABLE_IRQ(n) (*((volatile uint32_t *)0xE000E100 + ((n) >> 5)) = (1 << ((n)&31)))
+#define NVIC_DISABLE_IRQ(n) (*((volatile uint32_t *)0xE000E180 + ((n) >> 5)) = (1 << ((n)&31)))
+#define NVIC_SET_PRIORITY(n, p) (*((volatile uint8_t *)0xE000E400 + (n)) = (uint8_t)(p))
+
+/*!
+ * @brief Vector table in RAM that VTOR points at, interrupt n is at 16 + n
+ * @note Aligned to the table size rounded up to a power of 2, which VTOR needs.
+ */
+extern void (*volatile _VectorsRam[NVIC_NUM_INTERRUPTS + 16])(void);
+
+/*!
+ * @brief What every vector nobody hooked points to
+ */
+extern "C" void unused_interrupt_vector(void);
+
+/*!
+ * @brief Milliseconds since reset, counted by the systick interrupt
+ */
+extern volatile uint32_t systick_millis_count;
+
+/*!
+ * @returns milliseconds since startup
+ */
+static inline uint32_t millis(void)
+{
+  return systick_millis_count;
+}
+
+/*!
+ * @returns microseconds since startup
+ */
+static inline uint32_t micros(void)
+{
+  return os_port_micros();
+}
+
+/*!
+ * @brief Busy waits, like delay() on the board
+ */
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+/*!
+ * @brief Sketch entry points, main() calls setup() once and then loop() forever.
+ */
+void setup(void);
+void loop(void);
+
+/*!
+ * @brief Anything that can be printed to, like Print in the Arduino core
+ */
+class Print
+{
+public:
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return this->write((const uint8_t *)str, strlen(str)); }
+
+  size_t print(const char *str) { return this->write(str); }
+  size_t print(char c) { return this->write((uint8_t)c); }
+  size_t print(int n) { return this->printf("%d", n); }
+  size_t print(unsigned int n) { return this->printf("%u", n); }
+  size_t print(long n) { return this->printf("%ld", n); }
+  size_t print(unsigned long n) { return this->printf("%lu", n); }
+  size_t print(double n, int digits = 2) { return this->printf("%.*f", digits, n); }
+
+  size_t println(void) { return this->write("\n"); }
+  template <typename T>
+  size_t println(T value) { return this->print(value) + this->println(); }
+
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/*!
+ * @brief CMSDK UART 0 of the MPS2, the first -serial of QEMU
+ * @note QEMU doesn't care about the baud rate, so begin() only turns the UART on.
+ */
+class Mps2Serial : public Print
+{
+public:
+  void begin(uint32_t baud);
+  operator bool() { return true; }
+
+  int available(void);
+  int read(void);
+  void flush(void);
+
+  size_t write(uint8_t b);
+  using Print::write;
+};
+
+extern Mps2Serial Serial;
+
+#endif
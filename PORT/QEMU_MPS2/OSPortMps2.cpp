@@ -0,0 +1,229 @@
+#include "Arduino.h"
+#include "OS/OSThreadKernel.h"
+
+#ifdef OS_PORT_MPS2
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Systick reload, it interrupts once a millisecond
+ */
+static const uint32_t OS_MPS2_CLOCKS_PER_MS = OS_MPS2_SYSCLK_HZ / 1000;
+
+/*!
+ * @brief CMSDK APB timer 0, standing in for the general purpose timer
+ */
+static const int OS_MPS2_TIMER0_IRQ = 8;
+#define MPS2_TIMER0_CTRL (*(volatile uint32_t *)0x40000000)
+#define MPS2_TIMER0_VALUE (*(volatile uint32_t *)0x40000004)
+#define MPS2_TIMER0_RELOAD (*(volatile uint32_t *)0x40000008)
+#define MPS2_TIMER0_INTCLEAR (*(volatile uint32_t *)0x4000000C)
+#define MPS2_TIMER_CTRL_EN ((uint32_t)(1 << 0))
+#define MPS2_TIMER_CTRL_IRQEN ((uint32_t)(1 << 3))
+
+/*!
+ * @brief Symbols from the linker script
+ */
+extern unsigned long _estack;
+extern unsigned long __data_load;
+extern unsigned long __data_start__;
+extern unsigned long __data_end__;
+extern unsigned long __bss_start__;
+extern unsigned long __bss_end__;
+
+extern "C" void __libc_init_array(void);
+extern "C" void Reset_Handler(void);
+static void systick_isr(void);
+
+__attribute__((aligned(256))) void (*volatile _VectorsRam[NVIC_NUM_INTERRUPTS + 16])(void);
+static_assert(sizeof(_VectorsRam) <= 256, "_VectorsRam has to be aligned to it's size rounded up to a power of 2");
+
+volatile uint32_t systick_millis_count = 0;
+
+/*!
+ * @brief Vector table QEMU boots from, only what's needed to get to Reset_Handler() and copy it into _VectorsRam
+ */
+__attribute__((section(".isr_vector"), used)) static void (*const vectors_flash[16])(void) = {
+    (void (*)(void))&_estack,
+    Reset_Handler,
+    unused_interrupt_vector, // NMI
+    unused_interrupt_vector, // Hard fault
+    unused_interrupt_vector, // Mem manage
+    unused_interrupt_vector, // Bus fault
+    unused_interrupt_vector, // Usage fault
+    0,
+    0,
+    0,
+    0,
+    unused_interrupt_vector, // SVC, the kernel hooks this in threads_init()
+    unused_interrupt_vector, // Debug monitor
+    0,
+    unused_interrupt_vector, // PendSV, the kernel hooks this in threads_init()
+    systick_isr,
+};
+
+/*!
+ * @brief Where the board starts, gets memory and the vector table set up and then runs main()
+ */
+extern "C" void Reset_Handler(void)
+{
+#if defined(__ARM_PCS_VFP)
+  // Turns on the FPU before anything gets the chance to use it.
+  SCB_CPACR |= (0xF << 20);
+  __asm volatile("dsb \n isb" ::: "memory");
+#endif
+
+  unsigned long *src = &__data_load;
+  unsigned long *dest = &__data_start__;
+  while (dest < &__data_end__)
+    *dest++ = *src++;
+  dest = &__bss_start__;
+  while (dest < &__bss_end__)
+    *dest++ = 0;
+
+  for (int n = 0; n < 16; n++)
+    _VectorsRam[n] = vectors_flash[n];
+  for (int n = 16; n < NVIC_NUM_INTERRUPTS + 16; n++)
+    _VectorsRam[n] = unused_interrupt_vector;
+  SCB_VTOR = (uint32_t)_VectorsRam;
+  __asm volatile("dsb \n isb" ::: "memory");
+
+  // Same priority as on the Teensy, so it's one of the interrupts os_irq_lock() masks.
+  SCB_SHPR3 = (SCB_SHPR3 & 0x00FFFFFF) | ((uint32_t)OS_KERNEL_IRQ_PRIORITY << 24);
+  SYST_RVR = OS_MPS2_CLOCKS_PER_MS - 1;
+  SYST_CVR = 0;
+  SYST_CSR = SYST_CSR_CLKSOURCE | SYST_CSR_TICKINT | SYST_CSR_ENABLE;
+
+  __libc_init_array();
+
+  extern int main(void);
+  os_port_exit(main());
+}
+
+/*!
+ * @brief Counts milliseconds, the same as the Teensy core's systick
+ * @note threads_init() puts threads_systick_isr() in front of it, which counts down the running thread's slice after.
+ */
+static void systick_isr(void)
+{
+  systick_millis_count++;
+}
+
+/*!
+ * @brief Anything we don't have a handler for, faults included, ends the run so a crashed benchmark doesn't hang whoever ran QEMU
+ */
+extern "C" void unused_interrupt_vector(void)
+{
+  uint32_t ipsr;
+  __asm volatile("mrs %0, ipsr" : "=r"(ipsr));
+  Serial.printf("will-os: unhandled exception %lu\n", (unsigned long)(ipsr & 0x1FF));
+  Serial.flush();
+  os_port_exit(1);
+}
+
+/*!
+ * @brief Reads where systick is at
+ * @param uint32_t *ms milliseconds since reset
+ * @param uint32_t *clocks clocks since the start of that millisecond
+ */
+static inline void os_port_clock_read(uint32_t *ms, uint32_t *clocks)
+{
+  uint32_t irq_state = os_irq_lock();
+  uint32_t count = systick_millis_count;
+  uint32_t current = SYST_CVR;
+  uint32_t istatus = SCB_ICSR;
+  os_irq_unlock(irq_state);
+
+  // Systick rolled over but it's interrupt hasn't run yet.
+  if ((istatus & SCB_ICSR_PENDSTSET) && current > OS_MPS2_CLOCKS_PER_MS / 2)
+    count++;
+
+  *ms = count;
+  *clocks = OS_MPS2_CLOCKS_PER_MS - 1 - current;
+}
+
+uint64_t os_port_nanos(void)
+{
+  uint32_t ms, clocks;
+  os_port_clock_read(&ms, &clocks);
+  return (uint64_t)ms * 1000000 + clocks * OS_MPS2_NS_PER_CLOCK;
+}
+
+uint32_t os_port_micros(void)
+{
+  uint32_t ms, clocks;
+  os_port_clock_read(&ms, &clocks);
+  return ms * 1000 + clocks / (OS_MPS2_SYSCLK_HZ / 1000000);
+}
+
+uint32_t os_port_cycles(void)
+{
+  uint32_t ms, clocks;
+  os_port_clock_read(&ms, &clocks);
+  return ms * 1000000 + clocks * OS_MPS2_NS_PER_CLOCK;
+}
+
+/*!
+ * @brief Fires on the next wake deadline, same as the general purpose timer interrupt on the Teensy
+ */
+static void os_port_timer_isr(void)
+{
+  MPS2_TIMER0_INTCLEAR = 1;
+  __asm volatile("dsb");
+  // Only fires on a wake deadline, the running thread keeps the rest of it's slice if it's still the most important.
+  os_wake_deadline_pend();
+}
+
+/*!
+ * @brief Starts up the board side of the kernel, called from threads_init()
+ * @note Hooks the CMSDK timer into _VectorsRam and starts it as the wake timer.
+ */
+void os_port_init(void)
+{
+  MPS2_TIMER0_CTRL = 0;
+  MPS2_TIMER0_INTCLEAR = 1;
+  _VectorsRam[16 + OS_MPS2_TIMER0_IRQ] = os_port_timer_isr;
+  NVIC_SET_PRIORITY(OS_MPS2_TIMER0_IRQ, OS_MPS2_TIMER_PRIORITY);
+  os_port_timer_reprogram(OS_TICKLESS_MAX_SLEEP_US);
+  NVIC_ENABLE_IRQ(OS_MPS2_TIMER0_IRQ);
+}
+
+/*!
+ * @brief Sets when the wake timer fires next, stands in for the general purpose timer's compare
+ * @note The timer counts down and starts over from the reload, so if nobody reprograms it, it fires again one period later, which does no harm.
+ * @param uint32_t microseconds from now
+ */
+void os_port_timer_reprogram(uint32_t microseconds)
+{
+  static const uint32_t clocks_per_us = OS_MPS2_SYSCLK_HZ / 1000000;
+  uint32_t clocks = microseconds > UINT32_MAX / clocks_per_us ? UINT32_MAX : microseconds * clocks_per_us;
+  if (clocks == 0)
+    clocks = 1;
+
+  MPS2_TIMER0_CTRL = 0;
+  MPS2_TIMER0_RELOAD = clocks;
+  MPS2_TIMER0_VALUE = clocks;
+  MPS2_TIMER0_CTRL = MPS2_TIMER_CTRL_EN | MPS2_TIMER_CTRL_IRQEN;
+}
+
+/*!
+ * @brief Ends the emulator through semihosting, needs -semihosting on the QEMU command line
+ * @param int status, QEMU only tells apart zero and everything else
+ */
+void os_port_exit(int status)
+{
+  // SYS_EXIT, with ADP_Stopped_ApplicationExit or ADP_Stopped_RunTimeErrorUnknown.
+  register uint32_t op asm("r0") = 0x18;
+  register uint32_t reason asm("r1") = status == 0 ? 0x20026 : 0x20023;
+  __asm volatile("bkpt 0xAB" : : "r"(op), "r"(reason) : "memory");
+
+  // No semihosting, so all we can do is stop here.
+  __disable_irq();
+  while (1)
+    __asm volatile("wfi");
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _OSPORTMPS2_H
+#define _OSPORTMPS2_H
+
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*!
+ * @brief Port of the kernel to the Arm MPS2 boards QEMU emulates, mps2-an386(Cortex-M4F) and mps2-an500(Cortex-M7)
+ * @note Unlike the host port this is the real Cortex-M kernel, TeensyThreads-asm.S and all, only the board around it is different:
+ * @note - _VectorsRam is a vector table in RAM that VTOR points at, so the kernel hooks PendSV and SVC the same way it does on the Teensy.
+ * @note - Systick counts millis(), and the CMSDK APB timer 0 stands in for the general purpose timer, firing on the next wake deadline.
+ * @note - QEMU has no DWT cycle counter, so the cycle counter is built from systick and counts nanoseconds of QEMU's virtual clock.
+ * @note   Run with -icount shift=0 and every nanosecond is exactly one instruction, so benchmark numbers are instruction counts that come out the same every run.
+ * @note - Serial is the CMSDK UART 0, which QEMU hands to -serial(stdio with -nographic).
+ */
+
+#include <stdint.h>
+
+/*!
+ * @brief Clock everything on the board runs off, systick and the CMSDK timers included
+ */
+static const uint32_t OS_MPS2_SYSCLK_HZ = 25000000;
+
+/*!
+ * @brief Nanoseconds in one clock of OS_MPS2_SYSCLK_HZ, the resolution of the cycle counter
+ */
+static const uint32_t OS_MPS2_NS_PER_CLOCK = 1000000000 / OS_MPS2_SYSCLK_HZ;
+
+/*!
+ * @brief Priority of the CMSDK timer interrupt, same as the general purpose timer on the Teensy
+ * @note Can be defined as a preprocessor command
+ */
+#ifndef EXTERN_OS_MPS2_TIMER_PRIORITY
+static const uint8_t OS_MPS2_TIMER_PRIORITY = 255;
+#else
+static const uint8_t OS_MPS2_TIMER_PRIORITY = EXTERN_OS_MPS2_TIMER_PRIORITY;
+#endif
+
+/*!
+ * @brief Starts up the board side of the kernel, called from threads_init()
+ * @note Hooks the CMSDK timer into _VectorsRam and starts it as the wake timer.
+ */
+void os_port_init(void);
+
+/*!
+ * @brief Sets when the wake timer fires next, stands in for the general purpose timer's compare
+ * @param uint32_t microseconds from now
+ */
+void os_port_timer_reprogram(uint32_t microseconds);
+
+/*!
+ * @returns Nanoseconds since reset, counted off systick
+ * @note Safe to call from anywhere, including with interrupts masked.
+ */
+uint64_t os_port_nanos(void);
+
+/*!
+ * @returns Microseconds since reset, what micros() gives, wraps every 71 minutes like on the Teensy
+ */
+uint32_t os_port_micros(void);
+
+/*!
+ * @returns Bottom 32 bits of os_port_nanos(), what the kernel reads as the cycle counter
+ * @note Cheaper than os_port_nanos() since it never needs 64 bit math.
+ */
+uint32_t os_port_cycles(void);
+
+/*!
+ * @brief Ends the emulator through semihosting, needs -semihosting on the QEMU command line
+ * @param int status, QEMU only tells apart zero and everything else
+ */
+void os_port_exit(int status) __attribute__((noreturn));
+
+#endif
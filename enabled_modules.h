@@ -2,5 +2,6 @@
 #define _ENABLED_MODULES_H
 
 #define MUTEX_MODULE
+#define FUTEX_MODULE
 
 #endif
\ No newline at end of file
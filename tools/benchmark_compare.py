@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+
+Compares two runs of the kernel benchmark suite, printed with
+os_print_benchmark_json(), and flags whatever got slower.
+
+Either file can be a whole serial log or program output, only lines that
+are a JSON object are read:
+
+    python3 tools/benchmark_compare.py old.txt new.txt
+    python3 tools/benchmark_compare.py old.txt new.txt --metric p99 --threshold 5
+
+Exits with 1 if any benchmark got slower by more than the threshold, so it
+can gate a release. Runs from different targets, or at different clock
+speeds, aren't comparable and are refused.
+
+    python3 tools/benchmark_compare.py --self-test
+"""
+
+import argparse
+import json
+import sys
+
+METRICS = ("min", "avg", "p50", "p90", "p99", "max")
+
+
+def load_results(lines):
+    """Returns {benchmark: result} out of every JSON object line, anything else is skipped"""
+    results = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith("{"):
+            continue
+        try:
+            result = json.loads(line)
+        except ValueError:
+            continue
+        if "benchmark" in result:
+            results[result["benchmark"]] = result
+    return results
+
+
+def compare(base, new, metric, threshold):
+    """Returns (rows, regressions), rows are (name, base value, new value, percent change or None)"""
+    rows = []
+    regressions = []
+    for name in list(base) + [n for n in new if n not in base]:
+        if name not in base or name not in new:
+            rows.append((name, base.get(name, {}).get(metric), new.get(name, {}).get(metric), None))
+            continue
+
+        old_value = base[name][metric]
+        new_value = new[name][metric]
+        if old_value == 0:
+            change = 0.0 if new_value == 0 else float("inf")
+        else:
+            change = (new_value - old_value) * 100.0 / old_value
+        rows.append((name, old_value, new_value, change))
+        if change > threshold:
+            regressions.append(name)
+    return rows, regressions
+
+
+def check_comparable(base, new):
+    """Returns why the runs can't be compared, or None"""
+    for key in ("target", "cycles_per_us"):
+        old = {r.get(key) for r in base.values()}
+        cur = {r.get(key) for r in new.values()}
+        if old != cur:
+            return "%s differs: %s vs %s" % (key, ", ".join(map(str, sorted(old, key=str))), ", ".join(map(str, sorted(cur, key=str))))
+    return None
+
+
+def print_rows(rows, regressions, metric, threshold, out):
+    out.write("%-22s %12s %12s %9s\n" % ("benchmark", "base " + metric, "new " + metric, "change"))
+    for name, old_value, new_value, change in rows:
+        if change is None:
+            status = "only in base" if new_value is None else "only in new"
+            out.write("%-22s %12s %12s %9s\n" % (name, "-" if old_value is None else old_value, "-" if new_value is None else new_value, status))
+            continue
+        flag = "  <-- slower" if name in regressions else ""
+        out.write("%-22s %12d %12d %+8.1f%%%s\n" % (name, old_value, new_value, change, flag))
+    if regressions:
+        out.write("%d benchmark(s) more than %.1f%% slower\n" % (len(regressions), threshold))
+
+
+def self_test():
+    base = load_results([
+        "Benchmarks on posix, 1000 cycles per us",
+        '{"benchmark":"yield","target":"posix","cycles_per_us":1000,"p50":1000,"p99":1200}',
+        '{"benchmark":"mutex_handoff","target":"posix","cycles_per_us":1000,"p50":2000,"p99":2500}',
+        "{ not json",
+    ])
+    new = load_results([
+        '{"benchmark":"yield","target":"posix","cycles_per_us":1000,"p50":1050,"p99":1300}',
+        '{"benchmark":"mutex_handoff","target":"posix","cycles_per_us":1000,"p50":2500,"p99":2500}',
+        '{"benchmark":"signal_wake","target":"posix","cycles_per_us":1000,"p50":900,"p99":950}',
+    ])
+    assert sorted(base) == ["mutex_handoff", "yield"]
+    assert check_comparable(base, new) is None
+
+    rows, regressions = compare(base, new, "p50", 10.0)
+    assert regressions == ["mutex_handoff"], regressions
+    assert [r[0] for r in rows] == ["yield", "mutex_handoff", "signal_wake"]
+    assert rows[2][3] is None
+
+    other = load_results(['{"benchmark":"yield","target":"qemu_mps2","cycles_per_us":1000,"p50":1}'])
+    assert check_comparable(base, other) is not None
+    print("self test passed")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two runs of the will-os kernel benchmark suite")
+    parser.add_argument("base", nargs="?", help="output of the run to compare against")
+    parser.add_argument("new", nargs="?", help="output of the new run")
+    parser.add_argument("--metric", choices=METRICS, default="p50", help="which number to compare (default p50)")
+    parser.add_argument("--threshold", type=float, default=10.0, help="percent slower that counts as a regression (default 10)")
+    parser.add_argument("--self-test", action="store_true", help="check the comparison logic and exit")
+    args = parser.parse_args()
+
+    if args.self_test:
+        self_test()
+        return 0
+    if args.base is None or args.new is None:
+        parser.error("need a base and a new run")
+
+    with open(args.base) as f:
+        base = load_results(f)
+    with open(args.new) as f:
+        new = load_results(f)
+    if not base or not new:
+        sys.stderr.write("no benchmark results in %s\n" % (args.base if not base else args.new))
+        return 2
+
+    reason = check_comparable(base, new)
+    if reason is not None:
+        sys.stderr.write("runs aren't comparable, %s\n" % reason)
+        return 2
+
+    rows, regressions = compare(base, new, args.metric, args.threshold)
+    print_rows(rows, regressions, args.metric, args.threshold, sys.stdout)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,227 @@
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*
+Host side simulation of the EDF class against fixed priorities.
+
+Runs the same periodic task sets through two dispatchers, one tick at a time:
+- Fixed priority, with rate monotonic priorities (shorter period, higher priority),
+  which is the best anyone can do by hand tuning static priorities.
+- Earliest deadline first, picking the earliest absolute deadline off of the same
+  DeadlineHeap the kernel uses for it's EDF ready set.
+
+Build and run from the root of the repo:
+  g++ -O2 -I. tools/edf_sim.cpp DS_HELPER/deadline_heap.cpp -o edf_sim && ./edf_sim
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include "DS_HELPER/deadline_heap.hpp"
+
+static const int SIM_MAX_TASKS = 8;
+
+/*!
+ * @brief One periodic task, deadlines are the same as the period
+ */
+typedef struct
+{
+  const char *name;
+  // Ticks of CPU time each job needs
+  uint32_t cost;
+  // Ticks between releases
+  uint32_t period;
+} sim_task_t;
+
+/*!
+ * @brief Task set we run through both dispatchers
+ */
+typedef struct
+{
+  const char *name;
+  int num_tasks;
+  sim_task_t tasks[SIM_MAX_TASKS];
+} sim_task_set_t;
+
+/*!
+ * @brief How a task did over the whole run
+ */
+typedef struct
+{
+  uint32_t jobs;
+  uint32_t misses;
+  uint32_t worst_response;
+} sim_task_result_t;
+
+/*!
+ * @brief Job that's currently out for a task
+ */
+typedef struct
+{
+  // Ticks of work the job still has left, 0 if it's done
+  uint32_t remaining;
+  uint64_t release;
+  uint64_t deadline;
+  DeadlineHeapNode node;
+} sim_job_t;
+
+enum sim_policy_t
+{
+  SIM_FIXED_PRIORITY,
+  SIM_EDF
+};
+
+/*!
+ * @returns Whether or not task a has a higher rate monotonic priority than task b
+ */
+static bool sim_rm_before(const sim_task_set_t *set, int a, int b)
+{
+  if (set->tasks[a].period != set->tasks[b].period)
+    return set->tasks[a].period < set->tasks[b].period;
+  return a < b;
+}
+
+/*!
+ * @brief Runs a task set for a number of ticks under a dispatch policy
+ * @note A job that misses it's deadline is dropped and counted as a miss, so one miss doesn't snowball into every other job.
+ */
+static void sim_run(const sim_task_set_t *set, sim_policy_t policy, uint64_t ticks, sim_task_result_t *results)
+{
+  sim_job_t jobs[SIM_MAX_TASKS];
+  DeadlineHeapNode *storage[SIM_MAX_TASKS];
+  DeadlineHeap ready;
+  ready.init(storage, SIM_MAX_TASKS);
+
+  for (int n = 0; n < set->num_tasks; n++)
+  {
+    jobs[n].remaining = 0;
+    jobs[n].node.ptr = &jobs[n];
+    results[n].jobs = 0;
+    results[n].misses = 0;
+    results[n].worst_response = 0;
+  }
+
+  for (uint64_t now = 0; now < ticks; now++)
+  {
+    for (int n = 0; n < set->num_tasks; n++)
+    {
+      sim_job_t *job = &jobs[n];
+
+      // Job still isn't done at it's deadline.
+      if (job->remaining && now >= job->deadline)
+      {
+        results[n].misses++;
+        job->remaining = 0;
+        ready.remove(&job->node);
+      }
+
+      if (now % set->tasks[n].period == 0)
+      {
+        job->remaining = set->tasks[n].cost;
+        job->release = now;
+        job->deadline = now + set->tasks[n].period;
+        results[n].jobs++;
+        ready.insert(&job->node, job->deadline);
+      }
+    }
+
+    int running = -1;
+    if (policy == SIM_EDF)
+    {
+      DeadlineHeapNode *top = ready.peek();
+      if (top != NULL)
+        running = (int)((sim_job_t *)top->ptr - jobs);
+    }
+    else
+    {
+      for (int n = 0; n < set->num_tasks; n++)
+        if (jobs[n].remaining && (running == -1 || sim_rm_before(set, n, running)))
+          running = n;
+    }
+
+    // Nothing to do this tick.
+    if (running == -1)
+      continue;
+
+    sim_job_t *job = &jobs[running];
+    if (--job->remaining == 0)
+    {
+      ready.remove(&job->node);
+      uint32_t response = (uint32_t)(now + 1 - job->release);
+      if (response > results[running].worst_response)
+        results[running].worst_response = response;
+    }
+  }
+}
+
+static uint64_t sim_gcd(uint64_t a, uint64_t b)
+{
+  while (b)
+  {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/*!
+ * @brief Runs a task set through both dispatchers and prints how each one did
+ * @note Total deadline misses under fixed priorities and under EDF go out through fixed_misses and edf_misses
+ */
+static void sim_compare(const sim_task_set_t *set, uint32_t *fixed_misses, uint32_t *edf_misses)
+{
+  double utilization = 0;
+  uint64_t hyperperiod = 1;
+  for (int n = 0; n < set->num_tasks; n++)
+  {
+    utilization += (double)set->tasks[n].cost / set->tasks[n].period;
+    hyperperiod = hyperperiod / sim_gcd(hyperperiod, set->tasks[n].period) * set->tasks[n].period;
+  }
+
+  // Schedule repeats every hyperperiod, so a few of them covers everything that can happen.
+  uint64_t ticks = hyperperiod * 4;
+
+  sim_task_result_t fixed[SIM_MAX_TASKS];
+  sim_task_result_t edf[SIM_MAX_TASKS];
+  sim_run(set, SIM_FIXED_PRIORITY, ticks, fixed);
+  sim_run(set, SIM_EDF, ticks, edf);
+
+  printf("%s: %d tasks, %.1f%% utilization, %llu ticks\n", set->name, set->num_tasks, utilization * 100, (unsigned long long)ticks);
+  printf("  %-10s %6s %6s | %12s %12s | %12s %12s\n", "task", "cost", "period", "fixed misses", "fixed worst", "edf misses", "edf worst");
+
+  *fixed_misses = 0;
+  *edf_misses = 0;
+  for (int n = 0; n < set->num_tasks; n++)
+  {
+    printf("  %-10s %6u %6u | %5u/%-6u %12u | %5u/%-6u %12u\n", set->tasks[n].name, set->tasks[n].cost, set->tasks[n].period,
+           fixed[n].misses, fixed[n].jobs, fixed[n].worst_response, edf[n].misses, edf[n].jobs, edf[n].worst_response);
+    *fixed_misses += fixed[n].misses;
+    *edf_misses += edf[n].misses;
+  }
+  printf("  fixed priority: %s, edf: %s\n\n", *fixed_misses ? "MISSES DEADLINES" : "schedulable", *edf_misses ? "MISSES DEADLINES" : "schedulable");
+}
+
+int main(void)
+{
+  // Every set is over 90% utilization and under 100%, so EDF should never miss.
+  static const sim_task_set_t sets[] = {
+      {"two tasks", 2, {{"a", 2, 5}, {"b", 4, 7}}},
+      {"control loop", 3, {{"imu", 1, 4}, {"motors", 2, 6}, {"telemetry", 6, 15}}},
+      {"mixed rates", 4, {{"fast", 1, 5}, {"mid", 3, 10}, {"slow", 6, 14}, {"log", 2, 40}}},
+  };
+
+  int fixed_failed = 0;
+  int edf_failed = 0;
+  for (size_t n = 0; n < sizeof(sets) / sizeof(sets[0]); n++)
+  {
+    uint32_t fixed_misses, edf_misses;
+    sim_compare(&sets[n], &fixed_misses, &edf_misses);
+    fixed_failed += fixed_misses != 0;
+    edf_failed += edf_misses != 0;
+  }
+
+  printf("fixed priority missed deadlines in %d of %d sets, edf in %d\n", fixed_failed, (int)(sizeof(sets) / sizeof(sets[0])), edf_failed);
+  return edf_failed ? 1 : 0;
+}
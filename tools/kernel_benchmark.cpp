@@ -0,0 +1,74 @@
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*
+Sketch that runs the kernel benchmark suite once and exits, so a run can be scripted and compared against the last one.
+Exits with 1 if priority inheritance didn't bound how long the inversion benchmark's high priority thread was blocked.
+Prints a table, and then the same results as JSON lines for tools/benchmark_compare.py:
+  ./kernel_benchmark > new.txt && python3 tools/benchmark_compare.py old.txt new.txt
+
+Builds for any board, but it's meant for the ports that can exit:
+- PORT/POSIX, where numbers are nanoseconds on the host.
+- PORT/QEMU_MPS2, where it's the real Cortex-M context switch and, with -icount shift=0, numbers are instruction counts.
+See the README.MD of each port for how to build it, it needs -DBENCHMARK_MODULE.
+*/
+
+#include "OS/OSThreadKernel.h"
+#include "OS/OSBenchmarkKernel.h"
+
+#ifndef BENCHMARK_MODULE
+#error "kernel_benchmark.cpp needs BENCHMARK_MODULE"
+#endif
+
+static const uint32_t BENCHMARK_ITERATIONS = 1000;
+
+static os_benchmark_entry_t results[OS_BENCHMARK_SUITE_LEN];
+
+/*!
+ * @brief Checks the high priority thread in the inversion benchmark was only held up by the low one, and not the medium one too
+ * @returns false if priority inheritance didn't bound the blocking
+ */
+static bool check_inversion(const os_benchmark_entry_t *entries, int count)
+{
+  // Held up for the hold time plus switches and wake up lateness with inheritance, the medium thread's run on top of that without.
+  uint32_t bound_us = OS_BENCHMARK_INVERSION_HOLD_US + OS_BENCHMARK_INVERSION_MEDIUM_US / 2;
+  for (int n = 0; n < count; n++)
+  {
+    if (strcmp(entries[n].name, "inversion_inherit") != 0)
+      continue;
+
+    uint32_t blocked_us = entries[n].result.p90_cycles / os_benchmark_cycles_per_us();
+    bool bounded = entries[n].result.samples > 0 && blocked_us < bound_us;
+    Serial.printf("inversion: high priority thread blocked %lu us at p90 with inheritance, bound %lu us, %s\n",
+                  (unsigned long)blocked_us, (unsigned long)bound_us, bounded ? "ok" : "FAIL");
+    return bounded;
+  }
+  return false;
+}
+
+static void benchmark_thread(void *arg)
+{
+  (void)arg;
+  int count = os_benchmark_run_suite(results, OS_BENCHMARK_SUITE_LEN, BENCHMARK_ITERATIONS);
+  os_print_benchmark_results(&Serial, results, count);
+  Serial.println();
+  os_print_benchmark_json(&Serial, results, count);
+  bool inversion_bounded = check_inversion(results, count);
+
+  Serial.flush();
+  exit(inversion_bounded ? 0 : 1);
+}
+
+void setup()
+{
+  threads_init();
+
+  // Stopped while we add the thread, so setup() gets to finish first.
+  os_stop();
+  os_add_thread(benchmark_thread, NULL, 100, 4096, NULL);
+  os_start(-1);
+}
+
+void loop() {}
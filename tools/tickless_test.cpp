@@ -0,0 +1,136 @@
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*
+Host side checks of the tickless deadline math in OS/OSTicklessKernel.h.
+
+Picks the earliest deadline out of a set of waiting threads, and works out how long the kernel
+timer gets programmed for, clamped between OS_TICKLESS_MIN_SLEEP_US and OS_TICKLESS_MAX_SLEEP_US.
+Prints every check that fails and exits with 1 if any did.
+
+Build and run from the root of the repo:
+  g++ -O2 -I. tools/tickless_test.cpp -o tickless_test && ./tickless_test
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include "OS/OSTicklessKernel.h"
+
+static int checks = 0;
+static int failures = 0;
+
+/*!
+ * @brief Counts a check, printing it if it failed
+ */
+static void check(bool pass, const char *name, unsigned long long got, unsigned long long expected)
+{
+  checks++;
+  if (pass)
+    return;
+  failures++;
+  printf("FAIL %s: got %llu, expected %llu\n", name, got, expected);
+}
+
+/*!
+ * @brief Timer length for a single waiting thread
+ */
+static uint32_t timer_for(uint64_t deadline_us, uint64_t now_us)
+{
+  os_tickless_deadline_t deadline;
+  os_tickless_deadline_reset(&deadline);
+  os_tickless_deadline_add(&deadline, deadline_us);
+  return os_tickless_timer_us(&deadline, now_us);
+}
+
+/*!
+ * @brief Earliest deadline out of the waiting threads, whatever order they're added in
+ */
+static void check_next_deadline(void)
+{
+  os_tickless_deadline_t deadline;
+  os_tickless_deadline_reset(&deadline);
+  check(!deadline.valid, "nothing waiting is invalid", deadline.valid, false);
+
+  static const uint64_t deadlines[] = {5000, 3000, 9000, 3000, 4000};
+  for (size_t n = 0; n < sizeof(deadlines) / sizeof(deadlines[0]); n++)
+    os_tickless_deadline_add(&deadline, deadlines[n]);
+  check(deadline.valid, "deadline added is valid", deadline.valid, true);
+  check(deadline.deadline_us == 3000, "earliest of several", deadline.deadline_us, 3000);
+
+  // First deadline added has to win even if it's later than the 0 reset leaves behind.
+  os_tickless_deadline_reset(&deadline);
+  os_tickless_deadline_add(&deadline, 7000);
+  check(deadline.deadline_us == 7000, "first deadline after a reset", deadline.deadline_us, 7000);
+
+  // Reset has to forget the last round's earliest deadline.
+  os_tickless_deadline_add(&deadline, 2000);
+  os_tickless_deadline_reset(&deadline);
+  os_tickless_deadline_add(&deadline, 8000);
+  check(deadline.deadline_us == 8000, "reset forgets the last round", deadline.deadline_us, 8000);
+}
+
+/*!
+ * @brief How long the timer gets programmed for, and the clamps on either end
+ */
+static void check_timer_clamp(void)
+{
+  const uint64_t now = 1000000;
+
+  os_tickless_deadline_t nothing;
+  os_tickless_deadline_reset(&nothing);
+  check(os_tickless_timer_us(&nothing, now) == OS_TICKLESS_MAX_SLEEP_US, "nothing waiting sleeps the longest", os_tickless_timer_us(&nothing, now), OS_TICKLESS_MAX_SLEEP_US);
+
+  check(timer_for(now + 500, now) == 500, "deadline in range", timer_for(now + 500, now), 500);
+
+  // Passed or too close to program, so as soon as we can.
+  check(timer_for(now - 1, now) == OS_TICKLESS_MIN_SLEEP_US, "deadline passed", timer_for(now - 1, now), OS_TICKLESS_MIN_SLEEP_US);
+  check(timer_for(0, now) == OS_TICKLESS_MIN_SLEEP_US, "deadline long passed", timer_for(0, now), OS_TICKLESS_MIN_SLEEP_US);
+  check(timer_for(now, now) == OS_TICKLESS_MIN_SLEEP_US, "deadline right now", timer_for(now, now), OS_TICKLESS_MIN_SLEEP_US);
+  check(timer_for(now + OS_TICKLESS_MIN_SLEEP_US, now) == OS_TICKLESS_MIN_SLEEP_US, "deadline at the minimum",
+        timer_for(now + OS_TICKLESS_MIN_SLEEP_US, now), OS_TICKLESS_MIN_SLEEP_US);
+  check(timer_for(now + OS_TICKLESS_MIN_SLEEP_US + 1, now) == OS_TICKLESS_MIN_SLEEP_US + 1, "deadline just past the minimum",
+        timer_for(now + OS_TICKLESS_MIN_SLEEP_US + 1, now), OS_TICKLESS_MIN_SLEEP_US + 1);
+
+  // Far off, so we still check in every OS_TICKLESS_MAX_SLEEP_US.
+  check(timer_for(now + OS_TICKLESS_MAX_SLEEP_US - 1, now) == OS_TICKLESS_MAX_SLEEP_US - 1, "deadline just under the maximum",
+        timer_for(now + OS_TICKLESS_MAX_SLEEP_US - 1, now), OS_TICKLESS_MAX_SLEEP_US - 1);
+  check(timer_for(now + OS_TICKLESS_MAX_SLEEP_US, now) == OS_TICKLESS_MAX_SLEEP_US, "deadline at the maximum",
+        timer_for(now + OS_TICKLESS_MAX_SLEEP_US, now), OS_TICKLESS_MAX_SLEEP_US);
+  check(timer_for(now + 0x100000000ULL + 500, now) == OS_TICKLESS_MAX_SLEEP_US, "deadline past a 32 bit wrap",
+        timer_for(now + 0x100000000ULL + 500, now), OS_TICKLESS_MAX_SLEEP_US);
+  check(timer_for(UINT64_MAX, now) == OS_TICKLESS_MAX_SLEEP_US, "deadline that never comes", timer_for(UINT64_MAX, now), OS_TICKLESS_MAX_SLEEP_US);
+
+  // The 64 bit clock carries on where the 32 bit timer wraps.
+  const uint64_t wrap = 0xFFFFFF00ULL;
+  check(timer_for(wrap + 0x200, wrap) == 0x200, "deadline across the 32 bit wrap", timer_for(wrap + 0x200, wrap), 0x200);
+}
+
+/*!
+ * @brief Several threads at once, the timer goes off for whichever is first
+ */
+static void check_earliest_programs_timer(void)
+{
+  const uint64_t now = 50000;
+  os_tickless_deadline_t deadline;
+  os_tickless_deadline_reset(&deadline);
+  os_tickless_deadline_add(&deadline, now + 20000);
+  os_tickless_deadline_add(&deadline, now + 750);
+  os_tickless_deadline_add(&deadline, now + 3000000);
+  check(os_tickless_timer_us(&deadline, now) == 750, "timer set for the earliest thread", os_tickless_timer_us(&deadline, now), 750);
+
+  // One of them already ran out, so the rest wait on it.
+  os_tickless_deadline_add(&deadline, now - 100);
+  check(os_tickless_timer_us(&deadline, now) == OS_TICKLESS_MIN_SLEEP_US, "one thread already late", os_tickless_timer_us(&deadline, now), OS_TICKLESS_MIN_SLEEP_US);
+}
+
+int main(void)
+{
+  check_next_deadline();
+  check_timer_clamp();
+  check_earliest_programs_timer();
+
+  printf("%d of %d tickless checks passed\n", checks - failures, checks);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/*
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+*/
+
+/*
+Sketch that checks threads at the same priority take turns, even when neither of them ever blocks or yields.
+Two threads busy loop at the same priority, and a higher priority checker wakes up once in a while to see that
+both of them got the CPU in between and both used up whole time slices. A third thread above them wakes up every millisecond,
+and since being preempted doesn't end a slice, the busy threads shouldn't use up slices any faster for it.
+Prints PASS or FAIL and exits with 0 or 1.
+
+Builds for the ports that can exit, see the README.MD of each port for how to build a sketch:
+- PORT/POSIX, where systick is a SIGALRM timer.
+- PORT/QEMU_MPS2, where it's the real systick counting down the slice in the assembly context_switch().
+*/
+
+#include "OS/OSThreadKernel.h"
+
+/*!
+ * @brief Priority both busy threads run at, the checker runs above it
+ */
+static const uint8_t BUSY_PRIORITY = 100;
+
+/*!
+ * @brief How long the checker lets the busy threads fight it out each round
+ */
+static const uint32_t CHECK_PERIOD_MS = 100;
+static const int CHECK_ROUNDS = 5;
+
+/*!
+ * @brief Slice each busy thread gets, in systick milliseconds
+ */
+static const int BUSY_SLICE_TICKS = 10;
+
+/*!
+ * @brief How far each busy thread got, the checker reads them
+ */
+static volatile uint32_t busy_count[2];
+static os_thread_id_t busy_id[2];
+
+/*!
+ * @brief Never blocks or yields, only systick running out it's slice lets the other one in
+ * @param void *arg which of the two counters is ours
+ */
+static void busy_thread(void *arg)
+{
+  volatile uint32_t *count = &busy_count[(uintptr_t)arg];
+  while (1)
+    (*count)++;
+}
+
+/*!
+ * @brief Wakes up on a deadline every millisecond, preempting whichever busy thread is running
+ */
+static void wake_thread(void *arg)
+{
+  (void)arg;
+  while (1)
+    os_thread_sleep_ms(1);
+}
+
+static void check_thread(void *arg)
+{
+  (void)arg;
+  bool pass = true;
+  uint64_t start_us = os_micros64();
+  for (int round = 0; round < CHECK_ROUNDS; round++)
+  {
+    uint32_t before[2] = {busy_count[0], busy_count[1]};
+    os_thread_sleep_ms(CHECK_PERIOD_MS);
+
+    // Whichever one got the CPU first would have it the whole time without slicing.
+    for (int n = 0; n < 2; n++)
+    {
+      if (busy_count[n] == before[n])
+      {
+        Serial.printf("round %d: busy thread %d made no progress\n", round, n);
+        pass = false;
+      }
+    }
+  }
+
+  uint32_t total_slices = 0;
+  for (int n = 0; n < 2; n++)
+  {
+    uint32_t slices = os_get_thread_slices(busy_id[n]);
+    Serial.printf("busy thread %d: count %lu, %lu slices used up\n", n, (unsigned long)busy_count[n], (unsigned long)slices);
+    if (slices == 0)
+      pass = false;
+    total_slices += slices;
+  }
+
+  // Only one busy thread runs at a time, so together they can't use up more than one slice every BUSY_SLICE_TICKS,
+  // twice that leaves room for the checker's own time. If wake deadlines ended slices it'd be one every millisecond.
+  uint32_t elapsed_ms = (uint32_t)((os_micros64() - start_us) / 1000);
+  uint32_t most_slices = 2 * elapsed_ms / BUSY_SLICE_TICKS;
+  if (total_slices > most_slices)
+  {
+    Serial.printf("%lu slices used up in %lu ms, more than %lu\n", (unsigned long)total_slices, (unsigned long)elapsed_ms, (unsigned long)most_slices);
+    pass = false;
+  }
+
+  Serial.println(pass ? "PASS" : "FAIL");
+  Serial.flush();
+  exit(pass ? 0 : 1);
+}
+
+void setup()
+{
+  threads_init();
+
+  // Stopped while we add the threads, so setup() gets to finish first.
+  os_stop();
+  busy_id[0] = os_add_thread(busy_thread, (void *)0, BUSY_PRIORITY, 1024, NULL, BUSY_SLICE_TICKS);
+  busy_id[1] = os_add_thread(busy_thread, (void *)1, BUSY_PRIORITY, 1024, NULL, BUSY_SLICE_TICKS);
+  os_add_thread(check_thread, NULL, BUSY_PRIORITY + 1, 4096, NULL);
+  os_add_thread(wake_thread, NULL, BUSY_PRIORITY + 2, 1024, NULL);
+  os_start(-1);
+}
+
+void loop() {}
@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""
+Author: William Redenbaugh
+Last Edit Date: 10/16/2026
+
+Decodes a kernel trace dumped with os_trace_dump() into Chrome trace JSON,
+which opens in Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+Every thread gets a track showing when it was running, and when it was woken
+up but still waiting for the CPU, which is the scheduling latency. Blocks,
+wakeups and user markers show up as instant events, and interrupts get a track
+of their own.
+
+    python3 tools/trace_to_perfetto.py trace.bin -o trace.json
+
+Record layout has to match os_trace_header_t and os_trace_record_t in
+OS/OSTraceKernel.h. To check the decoder without a board:
+
+    python3 tools/trace_to_perfetto.py --self-test
+    python3 tools/trace_to_perfetto.py --synthetic synthetic.bin
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x54534F57
+TRACE_VERSION = 1
+
+HEADER = struct.Struct("<IHHIII")
+RECORD = struct.Struct("<IBBBBI")
+
+# os_trace_event_t
+TRACE_SWITCH = 1
+TRACE_WAKE = 2
+TRACE_BLOCK = 3
+TRACE_ISR_ENTER = 4
+TRACE_ISR_EXIT = 5
+TRACE_MARKER = 6
+
+# thread_state_t
+THREAD_STATES = {
+    0: "empty",
+    1: "running",
+    2: "ended",
+    3: "ending",
+    4: "suspended",
+    5: "sleeping",
+    6: "semaphore",
+    7: "semaphore",
+    8: "mutex",
+    9: "mutex",
+    10: "signal",
+    11: "signal",
+    12: "queue",
+    13: "futex",
+    14: "futex",
+}
+
+# Interrupts get their own track, out of the way of any thread id.
+IRQ_TID = 1000
+
+
+def decode(data):
+    """Splits a dump into it's header and records, with timestamps unwrapped to microseconds."""
+    if len(data) < HEADER.size:
+        raise ValueError("dump is shorter than the header")
+
+    magic, version, record_size, cycles_per_us, count, dropped = HEADER.unpack_from(data, 0)
+    if magic != TRACE_MAGIC:
+        raise ValueError("bad magic 0x%08x, not a trace dump" % magic)
+    if version != TRACE_VERSION:
+        raise ValueError("trace version %d, we only know version %d" % (version, TRACE_VERSION))
+    if record_size != RECORD.size:
+        raise ValueError("records are %d bytes, expected %d" % (record_size, RECORD.size))
+    if len(data) < HEADER.size + count * RECORD.size:
+        raise ValueError("dump says %d records but is cut short" % count)
+
+    header = {"cycles_per_us": cycles_per_us, "count": count, "dropped": dropped}
+
+    records = []
+    first = None
+    last = None
+    wraps = 0
+    for n in range(count):
+        cycles, event, thread, other, arg, value = RECORD.unpack_from(data, HEADER.size + n * RECORD.size)
+
+        # Cycle counter is 32 bits, records are in order, so any step backwards is a wrap.
+        if last is not None and cycles < last:
+            wraps += 1
+        last = cycles
+        total = (wraps << 32) + cycles
+        if first is None:
+            first = total
+
+        records.append({
+            "ts": (total - first) / float(cycles_per_us),
+            "event": event,
+            "thread": thread,
+            "other": other,
+            "arg": arg,
+            "data": value,
+        })
+
+    return header, records
+
+
+def to_chrome_trace(header, records):
+    """Turns decoded records into a Chrome trace JSON object."""
+    events = []
+    threads = set()
+
+    running = None
+    running_since = 0.0
+    woken_at = {}
+    irq_stack = []
+
+    def slice_event(name, tid, start, end, args=None):
+        event = {"name": name, "ph": "X", "pid": 0, "tid": tid, "ts": start, "dur": max(end - start, 0.0)}
+        if args:
+            event["args"] = args
+        events.append(event)
+
+    def instant_event(name, tid, ts, args=None):
+        event = {"name": name, "ph": "i", "s": "t", "pid": 0, "tid": tid, "ts": ts}
+        if args:
+            event["args"] = args
+        events.append(event)
+
+    for record in records:
+        ts = record["ts"]
+        thread = record["thread"]
+        threads.add(thread)
+
+        # Whoever was running at the first record has been running since the start of the trace.
+        if running is None:
+            running = thread
+            running_since = ts
+
+        event = record["event"]
+        if event == TRACE_SWITCH:
+            incoming = record["other"]
+            threads.add(incoming)
+            slice_event("running", thread, running_since, ts, {
+                "switched_out": THREAD_STATES.get(record["arg"], str(record["arg"])),
+                "voluntary": bool(record["data"]),
+            })
+
+            # Time between being woken up and actually getting the CPU.
+            if incoming in woken_at:
+                slice_event("runnable", incoming, woken_at[incoming], ts, {"latency_us": ts - woken_at[incoming]})
+                del woken_at[incoming]
+
+            running = incoming
+            running_since = ts
+
+        elif event == TRACE_WAKE:
+            woken = record["other"]
+            threads.add(woken)
+            instant_event("woken", woken, ts, {
+                "by_thread": thread,
+                "from": THREAD_STATES.get(record["arg"], str(record["arg"])),
+            })
+            # A thread can already be the one running, if it timed out while the kernel was busy with it.
+            if woken != running:
+                woken_at[woken] = ts
+
+        elif event == TRACE_BLOCK:
+            instant_event("blocked on " + THREAD_STATES.get(record["arg"], str(record["arg"])), thread, ts, {
+                "object": "0x%08x" % record["data"],
+            })
+
+        elif event == TRACE_ISR_ENTER:
+            irq_stack.append((record["arg"], ts))
+
+        elif event == TRACE_ISR_EXIT:
+            # Interrupts nest, so the exit closes the most recent matching entry.
+            for n in range(len(irq_stack) - 1, -1, -1):
+                if irq_stack[n][0] == record["arg"]:
+                    irq, start = irq_stack.pop(n)
+                    slice_event("irq %d" % irq, IRQ_TID, start, ts, {"interrupted_thread": thread})
+                    break
+
+        elif event == TRACE_MARKER:
+            instant_event("marker %d" % record["arg"], thread, ts, {"value": record["data"]})
+
+    # Close out whatever was still going when the trace was dumped.
+    if records:
+        end = records[-1]["ts"]
+        slice_event("running", running, running_since, end)
+        for woken, start in woken_at.items():
+            slice_event("runnable", woken, start, end, {"latency_us": end - start})
+
+    metadata = [{"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "will-os"}}]
+    for thread in sorted(threads):
+        metadata.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": thread, "args": {"name": "thread %d" % thread}})
+    metadata.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": IRQ_TID, "args": {"name": "interrupts"}})
+
+    return {
+        "traceEvents": metadata + events,
+        "displayTimeUnit": "ns",
+        "otherData": {"dropped_records": header["dropped"], "cycles_per_us": header["cycles_per_us"]},
+    }
+
+
+def synthetic_dump():
+    """
+    Builds a small dump by hand, the way the kernel would write it.
+    Thread 1 blocks on a mutex and the idle thread(2) runs, an interrupt wakes thread 1 back up
+    and it gets the CPU 10us later. Starts just short of the cycle counter wrapping.
+    """
+    cycles_per_us = 600
+    start = (1 << 32) - 30 * cycles_per_us
+
+    def at(us):
+        return (start + us * cycles_per_us) & 0xFFFFFFFF
+
+    records = [
+        (at(0), TRACE_MARKER, 1, 0, 7, 1234),
+        (at(5), TRACE_BLOCK, 1, 1, 9, 0x20001000),
+        (at(5), TRACE_SWITCH, 1, 2, 9, 1),
+        (at(100), TRACE_ISR_ENTER, 2, 0, 20, 0),
+        (at(102), TRACE_WAKE, 2, 1, 9, 0),
+        (at(104), TRACE_ISR_EXIT, 2, 0, 20, 0),
+        (at(112), TRACE_SWITCH, 2, 1, 1, 0),
+        (at(150), TRACE_MARKER, 1, 0, 8, 5678),
+    ]
+
+    data = HEADER.pack(TRACE_MAGIC, TRACE_VERSION, RECORD.size, cycles_per_us, len(records), 0)
+    for record in records:
+        data += RECORD.pack(*record)
+    return data
+
+
+def self_test():
+    """Decodes the synthetic dump and checks the timeline came out right."""
+    header, records = decode(synthetic_dump())
+    trace = to_chrome_trace(header, records)
+    events = trace["traceEvents"]
+
+    def find(name, tid):
+        return [e for e in events if e.get("name") == name and e.get("tid") == tid]
+
+    def close(a, b):
+        return abs(a - b) < 1e-6
+
+    assert len(records) == 8, "expected 8 records"
+    assert close(records[-1]["ts"], 150.0), "cycle counter wrap wasn't unwrapped"
+
+    running_1 = find("running", 1)
+    assert len(running_1) == 2, "thread 1 should have run twice"
+    assert close(running_1[0]["ts"], 0.0) and close(running_1[0]["dur"], 5.0)
+    assert running_1[0]["args"]["switched_out"] == "mutex" and running_1[0]["args"]["voluntary"]
+    assert close(running_1[1]["ts"], 112.0) and close(running_1[1]["dur"], 38.0)
+
+    idle = find("running", 2)
+    assert len(idle) == 1 and close(idle[0]["ts"], 5.0) and close(idle[0]["dur"], 107.0)
+    assert idle[0]["args"]["voluntary"] is False
+
+    runnable = find("runnable", 1)
+    assert len(runnable) == 1 and close(runnable[0]["args"]["latency_us"], 10.0), "scheduling latency should be 10us"
+
+    irq = find("irq 20", IRQ_TID)
+    assert len(irq) == 1 and close(irq[0]["ts"], 100.0) and close(irq[0]["dur"], 4.0)
+
+    assert len(find("blocked on mutex", 1)) == 1
+    assert len(find("marker 7", 1)) == 1 and len(find("marker 8", 1)) == 1
+
+    # Has to survive a round trip through JSON.
+    json.loads(json.dumps(trace))
+    print("self test passed")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a will-os kernel trace dump into Chrome/Perfetto trace JSON")
+    parser.add_argument("dump", nargs="?", help="binary dump written by os_trace_dump()")
+    parser.add_argument("-o", "--output", help="where to write the JSON, stdout if not given")
+    parser.add_argument("--synthetic", metavar="PATH", help="write a synthetic dump to PATH and exit")
+    parser.add_argument("--self-test", action="store_true", help="decode a synthetic dump and check the result")
+    args = parser.parse_args()
+
+    if args.self_test:
+        self_test()
+        return 0
+
+    if args.synthetic:
+        with open(args.synthetic, "wb") as f:
+            f.write(synthetic_dump())
+        return 0
+
+    if not args.dump:
+        parser.error("need a dump to decode")
+
+    with open(args.dump, "rb") as f:
+        header, records = decode(f.read())
+
+    if header["dropped"]:
+        sys.stderr.write("%d older records were overwritten before the dump\n" % header["dropped"])
+
+    trace = to_chrome_trace(header, records)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())